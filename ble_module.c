@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "ble_module.h"
 
@@ -48,23 +49,33 @@
 #include "ble_hci.h"
 
 #include "softdevice_handler.h"
+#include "fstorage.h"
+#include "fds.h"
 
 #include "ble_advdata.h"
 #include "ble_nus_c.h"
+#include "nrf_ble_gatt.h"
 #include "nrf_delay.h"
 
 #include "ninebot_module.h"
+#include "peer_cache.h"
+#include "ride_log.h"
+#include "conn_param_manager.h"
+#include "tx_power_control.h"
+#include "telemetry_relay.h"
 
+#include "sdk_config.h"
 #define NRF_LOG_MODULE_NAME "BLM"
+#if BLE_MODULE_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       BLE_MODULE_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
 #include "nrf_log.h"
 #include "nrf_log_ctrl.h"
 
-#define CENTRAL_LINK_COUNT      1                               /**< Number of central links used by the application. When changing this number remember to adjust the RAM settings*/
-#define PERIPHERAL_LINK_COUNT   0                               /**< Number of peripheral links used by the application. When changing this number remember to adjust the RAM settings*/
-
-#if (NRF_SD_BLE_API_VERSION == 3)
-#define NRF_BLE_MAX_MTU_SIZE    GATT_MTU_SIZE_DEFAULT           /**< MTU size used in the softdevice enabling and to reply to a BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST event. */
-#endif
+#define CENTRAL_LINK_COUNT      SCOOTER_LINK_COUNT              /**< Number of central links used by the application. When changing this number remember to adjust the RAM settings*/
+#define PERIPHERAL_LINK_COUNT   TELEMETRY_RELAY_ENABLED         /**< Number of peripheral links used by the application. When changing this number remember to adjust the RAM settings*/
 
 //#define UART_TX_BUF_SIZE        256                             /**< UART TX buffer size. */
 //#define UART_RX_BUF_SIZE        256                             /**< UART RX buffer size. */
@@ -74,45 +85,88 @@
 #define APP_TIMER_PRESCALER     0                               /**< Value of the RTC1 PRESCALER register. */
 #define APP_TIMER_OP_QUEUE_SIZE 2                               /**< Size of timer operation queues. */
                                                                 
-#define SCAN_INTERVAL           0x00A0                          /**< Determines scan interval in units of 0.625 millisecond. */
-#define SCAN_WINDOW             0x0050                          /**< Determines scan window in units of 0.625 millisecond. */
-#define SCAN_ACTIVE             1                               /**< If 1, performe active scanning (scan requests). */
-#define SCAN_SELECTIVE          0                               /**< If 1, ignore unknown devices (non whitelisted). */
-#define SCAN_TIMEOUT            0x0000                          /**< */
-                                                                
-#define MIN_CONNECTION_INTERVAL MSEC_TO_UNITS(20, UNIT_1_25_MS) /**< Determines minimum connection interval in millisecond. */
-#define MAX_CONNECTION_INTERVAL MSEC_TO_UNITS(75, UNIT_1_25_MS) /**< Determines maximum connection interval in millisecond. */
-#define SLAVE_LATENCY           0                               /**< Determines slave latency in counts of connection events. */
-#define SUPERVISION_TIMEOUT     MSEC_TO_UNITS(4000, UNIT_10_MS) /**< Determines supervision time-out in units of 10 millisecond. */
+#define SCAN_FAST_INTERVAL      MSEC_TO_UNITS(100, UNIT_0_625_MS)  /**< Scan interval right after boot/disconnect. */
+#define SCAN_FAST_WINDOW        MSEC_TO_UNITS(50, UNIT_0_625_MS)   /**< Scan window right after boot/disconnect (50% duty). */
+#define SCAN_FAST_TIMEOUT       30                                 /**< Seconds before backing off to the slow scan. */
+#define SCAN_SLOW_INTERVAL      MSEC_TO_UNITS(640, UNIT_0_625_MS)  /**< Passive scan interval once the scooter didn't show up. */
+#define SCAN_SLOW_WINDOW        MSEC_TO_UNITS(30, UNIT_0_625_MS)   /**< ~5% duty. */
+#define SCAN_SLOW_TIMEOUT       120                                /**< Seconds before backing off to the idle scan. */
+#define SCAN_IDLE_INTERVAL      MSEC_TO_UNITS(2560, UNIT_0_625_MS) /**< Passive scan interval when left searching (e.g. in the garage). */
+#define SCAN_IDLE_WINDOW        MSEC_TO_UNITS(30, UNIT_0_625_MS)   /**< ~1% duty, still catches a 100ms advertiser within a few seconds. */
+#define SCAN_IDLE_TIMEOUT       0x0000                             /**< Scan until found. */
+#define SCAN_USE_WHITELIST      0                               /**< If 1 and a scooter is cached, only that address is reported by the SoftDevice. */
+
+#define SCOOTER_NAME_PREFIX     "MIScooter"                     /**< Advertised local name prefix, see resources/protocolo.txt. */
+#define SCOOTER_COMPANY_ID      0x424E                          /**< Manufacturer data prefix 4e 42 ("NB"), see resources/protocolo.txt. */
+
+#define FAST_SCAN_INTERVAL      MSEC_TO_UNITS(30, UNIT_0_625_MS) /**< Scan interval used when reconnecting to the cached peer. */
+#define FAST_SCAN_WINDOW        MSEC_TO_UNITS(30, UNIT_0_625_MS) /**< Scan window used when reconnecting to the cached peer (100% duty). */
+#define FAST_SCAN_TIMEOUT       3                               /**< Seconds to wait for the cached peer before falling back to a full scan. */
                                                                 
 #define UUID16_SIZE             2                               /**< Size of 16 bit UUID */
 #define UUID32_SIZE	            4                               /**< Size of 32 bit UUID */
 #define UUID128_SIZE            16                              /**< Size of 128 bit UUID */
 
-static ble_nus_c_t              m_ble_nus_c;                    /* Nordic UART Service */
-static ble_db_discovery_t       m_ble_db_discovery;
+#define NO_LINK                 0xFF                            /**< link_find result when no slot matches. */
+
+typedef enum {scan_state_idle, scan_state_scanning, scan_state_connecting} scan_state_t;
+
+typedef struct {
+  uint16_t                      conn_handle;                    /* BLE_CONN_HANDLE_INVALID while the slot is free */
+  ble_gap_addr_t                peer_addr;
+  bool                          validating_cache;               /* waiting for the CCCD write response on cached handles */
+  bool                          discovery_pending;              /* waiting for its turn at service discovery */
+} scooter_link_t;
+
+// One slot per scooter, the index is the link number handed to ninebot_module.
+static ble_nus_c_t              m_ble_nus_c[CENTRAL_LINK_COUNT];        /* Nordic UART Service */
+static ble_db_discovery_t       m_ble_db_discovery[CENTRAL_LINK_COUNT];
+static scooter_link_t           m_links[CENTRAL_LINK_COUNT];
+static nrf_ble_gatt_t           m_gatt;                         /* ATT_MTU negotiation */
+
+static scan_state_t             m_scan_state;                   /* the SoftDevice runs one scan or one pending connect at a time */
+static bool                     m_scan_pending;                 /* scan_start was called before the peer cache was loaded */
+static bool                     m_fast_connect_tried;           /* cached peer already tried since the last disconnect */
+static uint8_t                  m_scan_phase;                   /* index into m_scan_params, advances on each scan timeout */
+static uint8_t                  m_discovering_link = NO_LINK;   /* ble_db_discovery keeps global state, links take turns */
 
 /**
- * @brief Connection parameters requested for connection.
+ * @brief Parameters used when scanning, each phase runs until its timeout and then backs off to the next.
+ *
+ * @details Only the first phase is active, the name and manufacturer data we filter on are in the
+ *          advertising packet itself so the scan requests are just extra radio time.
  */
-static const ble_gap_conn_params_t m_connection_param =
+static const ble_gap_scan_params_t m_scan_params[] =
+{
   {
-    (uint16_t)MIN_CONNECTION_INTERVAL,  // Minimum connection
-    (uint16_t)MAX_CONNECTION_INTERVAL,  // Maximum connection
-    (uint16_t)SLAVE_LATENCY,            // Slave latency
-    (uint16_t)SUPERVISION_TIMEOUT       // Supervision time-out
-  };
-
+    .active   = 1,
+    .interval = SCAN_FAST_INTERVAL,
+    .window   = SCAN_FAST_WINDOW,
+    .timeout  = SCAN_FAST_TIMEOUT,
+  },
+  {
+    .active   = 0,
+    .interval = SCAN_SLOW_INTERVAL,
+    .window   = SCAN_SLOW_WINDOW,
+    .timeout  = SCAN_SLOW_TIMEOUT,
+  },
+  {
+    .active   = 0,
+    .interval = SCAN_IDLE_INTERVAL,
+    .window   = SCAN_IDLE_WINDOW,
+    .timeout  = SCAN_IDLE_TIMEOUT,
+  },
+};
 
 /**
- * @brief Parameters used when scanning.
+ * @brief Parameters used when connecting, to the cached peer or to a scooter we just heard.
  */
-static const ble_gap_scan_params_t m_scan_params =
+static const ble_gap_scan_params_t m_fast_scan_params =
 {
-    .active   = 1,
-    .interval = SCAN_INTERVAL,
-    .window   = SCAN_WINDOW,
-    .timeout  = SCAN_TIMEOUT,
+    .active   = 0,
+    .interval = FAST_SCAN_INTERVAL,
+    .window   = FAST_SCAN_WINDOW,
+    .timeout  = FAST_SCAN_TIMEOUT,
     #if (NRF_SD_BLE_API_VERSION == 2)
         .selective   = 0,
         .p_whitelist = NULL,
@@ -148,17 +202,152 @@ void assert_nrf_callback(uint16_t line_num, const uint8_t *p_file_name) {
     app_error_handler(0xDEADBEEF, line_num, p_file_name);
 }
 
+/**@brief Finds the slot of a connection, BLE_CONN_HANDLE_INVALID finds a free slot.
+ */
+static uint8_t link_find(uint16_t conn_handle) {
+  for (uint8_t link = 0; link < CENTRAL_LINK_COUNT; link++) {
+    if (m_links[link].conn_handle == conn_handle) {
+      return link;
+    }
+  }
+  return NO_LINK;
+}
+
+/**@brief Finds the slot connected to a peer address.
+ */
+static uint8_t link_find_addr(const ble_gap_addr_t *p_addr) {
+  for (uint8_t link = 0; link < CENTRAL_LINK_COUNT; link++) {
+    if (m_links[link].conn_handle != BLE_CONN_HANDLE_INVALID &&
+        m_links[link].peer_addr.addr_type == p_addr->addr_type &&
+        memcmp(m_links[link].peer_addr.addr, p_addr->addr, BLE_GAP_ADDR_LEN) == 0) {
+      return link;
+    }
+  }
+  return NO_LINK;
+}
+
+static uint8_t link_count(void) {
+  uint8_t count = 0;
+  for (uint8_t link = 0; link < CENTRAL_LINK_COUNT; link++) {
+    if (m_links[link].conn_handle != BLE_CONN_HANDLE_INVALID) {
+      count++;
+    }
+  }
+  return count;
+}
+
+static void link_reset(uint8_t link) {
+  memset(&m_links[link], 0, sizeof(scooter_link_t));
+  m_links[link].conn_handle = BLE_CONN_HANDLE_INVALID;
+}
+
 /**@brief Function to start scanning.
+ *
+ * @details The first call after a disconnect (or boot) connects straight to the cached
+ *          scooter, only if that fails or times out do we fall back to a full scan.
+ *          Does nothing while a scan or connect is already running or every slot is taken.
  */
 void scan_start(void) {
     uint32_t err_code;
-    
-    err_code = sd_ble_gap_scan_start(&m_scan_params);
-    APP_ERROR_CHECK(err_code);
-    
-    err_code = bsp_indication_set(BSP_INDICATE_SCANNING);
+    peer_cache_entry_t cached;
+
+    if (!peer_cache_is_ready()) {
+      // peer_cache_ready restarts us once fds has loaded the cache.
+      m_scan_pending = true;
+      return;
+    }
+
+    if (m_scan_state != scan_state_idle || link_find(BLE_CONN_HANDLE_INVALID) == NO_LINK) {
+      return;
+    }
+
+    if (!m_fast_connect_tried && peer_cache_get(&cached) && link_find_addr(&cached.peer_addr) == NO_LINK) {
+      m_fast_connect_tried = true;
+      err_code = sd_ble_gap_connect(&cached.peer_addr, &m_fast_scan_params, conn_param_manager_connect_params());
+      if (err_code == NRF_SUCCESS) {
+        m_scan_state = scan_state_connecting;
+        NRF_LOG_INFO("Connecting to cached peer.\r\n");
+        return;
+      }
+      NRF_LOG_WARNING("Fast connect failed: %d\r\n", err_code);
+    }
+
+    ble_gap_scan_params_t scan_params = m_scan_params[m_scan_phase];
+#if (SCAN_USE_WHITELIST)
+    // Once the cached scooter is connected the whitelist would hide every other one.
+    if (peer_cache_get(&cached) && link_find_addr(&cached.peer_addr) == NO_LINK) {
+      const ble_gap_addr_t *p_whitelist = &cached.peer_addr;
+      err_code = sd_ble_gap_whitelist_set(&p_whitelist, 1);
+      APP_ERROR_CHECK(err_code);
+      scan_params.use_whitelist = 1;
+    }
+#endif
+
+    err_code = sd_ble_gap_scan_start(&scan_params);
     APP_ERROR_CHECK(err_code);
-    NRF_LOG_DEBUG("Scan started.\r\n");
+    m_scan_state = scan_state_scanning;
+
+    if (link_count() == 0) {
+      err_code = bsp_indication_set(BSP_INDICATE_SCANNING);
+      APP_ERROR_CHECK(err_code);
+    }
+    NRF_LOG_DEBUG("Scan started, phase %d.\r\n", m_scan_phase);
+}
+
+/**@brief Starts service discovery on the next link waiting for it, if none is running.
+ */
+static void discovery_start_next(void) {
+  uint32_t err_code;
+
+  if (m_discovering_link != NO_LINK) {
+    return;
+  }
+  for (uint8_t link = 0; link < CENTRAL_LINK_COUNT; link++) {
+    if (m_links[link].discovery_pending) {
+      m_links[link].discovery_pending = false;
+      // The NUS Client waits for a discovery result
+      err_code = ble_db_discovery_start(&m_ble_db_discovery[link], m_links[link].conn_handle);
+      if (err_code == NRF_SUCCESS) {
+        m_discovering_link = link;
+        return;
+      }
+      // Reconnecting gives the link a fresh start.
+      NRF_LOG_WARNING("Discovery on link %d failed: %d\r\n", link, err_code);
+      UNUSED_RETURN_VALUE(sd_ble_gap_disconnect(m_links[link].conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION));
+    }
+  }
+}
+
+static void discovery_request(uint8_t link) {
+  m_links[link].discovery_pending = true;
+  discovery_start_next();
+}
+
+/**@brief Called once fds has loaded the peer cache.
+ */
+static void peer_cache_ready(void) {
+  if (m_scan_pending) {
+    m_scan_pending = false;
+    scan_start();
+  }
+}
+
+/**@brief Remember the peer and its NUS handles for the next reconnect.
+ */
+static void peer_cache_update(uint8_t link, const ble_nus_c_handles_t *handles) {
+  peer_cache_entry_t entry;
+  uint32_t err_code;
+
+  // zeroed so padding and bitfields compare equal in peer_cache_store
+  memset(&entry, 0, sizeof(entry));
+  entry.peer_addr.addr_type = m_links[link].peer_addr.addr_type;
+  memcpy(entry.peer_addr.addr, m_links[link].peer_addr.addr, BLE_GAP_ADDR_LEN);
+  entry.handles = *handles;
+
+  err_code = peer_cache_store(&entry);
+  if (err_code != NRF_SUCCESS) {
+    NRF_LOG_WARNING("Peer not cached: %d\r\n", err_code);
+  }
 }
 
 /**@brief Callback handling NUS Client events.
@@ -172,31 +361,67 @@ void scan_start(void) {
 /**@snippet [Handling events from the ble_nus_c module] */ 
 static void ble_nus_c_evt_handler(ble_nus_c_t *p_ble_nus_c, const ble_nus_c_evt_t *p_ble_nus_evt) {
     uint32_t err_code;
+    uint8_t link = (uint8_t)(p_ble_nus_c - m_ble_nus_c);
   switch (p_ble_nus_evt->evt_type) {
         case BLE_NUS_C_EVT_DISCOVERY_COMPLETE:
             err_code = ble_nus_c_handles_assign(p_ble_nus_c, p_ble_nus_evt->conn_handle, &p_ble_nus_evt->handles);
             APP_ERROR_CHECK(err_code);
 
-    nrf_delay_ms(30);
             err_code = ble_nus_c_rx_notif_enable(p_ble_nus_c);
             APP_ERROR_CHECK(err_code);
-            NRF_LOG_INFO("The device has the Nordic UART Service\r\n");
-            ninebot_nus_start_polling(p_ble_nus_c);
+            NRF_LOG_INFO("Link %d has the Nordic UART Service\r\n", link);
+            // The cache holds one scooter, the last one discovered.
+            peer_cache_update(link, &p_ble_nus_evt->handles);
+            ninebot_nus_start_polling(link, p_ble_nus_c);
             break;
         
         case BLE_NUS_C_EVT_NUS_RX_EVT: {
             // NRF_LOG_INFO("Received nus data\r\n");
-            ninebot_nus_received_data(p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
+            ninebot_nus_received_data(link, p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
   } break;
         
         case BLE_NUS_C_EVT_DISCONNECTED:
-            NRF_LOG_INFO("Disconnected\r\n");
-            ninebot_nus_stop_polling();
-            scan_start();
+            // Link teardown happens on BLE_GAP_EVT_DISCONNECTED, that also covers links that never got this far.
+            NRF_LOG_INFO("Link %d disconnected\r\n", link);
             break;
     }
 }
 
+/**@brief Cheap check for a scooter advert, a byte compare on the name or manufacturer data.
+ *
+ * @param[in]   p_adv_report  Pointer to the advertisement report.
+ *
+ * @retval      true if the advert carries the "MIScooter" name or the Ninebot manufacturer data.
+ */
+static bool is_scooter_adv(const ble_gap_evt_adv_report_t *p_adv_report) {
+  const uint8_t *p_data = p_adv_report->data;
+  uint32_t index = 0;
+
+  while ((index + 1) < p_adv_report->dlen) {
+    uint8_t field_length = p_data[index];
+    uint8_t field_type = p_data[index + 1];
+    const uint8_t *p_field = &p_data[index + 2];
+    uint8_t data_length = field_length - 1;
+
+    if (field_length == 0 || (index + 1 + field_length) > p_adv_report->dlen) {
+      break; // malformed
+    }
+
+    if ((field_type == BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME) || (field_type == BLE_GAP_AD_TYPE_SHORT_LOCAL_NAME)) {
+      if (data_length >= (sizeof(SCOOTER_NAME_PREFIX) - 1) &&
+          memcmp(p_field, SCOOTER_NAME_PREFIX, sizeof(SCOOTER_NAME_PREFIX) - 1) == 0) {
+        return true;
+      }
+    } else if (field_type == BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA) {
+      if (data_length >= 2 && uint16_decode(p_field) == SCOOTER_COMPANY_ID) {
+        return true;
+      }
+    }
+    index += field_length + 1;
+  }
+  return false;
+}
+
 /**@brief Reads an advertising report and checks if a uuid is present in the service list.
  *
  * @details The function is able to search for 16-bit, 32-bit and 128-bit service uuids. 
@@ -215,12 +440,17 @@ static bool is_uuid_present(const ble_uuid_t *p_target_uuid,
   uint8_t *p_data = (uint8_t *)p_adv_report->data;
   ble_uuid_t extracted_uuid;
 
-  while (index < p_adv_report->dlen) {
+  while ((index + 1) < p_adv_report->dlen) {
     uint8_t field_length = p_data[index];
     uint8_t field_type = p_data[index + 1];
+    uint8_t data_length = field_length - 1;
+
+    if (field_length == 0 || (index + 1 + field_length) > p_adv_report->dlen) {
+      break; // malformed
+    }
 
     if ((field_type == BLE_GAP_AD_TYPE_16BIT_SERVICE_UUID_MORE_AVAILABLE) || (field_type == BLE_GAP_AD_TYPE_16BIT_SERVICE_UUID_COMPLETE)) {
-      for (uint32_t u_index = 0; u_index < (field_length / UUID16_SIZE); u_index++) {
+      for (uint32_t u_index = 0; u_index < (data_length / UUID16_SIZE); u_index++) {
         err_code = sd_ble_uuid_decode(UUID16_SIZE,
             &p_data[u_index * UUID16_SIZE + index + 2],
             &extracted_uuid);
@@ -233,7 +463,7 @@ static bool is_uuid_present(const ble_uuid_t *p_target_uuid,
     }
 
     else if ((field_type == BLE_GAP_AD_TYPE_32BIT_SERVICE_UUID_MORE_AVAILABLE) || (field_type == BLE_GAP_AD_TYPE_32BIT_SERVICE_UUID_COMPLETE)) {
-      for (uint32_t u_index = 0; u_index < (field_length / UUID32_SIZE); u_index++) {
+      for (uint32_t u_index = 0; u_index < (data_length / UUID32_SIZE); u_index++) {
         err_code = sd_ble_uuid_decode(UUID16_SIZE,
             &p_data[u_index * UUID32_SIZE + index + 2],
             &extracted_uuid);
@@ -245,7 +475,8 @@ static bool is_uuid_present(const ble_uuid_t *p_target_uuid,
       }
     }
 
-    else if ((field_type == BLE_GAP_AD_TYPE_128BIT_SERVICE_UUID_MORE_AVAILABLE) || (field_type == BLE_GAP_AD_TYPE_128BIT_SERVICE_UUID_COMPLETE)) {
+    else if (((field_type == BLE_GAP_AD_TYPE_128BIT_SERVICE_UUID_MORE_AVAILABLE) || (field_type == BLE_GAP_AD_TYPE_128BIT_SERVICE_UUID_COMPLETE)) &&
+        data_length >= UUID128_SIZE) {
       err_code = sd_ble_uuid_decode(UUID128_SIZE,
           &p_data[index + 2],
           &extracted_uuid);
@@ -272,38 +503,101 @@ static void on_ble_evt(ble_evt_t *p_ble_evt) {
   case BLE_GAP_EVT_ADV_REPORT: {
     const ble_gap_evt_adv_report_t *p_adv_report = &p_gap_evt->params.adv_report;
 
-    if (is_uuid_present(&m_nus_uuid, p_adv_report)) {
+    if (m_scan_state != scan_state_scanning || link_find_addr(&p_adv_report->peer_addr) != NO_LINK) {
+      break;
+    }
+
+    // The NUS uuid is only in the scan response, and only checked when the cheap filter misses.
+    if (is_scooter_adv(p_adv_report) ||
+        (p_adv_report->scan_rsp && is_uuid_present(&m_nus_uuid, p_adv_report))) {
 
       err_code = sd_ble_gap_connect(&p_adv_report->peer_addr,
-          &m_scan_params,
-          &m_connection_param);
+          &m_fast_scan_params,
+          conn_param_manager_connect_params());
 
       if (err_code == NRF_SUCCESS) {
         // scan is automatically stopped by the connect
-        err_code = bsp_indication_set(BSP_INDICATE_IDLE);
-        APP_ERROR_CHECK(err_code);
+        m_scan_state = scan_state_connecting;
         NRF_LOG_INFO("Connecting to target: ");
         NRF_LOG_HEXDUMP_INFO(p_adv_report->peer_addr.addr, BLE_GAP_ADDR_LEN);
       }
     }
   } break; // BLE_GAP_EVT_ADV_REPORT
 
-  case BLE_GAP_EVT_CONNECTED:
-    NRF_LOG_INFO("Connected to target\r\n");
+  case BLE_GAP_EVT_CONNECTED: {
+    peer_cache_entry_t cached;
+    uint8_t link = link_find(BLE_CONN_HANDLE_INVALID);
+
+    if (p_gap_evt->params.connected.role != BLE_GAP_ROLE_CENTRAL) {
+      // A phone on the telemetry relay, not a scooter.
+      break;
+    }
+
+    m_scan_state = scan_state_idle;
+    m_scan_phase = 0;
+    if (link == NO_LINK) {
+      // scan_start doesn't run without a free slot, so this is a SoftDevice surprise.
+      NRF_LOG_WARNING("No free link, dropping connection.\r\n");
+      UNUSED_RETURN_VALUE(sd_ble_gap_disconnect(p_gap_evt->conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION));
+      break;
+    }
+
+    NRF_LOG_INFO("Connected to target on link %d\r\n", link);
     err_code = bsp_indication_set(BSP_INDICATE_CONNECTED);
     APP_ERROR_CHECK(err_code);
+    m_links[link].conn_handle = p_gap_evt->conn_handle;
+    m_links[link].peer_addr = p_gap_evt->params.connected.peer_addr;
 
-    // start discovery of services. The NUS Client waits for a discovery result
-    err_code = ble_db_discovery_start(&m_ble_db_discovery, p_ble_evt->evt.gap_evt.conn_handle);
+    // Claim the client now, an unassigned ble_nus_c takes events from every connection.
+    err_code = ble_nus_c_handles_assign(&m_ble_nus_c[link], p_gap_evt->conn_handle, NULL);
     APP_ERROR_CHECK(err_code);
-    break; // BLE_GAP_EVT_CONNECTED
+
+    if (peer_cache_matches(&m_links[link].peer_addr) && peer_cache_get(&cached)) {
+      // Known scooter, enabling notifications on the cached CCCD doubles as the handle check.
+      err_code = ble_nus_c_handles_assign(&m_ble_nus_c[link], p_gap_evt->conn_handle, &cached.handles);
+      APP_ERROR_CHECK(err_code);
+      if (ble_nus_c_rx_notif_enable(&m_ble_nus_c[link]) == NRF_SUCCESS) {
+        m_links[link].validating_cache = true;
+      } else {
+        discovery_request(link);
+      }
+    } else {
+      discovery_request(link);
+    }
+
+    // Keep looking while there are free slots.
+    scan_start();
+  } break; // BLE_GAP_EVT_CONNECTED
+
+  case BLE_GAP_EVT_DISCONNECTED: {
+    uint8_t link = link_find(p_gap_evt->conn_handle);
+
+    if (link == NO_LINK) {
+      break;
+    }
+    NRF_LOG_INFO("Disconnected link %d, reason 0x%02x\r\n", link, p_gap_evt->params.disconnected.reason);
+    UNUSED_RETURN_VALUE(ninebot_nus_stop_polling(link));
+    link_reset(link);
+    if (m_discovering_link == link) {
+      m_discovering_link = NO_LINK;
+      discovery_start_next();
+    }
+    m_fast_connect_tried = false;
+    scan_start();
+  } break; // BLE_GAP_EVT_DISCONNECTED
 
   case BLE_GAP_EVT_TIMEOUT:
     if (p_gap_evt->params.timeout.src == BLE_GAP_TIMEOUT_SRC_SCAN) {
       NRF_LOG_DEBUG("Scan timed out.\r\n");
+      m_scan_state = scan_state_idle;
+      if (m_scan_phase < (ARRAY_SIZE(m_scan_params) - 1)) {
+        m_scan_phase++;
+      }
       scan_start();
     } else if (p_gap_evt->params.timeout.src == BLE_GAP_TIMEOUT_SRC_CONN) {
       NRF_LOG_INFO("Connection Request timed out.\r\n");
+      m_scan_state = scan_state_idle;
+      scan_start();
     }
     break; // BLE_GAP_EVT_TIMEOUT
 
@@ -314,13 +608,21 @@ static void on_ble_evt(ble_evt_t *p_ble_evt) {
     APP_ERROR_CHECK(err_code);
     break; // BLE_GAP_EVT_SEC_PARAMS_REQUEST
 
-  case BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST:
-    // Accepting parameters requested by peer.
-    NRF_LOG_DEBUG("GATT Update Request - Accept.\r\n");
-    err_code = sd_ble_gap_conn_param_update(p_gap_evt->conn_handle,
-        &p_gap_evt->params.conn_param_update_request.conn_params);
-    APP_ERROR_CHECK(err_code);
-    break; // BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST
+  case BLE_GATTC_EVT_WRITE_RSP: {
+    uint8_t link = link_find(p_ble_evt->evt.gattc_evt.conn_handle);
+
+    if (link != NO_LINK && m_links[link].validating_cache) {
+      m_links[link].validating_cache = false;
+      if (p_ble_evt->evt.gattc_evt.gatt_status == BLE_GATT_STATUS_SUCCESS) {
+        NRF_LOG_INFO("Cached NUS handles accepted.\r\n");
+        ninebot_nus_start_polling(link, &m_ble_nus_c[link]);
+      } else {
+        // Scooter firmware changed its GATT table, rediscover and recache.
+        NRF_LOG_INFO("Cached NUS handles rejected: 0x%04x\r\n", p_ble_evt->evt.gattc_evt.gatt_status);
+        discovery_request(link);
+      }
+    }
+  } break; // BLE_GATTC_EVT_WRITE_RSP
 
   case BLE_GATTC_EVT_TIMEOUT:
     // Disconnect on GATT Client timeout event.
@@ -338,16 +640,10 @@ static void on_ble_evt(ble_evt_t *p_ble_evt) {
     APP_ERROR_CHECK(err_code);
     break; // BLE_GATTS_EVT_TIMEOUT
 
-#if (NRF_SD_BLE_API_VERSION == 3)
-  case BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST:
-    NRF_LOG_DEBUG("GATT Exchange MTU.\r\n");
-    err_code = sd_ble_gatts_exchange_mtu_reply(p_ble_evt->evt.gatts_evt.conn_handle,
-        NRF_BLE_MAX_MTU_SIZE);
-    APP_ERROR_CHECK(err_code);
-    break; // BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST
-#endif
   case BLE_EVT_TX_COMPLETE: {
-    NRF_LOG_DEBUG("GATT TX Complete.\r\n");
+    // Hands the write commands' buffers back to the poll scheduler.
+    ninebot_nus_tx_complete(link_find(p_ble_evt->evt.common_evt.conn_handle),
+        p_ble_evt->evt.common_evt.params.tx_complete.count);
   } break;
   default:
     break;
@@ -361,11 +657,42 @@ static void on_ble_evt(ble_evt_t *p_ble_evt) {
  * @param[in]   p_ble_evt   Bluetooth stack event.
  */
 static void ble_evt_dispatch(ble_evt_t *p_ble_evt) {
+  // conn_handle leads every event struct. Looked up first so DISCONNECTED still reaches the link's client.
+  uint8_t link = link_find(p_ble_evt->evt.gap_evt.conn_handle);
+
   //    NRF_LOG_DEBUG("ble_evt_dispatch - event\r\n");
   on_ble_evt(p_ble_evt);
+  conn_param_manager_on_ble_evt(p_ble_evt);
+  tx_power_control_on_ble_evt(p_ble_evt);
 //  bsp_btn_ble_on_ble_evt(p_ble_evt);
-  ble_db_discovery_on_ble_evt(&m_ble_db_discovery, p_ble_evt);
-  ble_nus_c_on_ble_evt(&m_ble_nus_c, p_ble_evt);
+  for (uint8_t i = 0; i < CENTRAL_LINK_COUNT; i++) {
+    // filters on its own conn_handle
+    ble_db_discovery_on_ble_evt(&m_ble_db_discovery[i], p_ble_evt);
+  }
+  if (link != NO_LINK) {
+    ble_nus_c_on_ble_evt(&m_ble_nus_c[link], p_ble_evt);
+  }
+  telemetry_relay_on_ble_evt(p_ble_evt);
+  // Last, so the MTU exchange only goes out once discovery/CCCD writes above didn't claim the
+  // single GATT client procedure (nrf_ble_gatt retries on BUSY with every following event).
+  nrf_ble_gatt_on_ble_evt(&m_gatt, p_ble_evt);
+}
+
+/**@brief Function for handling ATT_MTU changes from the GATT module.
+ */
+static void gatt_evt_handler(nrf_ble_gatt_t *p_gatt, nrf_ble_gatt_evt_t *p_evt) {
+  uint8_t link = link_find(p_evt->conn_handle);
+  NRF_LOG_INFO("Link %d ATT MTU %d\r\n", link, p_evt->att_mtu_effective);
+  ninebot_nus_mtu_update(link, p_evt->att_mtu_effective);
+  telemetry_relay_mtu_update(p_evt->conn_handle, p_evt->att_mtu_effective);
+}
+
+/**@brief Function for dispatching a system event (flash operations) to interested modules.
+ *
+ * @param[in]   sys_evt   System stack event.
+ */
+static void sys_evt_dispatch(uint32_t sys_evt) {
+  fs_sys_event_handler(sys_evt);
 }
 
 /**@brief Function for handling database discovery events.
@@ -377,8 +704,21 @@ static void ble_evt_dispatch(ble_evt_t *p_ble_evt) {
  * @param[in] p_event  Pointer to the database discovery event.
  */
 static void db_disc_handler(ble_db_discovery_evt_t *p_evt) {
+  uint8_t link = link_find(p_evt->conn_handle);
+
   NRF_LOG_DEBUG("db_disc_handler called\r\n");
-  ble_nus_c_on_db_disc_evt(&m_ble_nus_c, p_evt);
+  if (link == NO_LINK) {
+    return;
+  }
+  // ble_nus_c_on_db_disc_evt doesn't check the connection, only hand it the link's own result.
+  ble_nus_c_on_db_disc_evt(&m_ble_nus_c[link], p_evt);
+
+  // NUS is the only registered service, any result ends this link's discovery.
+  // (BLE_DB_DISCOVERY_AVAILABLE is never raised in this SDK.)
+  if (link == m_discovering_link) {
+    m_discovering_link = NO_LINK;
+    discovery_start_next();
+  }
 }
 
 /** @brief Function for initializing the Database Discovery Module.
@@ -401,6 +741,10 @@ void ble_stack_init(void) {
   // Initialize the SoftDevice handler module.
   SOFTDEVICE_HANDLER_INIT(&clock_lf_cfg, NULL);
 
+  for (uint8_t link = 0; link < CENTRAL_LINK_COUNT; link++) {
+    link_reset(link);
+  }
+
   ble_enable_params_t ble_enable_params;
   err_code = softdevice_enable_get_default_config(CENTRAL_LINK_COUNT,
       PERIPHERAL_LINK_COUNT,
@@ -412,7 +756,11 @@ void ble_stack_init(void) {
 
   // Enable BLE stack.
 #if (NRF_SD_BLE_API_VERSION == 3)
-  ble_enable_params.gatt_enable_params.att_mtu = NRF_BLE_MAX_MTU_SIZE;
+  ble_enable_params.gatt_enable_params.att_mtu = NRF_BLE_GATT_MAX_MTU_SIZE;
+#endif
+#if TELEMETRY_RELAY_ENABLED
+  // NUS client and the relay service each add a vendor base uuid.
+  ble_enable_params.common_enable_params.vs_uuid_count = 2;
 #endif
   err_code = softdevice_enable(&ble_enable_params);
   APP_ERROR_CHECK(err_code);
@@ -420,9 +768,27 @@ void ble_stack_init(void) {
   // Register with the SoftDevice handler module for BLE events.
   err_code = softdevice_ble_evt_handler_set(ble_evt_dispatch);
   APP_ERROR_CHECK(err_code);
+
+  // Register with the SoftDevice handler module for flash (fds) events.
+  err_code = softdevice_sys_evt_handler_set(sys_evt_dispatch);
+  APP_ERROR_CHECK(err_code);
+
+  // Every fds user registers first. fds_init sends its init event to all the
+  // users registered so far, and again on every further call, so it runs once.
+  err_code = ride_log_init();
+  APP_ERROR_CHECK(err_code);
+  err_code = peer_cache_init(peer_cache_ready);
+  APP_ERROR_CHECK(err_code);
+  err_code = fds_init();
+  APP_ERROR_CHECK(err_code);
+  conn_param_manager_init();
+  err_code = tx_power_control_init();
+  APP_ERROR_CHECK(err_code);
+
+  err_code = nrf_ble_gatt_init(&m_gatt, gatt_evt_handler);
+  APP_ERROR_CHECK(err_code);
   NRF_LOG_DEBUG("ble_stack_init finished.\r\n");
 
-  nrf_delay_ms(100);
   db_discovery_init();
 }
 
@@ -434,7 +800,12 @@ void nus_c_init(void) {
 
   nus_c_init_t.evt_handler = ble_nus_c_evt_handler;
 
-  err_code = ble_nus_c_init(&m_ble_nus_c, &nus_c_init_t);
+  // ble_nus_c_init registers the vendor uuid and the discovery handler on every call,
+  // so only the first client is initialised and the others start as copies of it.
+  err_code = ble_nus_c_init(&m_ble_nus_c[0], &nus_c_init_t);
   APP_ERROR_CHECK(err_code);
+  for (uint8_t link = 1; link < CENTRAL_LINK_COUNT; link++) {
+    m_ble_nus_c[link] = m_ble_nus_c[0];
+  }
   NRF_LOG_DEBUG("nus_c_init finished.\r\n");
 }
\ No newline at end of file
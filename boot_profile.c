@@ -0,0 +1,76 @@
+/*
+  boot_profile.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nordic_common.h"
+
+#include "boot_profile.h"
+#include "ms_clock.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "BOT"
+#if BOOT_PROFILE_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       BOOT_PROFILE_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#if BOOT_PROFILE_ENABLED
+
+// vars
+static uint32_t m_phase_ms[boot_phase_count];
+static uint16_t m_marked;                     // bit per phase
+
+static const char *m_phase_names[boot_phase_count] = {
+  "clocks", "softdevice", "scanning", "display", "splash", "main loop", "connected", "first speed"
+};
+
+STATIC_ASSERT(boot_phase_count <= 16);
+
+// internal
+
+static void report_log(void) {
+  for (uint8_t phase = 0; phase < boot_phase_count; phase++) {
+    if (m_marked & (1 << phase)) {
+      NRF_LOG_INFO("%6d ms %s\r\n", m_phase_ms[phase], (uint32_t)m_phase_names[phase]);
+    }
+  }
+  NRF_LOG_INFO("Boot to first speed: %d ms\r\n", m_phase_ms[boot_phase_first_speed]);
+}
+
+// Boot profile
+
+void boot_profile_mark(boot_phase_t phase) {
+  if (phase >= boot_phase_count || (m_marked & (1 << phase))) {
+    return;
+  }
+  m_phase_ms[phase] = ms_clock_now();
+  m_marked |= (1 << phase);
+  if (phase == boot_phase_first_speed) {
+    report_log();
+  }
+}
+
+#endif // BOOT_PROFILE_ENABLED
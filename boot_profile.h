@@ -0,0 +1,63 @@
+/*
+  boot_profile.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Timestamps of the startup phases, logged once the first speed arrives.
+// Times are ms_clock, from RTC1 starting, so the LFCLK crystal start before
+// it isn't included.
+
+#ifndef __BOOT_PROFILE_H
+#define __BOOT_PROFILE_H
+
+#include <stdint.h>
+#include "sdk_config.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+typedef enum {
+  boot_phase_clocks = 0,               // app_timer and ms_clock running
+  boot_phase_softdevice,               // ble_stack_init done
+  boot_phase_scanning,                 // first scan_start
+  boot_phase_display,                  // controller initialised
+  boot_phase_splash,                   // splash on screen
+  boot_phase_main_loop,
+  boot_phase_connected,                // first scooter polled
+  boot_phase_first_speed,              // first decoded frame, logs the report
+  boot_phase_count
+} boot_phase_t;
+
+#if BOOT_PROFILE_ENABLED
+
+// Only the first mark of a phase counts.
+void boot_profile_mark(boot_phase_t phase);
+
+#else
+
+#define boot_profile_mark(phase)
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __BOOT_PROFILE_H */
@@ -0,0 +1,243 @@
+/*
+  buttons.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "boards.h"
+#include "nrf_drv_gpiote.h"
+#include "sdk_macros.h"
+
+#include "buttons.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "BTN"
+#if BUTTONS_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       BUTTONS_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#if BUTTONS_ENABLED
+
+#define BUTTONS_MAX         GPIOTE_CONFIG_NUM_OF_LOW_POWER_EVENTS   /**< Each pin takes a PORT event slot. */
+
+typedef struct {
+  uint8_t pin;
+  bool pressed;                        // debounced level
+  bool settling;                       // edges ignored until the debounce timer ends
+  bool waiting;                        // released, a second press now is a double
+  bool swallow;                        // the release ends a long or double press
+  bool has_double;                     // short presses wait out the double window
+  bool has_long;                       // a long hold fires while held, else it is a short press
+  app_timer_t debounce_timer_data;
+  app_timer_id_t debounce_timer_id;
+  app_timer_t press_timer_data;        // long press while held, double window once released
+  app_timer_id_t press_timer_id;
+} button_t;
+
+// vars
+static const buttons_action_t *m_actions;
+static uint8_t m_action_count;
+static button_t m_buttons[BUTTONS_MAX];
+static uint8_t m_button_count;
+
+static const char *m_press_names[buttons_press_count] = { "short", "long", "double" };
+
+// internal
+static bool pin_active(uint8_t pin) {
+  return nrf_drv_gpiote_in_is_set(pin) == (BUTTONS_ACTIVE_STATE ? true : false);
+}
+
+static button_t *button_find(uint8_t pin) {
+  for (uint8_t i = 0; i < m_button_count; i++) {
+    if (m_buttons[i].pin == pin) {
+      return &m_buttons[i];
+    }
+  }
+  return NULL;
+}
+
+static void dispatch(button_t *p_button, buttons_press_t press) {
+  NRF_LOG_DEBUG("pin %d %s\r\n", p_button->pin, (uint32_t)m_press_names[press]);
+  for (uint8_t i = 0; i < m_action_count; i++) {
+    if (m_actions[i].pin == p_button->pin && m_actions[i].press == press) {
+      m_actions[i].handler();
+    }
+  }
+}
+
+static void press_timer_start(button_t *p_button, uint32_t ms) {
+  uint32_t error_code = app_timer_start(p_button->press_timer_id, APP_TIMER_TICKS(ms, 0), p_button);
+  APP_ERROR_CHECK(error_code);
+}
+
+// A debounced edge.
+static void transition(button_t *p_button, bool pressed) {
+  p_button->pressed = pressed;
+  app_timer_stop(p_button->press_timer_id);
+
+  if (pressed) {
+    if (p_button->waiting) {
+      p_button->waiting = false;
+      p_button->swallow = true;
+      dispatch(p_button, buttons_press_double);
+    } else {
+      press_timer_start(p_button, BUTTONS_LONG_MS);
+    }
+    return;
+  }
+
+  if (p_button->swallow) {
+    p_button->swallow = false;
+  } else if (p_button->has_double) {
+    p_button->waiting = true;
+    press_timer_start(p_button, BUTTONS_DOUBLE_MS);
+  } else {
+    dispatch(p_button, buttons_press_short);
+  }
+}
+
+static void settle(button_t *p_button) {
+  p_button->settling = true;
+  uint32_t error_code = app_timer_start(p_button->debounce_timer_id, APP_TIMER_TICKS(BUTTONS_DEBOUNCE_MS, 0), p_button);
+  APP_ERROR_CHECK(error_code);
+}
+
+static void gpiote_event_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action) {
+  button_t *p_button = button_find((uint8_t)pin);
+  if (p_button == NULL || p_button->settling) {
+    return;
+  }
+
+  bool pressed = pin_active(p_button->pin);
+  if (pressed != p_button->pressed) {
+    transition(p_button, pressed);
+    settle(p_button);
+  }
+}
+
+// Catches an edge that came and went while settling.
+static void debounce_timer_handler(void *p_context) {
+  button_t *p_button = (button_t *)p_context;
+  p_button->settling = false;
+
+  bool pressed = pin_active(p_button->pin);
+  if (pressed != p_button->pressed) {
+    transition(p_button, pressed);
+    settle(p_button);
+  }
+}
+
+static void press_timer_handler(void *p_context) {
+  button_t *p_button = (button_t *)p_context;
+
+  if (p_button->pressed) {
+    if (p_button->has_long) {
+      p_button->swallow = true;
+      dispatch(p_button, buttons_press_long);
+    }
+  } else if (p_button->waiting) {
+    p_button->waiting = false;
+    dispatch(p_button, buttons_press_short);
+  }
+}
+
+static uint32_t button_add(uint8_t pin) {
+  VERIFY_TRUE(m_button_count < BUTTONS_MAX, NRF_ERROR_NO_MEM);
+
+  button_t *p_button = &m_buttons[m_button_count];
+  memset(p_button, 0, sizeof(button_t));
+  p_button->pin = pin;
+  p_button->debounce_timer_id = &p_button->debounce_timer_data;
+  p_button->press_timer_id = &p_button->press_timer_data;
+
+  uint32_t error_code = app_timer_create(&p_button->debounce_timer_id, APP_TIMER_MODE_SINGLE_SHOT, debounce_timer_handler);
+  VERIFY_SUCCESS(error_code);
+  error_code = app_timer_create(&p_button->press_timer_id, APP_TIMER_MODE_SINGLE_SHOT, press_timer_handler);
+  VERIFY_SUCCESS(error_code);
+
+  // hi_accuracy false, the PORT event rather than a GPIOTE channel
+  nrf_drv_gpiote_in_config_t config = GPIOTE_CONFIG_IN_SENSE_TOGGLE(false);
+  config.pull = BUTTON_PULL;
+  error_code = nrf_drv_gpiote_in_init(pin, &config, gpiote_event_handler);
+  VERIFY_SUCCESS(error_code);
+
+  // held through a reset counts as pressed, its release is not a press
+  p_button->pressed = pin_active(pin);
+  p_button->swallow = p_button->pressed;
+  m_button_count++;
+  return NRF_SUCCESS;
+}
+
+// Buttons
+uint32_t buttons_init(const buttons_action_t *p_actions, uint8_t count) {
+  uint32_t error_code;
+
+  m_actions = p_actions;
+  m_action_count = count;
+  m_button_count = 0;
+
+  if (!nrf_drv_gpiote_is_init()) {
+    error_code = nrf_drv_gpiote_init();
+    VERIFY_SUCCESS(error_code);
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    button_t *p_button = button_find(p_actions[i].pin);
+    if (p_button == NULL) {
+      error_code = button_add(p_actions[i].pin);
+      VERIFY_SUCCESS(error_code);
+      p_button = &m_buttons[m_button_count - 1];
+    }
+    if (p_actions[i].press == buttons_press_double) {
+      p_button->has_double = true;
+    }
+    if (p_actions[i].press == buttons_press_long) {
+      p_button->has_long = true;
+    }
+  }
+
+  for (uint8_t i = 0; i < m_button_count; i++) {
+    nrf_drv_gpiote_in_event_enable(m_buttons[i].pin, true);
+  }
+
+  NRF_LOG_INFO("%d buttons, %d actions\r\n", m_button_count, count);
+  return NRF_SUCCESS;
+}
+
+void buttons_disable(void) {
+  for (uint8_t i = 0; i < m_button_count; i++) {
+    // leaves the pull, clears the SENSE so only the wakeup pin is armed
+    nrf_drv_gpiote_in_event_disable(m_buttons[i].pin);
+    app_timer_stop(m_buttons[i].debounce_timer_id);
+    app_timer_stop(m_buttons[i].press_timer_id);
+  }
+}
+
+#endif // BUTTONS_ENABLED
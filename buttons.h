@@ -0,0 +1,78 @@
+/*
+  buttons.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+// Event driven buttons on the GPIOTE PORT event, the low power SENSE path,
+// so nothing polls while the buttons are idle. An edge is acted on at once,
+// further edges are ignored for BUTTONS_DEBOUNCE_MS and the level is checked
+// again when that ends. Presses are classed as short, long (fires while held
+// for BUTTONS_LONG_MS) or double (second press within BUTTONS_DOUBLE_MS) and
+// dispatched through a table of pin, press and handler. A short press only
+// waits for the double press window on pins the table binds a double to, and
+// a hold on a pin with no long binding is a short press on release.
+
+#ifndef __BUTTONS_H
+#define __BUTTONS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_config.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+typedef enum {
+  buttons_press_short = 0,
+  buttons_press_long,
+  buttons_press_double,
+  buttons_press_count
+} buttons_press_t;
+
+typedef void (*buttons_handler_t)(void);
+
+typedef struct {
+  uint8_t pin;
+  buttons_press_t press;
+  buttons_handler_t handler;
+} buttons_action_t;
+
+#if BUTTONS_ENABLED
+
+// After APP_TIMER_INIT, the table must outlive the module. Handlers run at
+// APP_IRQ_PRIORITY_LOWEST, alongside the app_timer and BLE handlers.
+uint32_t buttons_init(const buttons_action_t *p_actions, uint8_t count);
+
+// Stops sensing, so only the wakeup button is armed for system-off.
+void buttons_disable(void);
+
+#else
+
+#define buttons_init(p_actions, count) NRF_SUCCESS
+#define buttons_disable()
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __BUTTONS_H */
@@ -0,0 +1,309 @@
+/*
+  conn_param_manager.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "ble_gap.h"
+
+#include "conn_param_manager.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "CPM"
+#if CONN_PARAM_MANAGER_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       CONN_PARAM_MANAGER_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#define APP_TIMER_PRESCALER     0                               /**< Value of the RTC1 PRESCALER register. */
+
+#define MOVING_SPEED_KPH        2.0                             /**< At or above this we are riding. */
+#define STILL_SPEED_KPH         1.0                             /**< Below this we may be parked (hysteresis against MOVING_SPEED_KPH). */
+#define PARKED_DELAY_MS         10000                           /**< Time below STILL_SPEED_KPH before the link is relaxed. */
+#define CHARGING_BATTERY_DELTA  0.01                            /**< Battery rise while parked that means we are on the charger. */
+
+// Supervision timeout must exceed (1 + latency) * max interval * 2 for every set.
+static const ble_gap_conn_params_t m_policy[conn_param_state_count] = {
+  [conn_param_state_moving] = {
+    .min_conn_interval = MSEC_TO_UNITS(15, UNIT_1_25_MS),
+    .max_conn_interval = MSEC_TO_UNITS(30, UNIT_1_25_MS),
+    .slave_latency     = 0,
+    .conn_sup_timeout  = MSEC_TO_UNITS(4000, UNIT_10_MS),
+  },
+  [conn_param_state_parked] = {
+    .min_conn_interval = MSEC_TO_UNITS(100, UNIT_1_25_MS),
+    .max_conn_interval = MSEC_TO_UNITS(150, UNIT_1_25_MS),
+    .slave_latency     = 3,
+    .conn_sup_timeout  = MSEC_TO_UNITS(4000, UNIT_10_MS),
+  },
+  [conn_param_state_charging] = {
+    .min_conn_interval = MSEC_TO_UNITS(250, UNIT_1_25_MS),
+    .max_conn_interval = MSEC_TO_UNITS(400, UNIT_1_25_MS),
+    .slave_latency     = 2,
+    .conn_sup_timeout  = MSEC_TO_UNITS(6000, UNIT_10_MS),
+  },
+};
+
+static const char *m_state_names[conn_param_state_count] = {"moving", "parked", "charging"};
+
+typedef struct {
+  uint16_t conn_handle;
+  conn_param_state_t state;
+  conn_param_state_t applied_state;  // state whose params were last accepted by the SoftDevice
+  bool applied;                      // false until applied_state is meaningful
+  bool update_pending;               // an update procedure is in flight
+  bool still;
+  uint32_t still_since_ticks;
+  double parked_battery;
+  ble_gap_conn_params_t in_effect;   // from the connect and update events
+  bool request_deferred;             // the peer's request still needs its reply
+  ble_gap_conn_params_t peer_request;
+} conn_param_link_t;
+
+static conn_param_link_t m_links[CONN_PARAM_MANAGER_MAX_LINKS];
+
+// internal
+
+static conn_param_link_t *link_find(uint16_t conn_handle) {
+  for (uint8_t i = 0; i < CONN_PARAM_MANAGER_MAX_LINKS; i++) {
+    if (m_links[i].conn_handle == conn_handle) {
+      return &m_links[i];
+    }
+  }
+  return NULL;
+}
+
+static void log_params(const char *what, const ble_gap_conn_params_t *params) {
+  // interval in 1.25ms units, timeout in 10ms units
+  NRF_LOG_INFO("%s: interval %d-%d ms, latency %d, timeout %d ms\r\n", (uint32_t)what,
+      (params->min_conn_interval * 5) / 4, (params->max_conn_interval * 5) / 4,
+      params->slave_latency, params->conn_sup_timeout * 10);
+}
+
+static bool elapsed(uint32_t since_ticks, uint32_t ms) {
+  uint32_t diff = 0;
+  UNUSED_RETURN_VALUE(app_timer_cnt_diff_compute(app_timer_cnt_get(), since_ticks, &diff));
+  return diff >= APP_TIMER_TICKS(ms, APP_TIMER_PRESCALER);
+}
+
+static void on_update_request(conn_param_link_t *p_link, const ble_gap_conn_params_t *p_request);
+
+static void apply_state(conn_param_link_t *p_link) {
+  uint32_t err_code;
+  if (p_link->update_pending) {
+    return;
+  }
+  // The reply to the peer goes first, it carries the current policy as well.
+  if (p_link->request_deferred) {
+    on_update_request(p_link, &p_link->peer_request);
+    return;
+  }
+  if (p_link->applied && p_link->applied_state == p_link->state) {
+    return;
+  }
+
+  err_code = sd_ble_gap_conn_param_update(p_link->conn_handle, &m_policy[p_link->state]);
+  if (err_code == NRF_SUCCESS) {
+    p_link->update_pending = true;
+    p_link->applied_state = p_link->state;
+    NRF_LOG_INFO("0x%x: requesting %s parameters.\r\n", p_link->conn_handle, (uint32_t)m_state_names[p_link->state]);
+  } else if (err_code != NRF_ERROR_BUSY) {
+    // NRF_ERROR_BUSY retries on the next data update.
+    NRF_LOG_WARNING("conn_param_update failed: %d\r\n", err_code);
+  }
+}
+
+// The central has the final say, reply with the overlap of the peer's range and our policy,
+// or with the policy itself when they don't overlap. While a procedure is still running
+// the reply is held and sent from apply_state once it has finished.
+static void on_update_request(conn_param_link_t *p_link, const ble_gap_conn_params_t *p_request) {
+  uint32_t err_code;
+  const ble_gap_conn_params_t *p_policy = &m_policy[p_link->state];
+  ble_gap_conn_params_t reply = *p_policy;
+  uint16_t min_interval = MAX(p_request->min_conn_interval, p_policy->min_conn_interval);
+  uint16_t max_interval = MIN(p_request->max_conn_interval, p_policy->max_conn_interval);
+  bool overlap = (min_interval <= max_interval);
+
+  if (overlap) {
+    reply.min_conn_interval = min_interval;
+    reply.max_conn_interval = max_interval;
+    reply.slave_latency = MIN(p_request->slave_latency, p_policy->slave_latency);
+    reply.conn_sup_timeout = MAX(p_request->conn_sup_timeout, p_policy->conn_sup_timeout);
+  }
+
+  err_code = p_link->update_pending ? NRF_ERROR_BUSY : sd_ble_gap_conn_param_update(p_link->conn_handle, &reply);
+  if (err_code == NRF_SUCCESS) {
+    if (overlap) {
+      NRF_LOG_INFO("Peer request accepted within %s policy.\r\n", (uint32_t)m_state_names[p_link->state]);
+    } else {
+      NRF_LOG_INFO("Peer request outside %s policy, countering.\r\n", (uint32_t)m_state_names[p_link->state]);
+    }
+    p_link->request_deferred = false;
+    p_link->update_pending = true;
+    p_link->applied_state = p_link->state;
+    p_link->applied = true;
+  } else if (err_code == NRF_ERROR_BUSY) {
+    if (!p_link->request_deferred) {
+      NRF_LOG_INFO("Peer request deferred.\r\n");
+    }
+    p_link->peer_request = *p_request;
+    p_link->request_deferred = true;
+  } else {
+    p_link->request_deferred = false;
+    NRF_LOG_WARNING("conn_param_update reply failed: %d\r\n", err_code);
+  }
+}
+
+// Manager
+
+void conn_param_manager_init(void) {
+  for (uint8_t i = 0; i < CONN_PARAM_MANAGER_MAX_LINKS; i++) {
+    m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+  }
+  NRF_LOG_DEBUG("conn_param_manager_init finished.\r\n");
+}
+
+void conn_param_manager_on_ble_evt(ble_evt_t *p_ble_evt) {
+  const ble_gap_evt_t *p_gap_evt = &p_ble_evt->evt.gap_evt;
+  conn_param_link_t *p_link;
+
+  if (p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED) {
+    if (p_gap_evt->params.connected.role != BLE_GAP_ROLE_CENTRAL) {
+      // The phone's link is the phone's call.
+      return;
+    }
+    p_link = link_find(BLE_CONN_HANDLE_INVALID);
+    if (!p_link) {
+      NRF_LOG_WARNING("No free link for 0x%x.\r\n", p_gap_evt->conn_handle);
+      return;
+    }
+    p_link->conn_handle = p_gap_evt->conn_handle;
+    p_link->update_pending = false;
+    p_link->request_deferred = false;
+    p_link->state = conn_param_state_moving;
+    p_link->still = false;
+    // Connected with the moving set, see conn_param_manager_connect_params.
+    p_link->applied = true;
+    p_link->applied_state = conn_param_state_moving;
+    p_link->in_effect = p_gap_evt->params.connected.conn_params;
+    log_params("Connected", &p_gap_evt->params.connected.conn_params);
+    apply_state(p_link);
+    return;
+  }
+
+  p_link = link_find(p_gap_evt->conn_handle);
+  if (!p_link || p_gap_evt->conn_handle == BLE_CONN_HANDLE_INVALID) {
+    return;
+  }
+
+  switch (p_ble_evt->header.evt_id) {
+  case BLE_GAP_EVT_DISCONNECTED:
+    p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+    p_link->update_pending = false;
+    p_link->request_deferred = false;
+    p_link->applied = false;
+    break;
+
+  case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+    p_link->update_pending = false;
+    p_link->in_effect = p_gap_evt->params.conn_param_update.conn_params;
+    log_params("In effect", &p_gap_evt->params.conn_param_update.conn_params);
+    // The state may have moved on while the procedure ran, or the peer asked meanwhile.
+    apply_state(p_link);
+    break;
+
+  case BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST:
+    log_params("Peer requested", &p_gap_evt->params.conn_param_update_request.conn_params);
+    on_update_request(p_link, &p_gap_evt->params.conn_param_update_request.conn_params);
+    break;
+
+  default:
+    break;
+  }
+}
+
+void conn_param_manager_data_update(uint16_t conn_handle, const ninebot_data_t *data) {
+  conn_param_link_t *p_link = link_find(conn_handle);
+  conn_param_state_t state;
+
+  if (!p_link || conn_handle == BLE_CONN_HANDLE_INVALID || !data->connected) {
+    return;
+  }
+
+  state = p_link->state;
+  if (data->speed_kph >= MOVING_SPEED_KPH) {
+    p_link->still = false;
+    state = conn_param_state_moving;
+  } else if (data->speed_kph < STILL_SPEED_KPH) {
+    if (!p_link->still) {
+      p_link->still = true;
+      p_link->still_since_ticks = app_timer_cnt_get();
+    } else if (state == conn_param_state_moving && elapsed(p_link->still_since_ticks, PARKED_DELAY_MS)) {
+      state = conn_param_state_parked;
+      p_link->parked_battery = data->battery_percentage;
+    }
+  }
+
+  // The M365 has no charging flag we poll, a rising battery while parked is the tell.
+  if (state == conn_param_state_parked && data->battery_percentage >= p_link->parked_battery + CHARGING_BATTERY_DELTA) {
+    state = conn_param_state_charging;
+  }
+
+  if (state != p_link->state) {
+    NRF_LOG_INFO("0x%x: state %s -> %s\r\n", conn_handle, (uint32_t)m_state_names[p_link->state], (uint32_t)m_state_names[state]);
+    p_link->state = state;
+  }
+  apply_state(p_link);
+}
+
+conn_param_state_t conn_param_manager_state(uint16_t conn_handle) {
+  conn_param_link_t *p_link = link_find(conn_handle);
+  return (p_link && conn_handle != BLE_CONN_HANDLE_INVALID) ? p_link->state : conn_param_state_moving;
+}
+
+uint32_t conn_param_manager_interval_us(uint16_t conn_handle) {
+  conn_param_link_t *p_link = link_find(conn_handle);
+  if (!p_link || conn_handle == BLE_CONN_HANDLE_INVALID) {
+    return 0;
+  }
+  // interval in 1.25ms units
+  return (uint32_t)p_link->in_effect.max_conn_interval * 1250;
+}
+
+uint32_t conn_param_manager_sleep_ms(uint16_t conn_handle) {
+  conn_param_link_t *p_link = link_find(conn_handle);
+  if (!p_link || conn_handle == BLE_CONN_HANDLE_INVALID) {
+    return 0;
+  }
+  return conn_param_manager_interval_us(conn_handle) / 1000 * (p_link->in_effect.slave_latency + 1);
+}
+
+const ble_gap_conn_params_t *conn_param_manager_connect_params(void) {
+  // Discovery and the first polls want the short interval.
+  return &m_policy[conn_param_state_moving];
+}
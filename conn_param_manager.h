@@ -0,0 +1,67 @@
+/*
+  conn_param_manager.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Picks the connection interval / slave latency for each scooter link from its
+// riding state: short while moving (speed latency), long while parked or
+// charging (power on both ends).
+
+#ifndef __CONN_PARAM_MANAGER_H
+#define __CONN_PARAM_MANAGER_H
+
+#include <stdint.h>
+#include "ble.h"
+#include "ninebot_module.h"
+#include "sdk_config.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+typedef enum {
+  conn_param_state_moving = 0,
+  conn_param_state_parked,
+  conn_param_state_charging,
+  conn_param_state_count
+} conn_param_state_t;
+
+#define CONN_PARAM_MANAGER_MAX_LINKS SCOOTER_LINK_COUNT  /**< Links tracked, one per central connection. */
+
+void conn_param_manager_init(void);
+void conn_param_manager_on_ble_evt(ble_evt_t *p_ble_evt);
+
+// Feed every data update, the riding state is derived from speed and battery.
+void conn_param_manager_data_update(uint16_t conn_handle, const ninebot_data_t *data);
+
+conn_param_state_t conn_param_manager_state(uint16_t conn_handle);
+
+// Connection interval in effect, 0 for an unknown handle.
+uint32_t conn_param_manager_interval_us(uint16_t conn_handle);
+
+// Longest the scooter may go without listening under the parameters in effect,
+// max interval * (slave latency + 1). A request can wait this long for it.
+uint32_t conn_param_manager_sleep_ms(uint16_t conn_handle);
+const ble_gap_conn_params_t *conn_param_manager_connect_params(void);
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __CONN_PARAM_MANAGER_H */
@@ -0,0 +1,123 @@
+/*
+  gauge.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nordic_common.h"
+#include "app_util.h"
+
+#include "ssd1306.h"
+#include "gauge.h"
+
+#define MINOR_TICK_LENGTH   2
+#define MAJOR_TICK_LENGTH   5
+#define NEEDLE_HUB          3           /**< Needle starts this far out, the pivot stays clear. */
+#define NEEDLE_INSET        2           /**< and ends inside the ring. */
+
+// sin of 0 .. 64, a quarter turn, in Q14
+static const int16_t m_quarter_sine[65] = {
+      0,   402,   804,  1205,  1606,  2006,  2404,  2801,
+   3196,  3590,  3981,  4370,  4756,  5139,  5520,  5897,
+   6270,  6639,  7005,  7366,  7723,  8076,  8423,  8765,
+   9102,  9434,  9760, 10080, 10394, 10702, 11003, 11297,
+  11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395,
+  13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978,
+  15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986,
+  16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379,
+  16384
+};
+
+// internal
+
+// Point at radius along angle, rounded to the nearest pixel.
+static void gauge_point(const gauge_t *p_gauge, uint8_t angle, int16_t radius, int16_t *p_x, int16_t *p_y) {
+  *p_x = p_gauge->cx + (int16_t)(((int32_t)radius * gauge_sin(angle) + GAUGE_ONE / 2) >> 14);
+  *p_y = p_gauge->cy - (int16_t)(((int32_t)radius * gauge_cos(angle) + GAUGE_ONE / 2) >> 14);
+}
+
+static void gauge_ray(const gauge_t *p_gauge, uint8_t angle, int16_t inner, int16_t outer, uint16_t color) {
+  int16_t x0, y0, x1, y1;
+  gauge_point(p_gauge, angle, inner, &x0, &y0);
+  gauge_point(p_gauge, angle, outer, &x1, &y1);
+  ssd1306_draw_line(x0, y0, x1, y1, color);
+}
+
+// Gauge
+
+int16_t gauge_sin(uint8_t angle) {
+  uint8_t index = angle & 0x3F;
+  switch (angle >> 6) {
+  case 0:
+    return m_quarter_sine[index];
+  case 1:
+    return m_quarter_sine[64 - index];
+  case 2:
+    return -m_quarter_sine[index];
+  default:
+    return -m_quarter_sine[64 - index];
+  }
+}
+
+int16_t gauge_cos(uint8_t angle) {
+  return gauge_sin((uint8_t)(angle + 64));
+}
+
+uint8_t gauge_angle(const gauge_t *p_gauge, int16_t value) {
+  value = MAX(0, MIN(value, p_gauge->max_value));
+  return (uint8_t)(p_gauge->start + (int32_t)p_gauge->sweep * value / p_gauge->max_value);
+}
+
+void gauge_dial_draw(const gauge_t *p_gauge) {
+  // the ring, a pixel per angle step
+  for (uint16_t step = 0; step <= p_gauge->sweep; step++) {
+    int16_t x, y;
+    gauge_point(p_gauge, (uint8_t)(p_gauge->start + step), p_gauge->radius, &x, &y);
+    ssd1306_draw_pixel(x, y, WHITE);
+  }
+
+  int16_t step = p_gauge->minor_step > 0 ? p_gauge->minor_step : p_gauge->major_step;
+  for (int16_t value = 0; value <= p_gauge->max_value; value += step) {
+    int16_t length = (value % p_gauge->major_step == 0) ? MAJOR_TICK_LENGTH : MINOR_TICK_LENGTH;
+    gauge_ray(p_gauge, gauge_angle(p_gauge, value), p_gauge->radius - length, p_gauge->radius, WHITE);
+  }
+
+  ssd1306_fill_circle(p_gauge->cx, p_gauge->cy, NEEDLE_HUB - 1, WHITE);
+}
+
+void gauge_needle_draw(gauge_t *p_gauge, int16_t value) {
+  uint8_t angle = gauge_angle(p_gauge, value);
+  if (p_gauge->needle_drawn) {
+    if (angle == p_gauge->needle_angle) {
+      return;
+    }
+    gauge_ray(p_gauge, p_gauge->needle_angle, NEEDLE_HUB, p_gauge->radius - NEEDLE_INSET, INVERSE);
+  }
+  gauge_ray(p_gauge, angle, NEEDLE_HUB, p_gauge->radius - NEEDLE_INSET, INVERSE);
+  p_gauge->needle_angle = angle;
+  p_gauge->needle_drawn = true;
+}
+
+void gauge_needle_reset(gauge_t *p_gauge) {
+  p_gauge->needle_drawn = false;
+}
@@ -0,0 +1,72 @@
+/*
+  gauge.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+// Arc gauge widget, a tick ring and a needle. Angles are binary, 256 to the
+// turn, clockwise from straight up; sine comes from a quarter-wave table in
+// Q14 so nothing needs libm. The dial only changes with the gauge, so it
+// belongs in the static layer; the needle is drawn with INVERSE so drawing
+// it again at the same angle erases it, and moving it touches two lines.
+
+#ifndef __GAUGE_H
+#define __GAUGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+#define GAUGE_ONE           16384       /**< 1.0 in the Q14 gauge_sin returns. */
+
+typedef struct {
+  int16_t cx, cy;                       // pivot
+  uint8_t radius;                       // tick ring
+  uint8_t start;                        // angle of 0
+  uint8_t sweep;                        // angle of max_value past start
+  int16_t max_value;
+  int16_t minor_step;                   // short tick every, 0 for none
+  int16_t major_step;                   // long tick every
+  // needle on the frame, angle valid while drawn
+  bool needle_drawn;
+  uint8_t needle_angle;
+} gauge_t;
+
+int16_t gauge_sin(uint8_t angle);
+int16_t gauge_cos(uint8_t angle);
+
+// Angle of value, clamped to the dial.
+uint8_t gauge_angle(const gauge_t *p_gauge, int16_t value);
+
+void gauge_dial_draw(const gauge_t *p_gauge);
+
+// Erases the needle left on the frame, then draws it at value.
+void gauge_needle_draw(gauge_t *p_gauge, int16_t value);
+
+// The frame was redrawn from scratch, the old needle is gone with it.
+void gauge_needle_reset(gauge_t *p_gauge);
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __GAUGE_H */
@@ -0,0 +1,85 @@
+/*
+  graph.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nordic_common.h"
+#include "app_util.h"
+
+#include "ssd1306.h"
+#include "graph.h"
+
+// internal
+
+// Row of a value, y is the top of the graph.
+static int16_t value_row(int16_t value, int32_t low, int32_t range, int16_t y, int16_t h) {
+  return y + h - 1 - (int16_t)(((int32_t)value - low) * (h - 1) / range);
+}
+
+// Graph
+
+void graph_draw(const time_series_t *p_series, time_series_resolution_t resolution, int16_t x, int16_t y, int16_t w, int16_t h, int16_t min_range) {
+  time_series_bucket_t bucket;
+  int16_t columns = MIN(w, time_series_length(p_series, resolution));
+  int32_t low = 0;
+  int32_t high = 0;
+  int16_t zero;
+
+  if (h < 2) {
+    return;
+  }
+
+  // Scale, zero always in view so regen and reversing go below the axis.
+  for (int16_t age = 0; age < columns; age++) {
+    time_series_get(p_series, resolution, (uint8_t)age, &bucket);
+    if (bucket.max >= bucket.min) {
+      low = MIN(low, bucket.min);
+      high = MAX(high, bucket.max);
+    }
+  }
+  high = MAX(high, low + MAX(min_range, 1));
+  zero = value_row(0, low, high - low, y, h);
+
+  for (int16_t age = 0; age < columns; age++) {
+    int16_t column = x + w - 1 - age;
+    int16_t avg_row;
+    int16_t max_row;
+
+    time_series_get(p_series, resolution, (uint8_t)age, &bucket);
+    if (bucket.max < bucket.min) {
+      // nothing landed in this bucket, just the axis
+      ssd1306_draw_pixel(column, zero, WHITE);
+      continue;
+    }
+    avg_row = value_row(bucket.avg, low, high - low, y, h);
+    if (avg_row <= zero) {
+      ssd1306_draw_fast_vline(column, avg_row, zero - avg_row + 1, WHITE);
+    } else {
+      ssd1306_draw_fast_vline(column, zero, avg_row - zero + 1, WHITE);
+    }
+    max_row = value_row(bucket.max, low, high - low, y, h);
+    if (max_row < avg_row - 1) {
+      ssd1306_draw_pixel(column, max_row, WHITE);
+    }
+  }
+}
@@ -0,0 +1,42 @@
+/*
+  graph.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// History graph widget, a column per time_series entry with the newest on the
+// right. Columns run from zero to the average, the maximum is marked above
+// when it differs. The scale fits the shown entries, at least min_range.
+
+#ifndef __GRAPH_H
+#define __GRAPH_H
+
+#include <stdint.h>
+#include "time_series.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+void graph_draw(const time_series_t *p_series, time_series_resolution_t resolution, int16_t x, int16_t y, int16_t w, int16_t h, int16_t min_range);
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __GRAPH_H */
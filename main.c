@@ -34,11 +34,33 @@
 #include "binary.h"
 #include "softdevice_handler.h"
 
+#include "sdk_config.h"
 #define NRF_LOG_MODULE_NAME "APP"
+#if APP_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       APP_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
 #include "nrf_log.h"
 #include "nrf_log_ctrl.h"
 
 #include "ninebot_module.h"
+#include "ninebot_filter.h"
+#include "ms_clock.h"
+#include "protocol_trace.h"
+#include "boot_profile.h"
+#include "graph.h"
+#include "gauge.h"
+#include "perf_monitor.h"
+#include "buttons.h"
+#include "power_manager.h"
+#include "ride_history.h"
+#include "ride_log.h"
+#include "ride_stats.h"
+#include "radio_timing.h"
+#include "telemetry_beacon.h"
+#include "telemetry_relay.h"
+#include "warm_start.h"
 
 #define DELAY_MS                 1000                /**< Timer Delay in milli-seconds. */
 
@@ -49,24 +71,83 @@
 
 #define APP_TIMER_PRESCALER      0                      /**< Value of the RTC1 PRESCALER register. */
 #define APP_TIMER_MAX_TIMERS     BSP_APP_TIMERS_NUMBER  /**< Maximum number of simultaneously created timers. */
-#define APP_TIMER_OP_QUEUE_SIZE  2                      /**< Size of timer operation queues. */
+#define APP_TIMER_OP_QUEUE_SIZE  4                      /**< Size of timer operation queues. */
 
 volatile bool change_rtc = false;
 extern uint8_t time_buffer[128];
 
 #define USE_METRIC 1 // kph vs mph etc.
 
+// Views
+#define VIEW_CYCLE_MS               3000 /**< With more than one scooter connected, each page is shown this long. */
+#define VIEW_SUMMARY_ROW_HEIGHT     12
+#define VIEW_GRAPH_LABEL_WIDTH      24   /**< Left of the graphs, the rest of the width is a column per entry. */
+#define SPLASH_MS                   500  /**< Boot logo, unless a scooter connects first. */
+#define VIEW_NEEDLE_FRAME_MS        40   /**< Needle animation, 25 frames a second while it moves. */
+#define NO_LINK                     0xFF
+#define NO_SCREEN                   0xFF
+
+// What a render drew, with the graph resolution in the low bits. The static
+// layer is redrawn whenever it changes.
+typedef enum {
+  display_screen_hud = 0,
+  display_screen_search,
+  display_screen_scooter,
+  display_screen_graph,
+  display_screen_summary,
+  display_screen_gauge
+} display_screen_t;
+#define DISPLAY_SCREEN(screen, resolution) (((screen) << 4) | (resolution))
+
+APP_TIMER_DEF(m_view_timer_id);
+APP_TIMER_DEF(m_splash_timer_id);
+static ninebot_data_t m_scooters[NINEBOT_MAX_LINKS]; // latest data of every link
+static uint8_t m_view_page;                          // nth connected scooter, or the summary after the last one
+static volatile bool m_display_dirty;                // rendered, waiting for a radio idle window to flush
+static volatile bool m_render_requested;             // set by the handlers, rendered from the main loop
+static volatile bool m_splash_shown;                 // renders wait until the splash is done
+static bool m_restored;                              // showing the retained screen after a warm start
+static uint8_t m_live_links;                         // bit per link updated since then
+static uint32_t m_display_power_ms;                  // ms_clock when the display rail came up
+static bool m_graph_shown;                           // history graphs in place of the scooter pages
+static time_series_resolution_t m_graph_resolution;
+static bool m_hud_shown;                             // performance HUD over every other page
+#if SSD1306_LAYERS_ENABLED
+static uint8_t m_static_screen = NO_SCREEN;          // the static layer and mask hold this screen
+#endif
+#if GAUGE_ENABLED
+APP_TIMER_DEF(m_needle_timer_id);
+static bool m_gauge_shown;                           // speedometer in place of the scooter page
+static bool m_needle_shown;                          // the last render drew the gauge
+static bool m_needle_running;                        // the needle is still moving to m_needle_target
+static volatile bool m_needle_frame_due;             // set by the needle timer, drawn from the main loop
+static int16_t m_needle_value;                       // speed the needle shows, in 0.1s
+static int16_t m_needle_target;
+#if USE_METRIC
+static gauge_t m_gauge = { .cx = 64, .cy = 34, .radius = 30, .start = 160, .sweep = 192,
+                           .max_value = 300, .minor_step = 10, .major_step = 50 };
+#else
+static gauge_t m_gauge = { .cx = 64, .cy = 34, .radius = 30, .start = 160, .sweep = 192,
+                           .max_value = 200, .minor_step = 10, .major_step = 50 };
+#endif
+#endif
+
 // Display Config
 #define SSD1306_CONFIG_VDD_PIN      28
 #define SSD1306_CONFIG_SCL_PIN      3
 #define SSD1306_CONFIG_SDA_PIN      4
+#define SSD1306_POWER_UP_MS         20   /**< Rail settling before the controller takes commands. */
 
 // Button Config
 #define BTN_ID_WAKEUP               1  /**< ID of button used to wake up the application. */
 #define BTN_ID_SLEEP                1  /**< ID of button used to put the application into sleep mode. */
 #define BTN_ACTION_SLEEP            BSP_BUTTON_ACTION_RELEASE    /**< Button action used to put the application into sleep mode. */
+#define BTN_PIN_SLEEP               BSP_BUTTON_1  /**< Sleeps on release, held or not, as SENSE on a held pin wakes at once. */
+#define BTN_PIN_VIEW                BSP_BUTTON_0  /**< Short press cycles the graphs, double steps the scooters, long toggles the HUD. */
 
 static void ssd1306_power_off(void);
+static void display_render(void);
+static void display_render_request(void);
 
 /**@snippet [Handling events from the ble_nus_c module] */ 
 
@@ -82,11 +163,13 @@ static void sleep_mode_enter(void) {
   ssd1306_power_off();
 
   // Prepare wakeup buttons.
+  buttons_disable();
   err_code = bsp_wakeup_button_enable(BTN_ID_WAKEUP); 
   APP_ERROR_CHECK(err_code);
 
   // Go to system-off mode (this function will not return; wakeup will cause a reset).
-  err_code = sd_power_system_off();
+  // The retained state survives, so waking draws the last screen.
+  err_code = warm_start_system_off();
   APP_ERROR_CHECK(err_code);
 }
 
@@ -121,12 +204,22 @@ void bsp_configuration(void) {
 
     APP_TIMER_INIT(APP_TIMER_PRESCALER, APP_TIMER_OP_QUEUE_SIZE, NULL);
 
+    // ms since boot for the relay and the ride log
+    err_code = ms_clock_init();
+    APP_ERROR_CHECK(err_code);
+
+#if BUTTONS_ENABLED
+    // LEDs only, the buttons are event driven (buttons_configuration)
+    err_code = bsp_init(BSP_INIT_LED, APP_TIMER_TICKS(100, APP_TIMER_PRESCALER), bsp_event_handler);
+    APP_ERROR_CHECK(err_code);
+#else
     err_code = bsp_init(BSP_INIT_LED|BSP_INIT_BUTTONS, APP_TIMER_TICKS(100, APP_TIMER_PRESCALER), bsp_event_handler);
     APP_ERROR_CHECK(err_code);
 
     // configure our sleep button
     err_code = bsp_event_to_button_action_assign(BTN_ID_SLEEP, BTN_ACTION_SLEEP, BSP_EVENT_SLEEP);
-
+    APP_ERROR_CHECK(err_code);
+#endif
 }
 
 void ssd1306_power_on(void) {
@@ -138,7 +231,17 @@ void ssd1306_power_on(void) {
       NRF_GPIO_PIN_NOPULL,
       NRF_GPIO_PIN_H0H1, // NRF_GPIO_PIN_S0S1,
       NRF_GPIO_PIN_NOSENSE);
-  nrf_delay_ms(20);
+  // Settles while the stack comes up, see display_power_wait.
+  m_display_power_ms = ms_clock_now();
+}
+
+/** @brief Function for waiting out whatever is left of the display power up.
+ */
+static void display_power_wait(void) {
+  uint32_t elapsed = ms_clock_now() - m_display_power_ms;
+  if (elapsed < SSD1306_POWER_UP_MS) {
+    nrf_delay_ms(SSD1306_POWER_UP_MS - elapsed);
+  }
 }
 
 void ssd1306_power_off(void) {
@@ -156,10 +259,23 @@ void ssd1306_power_off(void) {
 /** @brief Function for the Power manager.
  */
 static void power_manage(void) {
-  uint32_t err_code = sd_app_evt_wait();
+  perf_monitor_idle_begin();
+  uint32_t err_code = power_manager_sleep();
+  perf_monitor_idle_end();
   APP_ERROR_CHECK(err_code);
 }
 
+/** @brief Function for reporting log entries lost to a full deferred log buffer.
+ */
+static void log_dropped_report(void) {
+  static uint32_t reported = 0;
+  uint32_t dropped = NRF_LOG_DROPPED_COUNT();
+  if (dropped != reported) {
+    NRF_LOG_WARNING("%d log entries dropped.\r\n", dropped - reported);
+    reported = dropped;
+  }
+}
+
 // Logos: https://www.dcode.fr/binary-image
 
 #define BT_LOGO_W 32
@@ -264,95 +380,565 @@ static const unsigned char dist_logo [] = {
   B11111111, B11111110,
 };
 
-void ninebot_data_updated_handler(ninebot_data_t *ninebot_data) {
-  // Reset
-  ssd1306_clear_display();
-  ssd1306_set_textcolor(WHITE);
-  ssd1306_set_cursor(0, 0);
+static uint8_t scooters_connected(void) {
+  uint8_t count = 0;
+  for (uint8_t link = 0; link < NINEBOT_MAX_LINKS; link++) {
+    if (m_scooters[link].connected) {
+      count++;
+    }
+  }
+  return count;
+}
 
-  // Draw
-  if (ninebot_data->connected) {
-#if USE_METRIC
-    // Speed - kph
-    ssd1306_set_textsize(3);
-    int length = ssd1306_printf_length("%.1lf", ninebot_data->speed_kph);
-    uint16_t x = (ssd1306_width() - (length * ssd1306_char_width())) / 2;
-    // Ensure that negative values don't jump around
-    if (ninebot_data->speed_kph < 0.0) {
-      x -= (ssd1306_char_width() / 2);
+// One page per connected scooter, plus the summary once there are two or more.
+static uint8_t view_page_count(void) {
+  uint8_t count = scooters_connected();
+  return count > 1 ? count + 1 : count;
+}
+
+// Link shown by the current page, NO_LINK for the summary and search pages.
+static uint8_t view_page_link(void) {
+  uint8_t page = 0;
+  for (uint8_t link = 0; link < NINEBOT_MAX_LINKS; link++) {
+    if (m_scooters[link].connected && page++ == m_view_page) {
+      return link;
     }
-    uint16_t y = 0;
-    ssd1306_set_cursor(x, y);
-    ssd1306_printf("%.1lf", ninebot_data->speed_kph);
-    ssd1306_set_textsize(1);
-    ssd1306_printf("km/h");
+  }
+  return NO_LINK;
+}
+
+static void draw_scooter_page(const ninebot_data_t *ninebot_data, uint8_t number, uint8_t count) {
+#if USE_METRIC
+  // Speed - kph
+  ssd1306_set_textsize(3);
+  int length = ssd1306_printf_length("%.1lf", ninebot_data->speed_kph);
+  uint16_t x = (ssd1306_width() - (length * ssd1306_char_width())) / 2;
+  // Ensure that negative values don't jump around
+  if (ninebot_data->speed_kph < 0.0) {
+    x -= (ssd1306_char_width() / 2);
+  }
+  uint16_t y = 0;
+  ssd1306_set_cursor(x, y);
+  ssd1306_printf("%.1lf", ninebot_data->speed_kph);
+  ssd1306_set_textsize(1);
+  ssd1306_printf("km/h");
 #else
-    // Speed - mph
-    ssd1306_set_textsize(3);
-    int length = ssd1306_printf_length("%.1lf", ninebot_data->speed_mph);
-    uint16_t x = (ssd1306_width() - (length * ssd1306_char_width())) / 2;
-    // Ensure that negative values don't jump around
-    if (ninebot_data->speed_mph < 0.0) {
-      x -= (ssd1306_char_width() / 2);
-    }
-    uint16_t y = 0;
-    ssd1306_set_cursor(x, y);
-    ssd1306_printf("%.1lf", ninebot_data->speed_mph);
-    ssd1306_set_textsize(1);
-    ssd1306_printf("mph");
+  // Speed - mph
+  ssd1306_set_textsize(3);
+  int length = ssd1306_printf_length("%.1lf", ninebot_data->speed_mph);
+  uint16_t x = (ssd1306_width() - (length * ssd1306_char_width())) / 2;
+  // Ensure that negative values don't jump around
+  if (ninebot_data->speed_mph < 0.0) {
+    x -= (ssd1306_char_width() / 2);
+  }
+  uint16_t y = 0;
+  ssd1306_set_cursor(x, y);
+  ssd1306_printf("%.1lf", ninebot_data->speed_mph);
+  ssd1306_set_textsize(1);
+  ssd1306_printf("mph");
 #endif
 
-    // Battery Icon
-    ssd1306_draw_bitmap(0, 50, bat_logo, BAT_LOGO_W, BAT_LOGO_H, WHITE);
+  // Battery Percentage
+  ssd1306_set_textsize(1);
+  ssd1306_set_cursor(19, 50);
+  double percent = 100.0d * ninebot_data->battery_percentage;
+  ssd1306_printf("%.0lf%%", percent);
 
-    // Battery Percentage
-    ssd1306_set_textsize(1);
-    ssd1306_set_cursor(19, 50);
-    double percent = 100.0d * ninebot_data->battery_percentage;
-    ssd1306_printf("%.0lf%%", percent);
-
-    // Battery Bar + Ticks
-    uint16_t y12 = ssd1306_height();
-    uint16_t x2 = (int)((double)ssd1306_width() * ninebot_data->battery_percentage);
-    ssd1306_draw_line(0, --y12, x2, y12, WHITE);
-    ssd1306_draw_pixel(32, y12, BLACK);
-    ssd1306_draw_pixel(64, y12, BLACK);
-    ssd1306_draw_pixel(96, y12, BLACK);
-
-    ssd1306_draw_line(0, --y12, x2, y12, WHITE);
-    ssd1306_draw_pixel(32, y12, BLACK);
-    ssd1306_draw_pixel(64, y12, BLACK);
-    ssd1306_draw_pixel(96, y12, BLACK);
+  // Battery Bar + Ticks
+  uint16_t y12 = ssd1306_height();
+  uint16_t x2 = (int)((double)ssd1306_width() * ninebot_data->battery_percentage);
+  ssd1306_draw_line(0, --y12, x2, y12, WHITE);
+  ssd1306_draw_line(0, --y12, x2, y12, WHITE);
 
 // Distance Remaining
 #if USE_METRIC
-    ssd1306_set_textsize(1);
-    length = ssd1306_printf_length("%.0lfkm", ninebot_data->distance_remaining_km);
-    x = ssd1306_width() - (length * ssd1306_char_width());
-    y = 50;
-    ssd1306_set_cursor(x, y);
-    ssd1306_printf("%.0lfkm", ninebot_data->distance_remaining_km);
+  ssd1306_set_textsize(1);
+  length = ssd1306_printf_length("%.0lfkm", ninebot_data->distance_remaining_km);
+  x = ssd1306_width() - (length * ssd1306_char_width());
+  y = 50;
+  ssd1306_set_cursor(x, y);
+  ssd1306_printf("%.0lfkm", ninebot_data->distance_remaining_km);
 #else
+  ssd1306_set_textsize(1);
+  length = ssd1306_printf_length("%.0lfmi", ninebot_data->distance_remaining_mi);
+  x = ssd1306_width() - (length * ssd1306_char_width());
+  y = 50;
+  ssd1306_set_cursor(x, y);
+  ssd1306_printf("%.0lfmi", ninebot_data->distance_remaining_mi);
+#endif
+
+  // Distance logo
+  ssd1306_draw_bitmap(x - DIST_LOGO_W - 3, 50, dist_logo, DIST_LOGO_W, DIST_LOGO_H, WHITE);
+
+  // Which scooter, when there is more than one
+  if (count > 1) {
     ssd1306_set_textsize(1);
-    length = ssd1306_printf_length("%.0lfmi", ninebot_data->distance_remaining_mi);
-    x = ssd1306_width() - (length * ssd1306_char_width());
-    y = 50;
-    ssd1306_set_cursor(x, y);
-    ssd1306_printf("%.0lfmi", ninebot_data->distance_remaining_mi);
+    ssd1306_set_cursor(0, 32);
+    ssd1306_printf("%d/%d", number, count);
+  }
+}
+
+// Speed over power, at m_graph_resolution.
+static void draw_graph_page(uint8_t link, uint8_t number, uint8_t count) {
+  const time_series_t *p_speed = ride_history_get(link, ride_history_speed);
+  const time_series_t *p_power = ride_history_get(link, ride_history_power);
+  int16_t w = ssd1306_width() - VIEW_GRAPH_LABEL_WIDTH;
+  int16_t h = ssd1306_height() / 2 - 1;
+
+  ssd1306_set_textsize(1);
+  if (count > 1) {
+    ssd1306_set_cursor(0, h - ssd1306_char_height());
+    ssd1306_printf("%d/%d", number, count);
+  }
+
+  if (p_speed && p_power) {
+    // at least 10 km/h and 100 W tall, so standing still stays flat
+    graph_draw(p_speed, m_graph_resolution, VIEW_GRAPH_LABEL_WIDTH, 0, w, h, 100);
+    graph_draw(p_power, m_graph_resolution, VIEW_GRAPH_LABEL_WIDTH, h + 2, w, h, 100);
+  }
+}
+
+#if GAUGE_ENABLED
+// Speedometer, the dial is static and the needle follows m_needle_target.
+static void draw_gauge_page(const ninebot_data_t *ninebot_data, uint8_t number, uint8_t count) {
+#if USE_METRIC
+  double speed = ninebot_data->speed_kph;
+#else
+  double speed = ninebot_data->speed_mph;
 #endif
+  m_needle_target = (int16_t)MAX(speed * 10.0, 0.0);
 
-    // Distance logo
-    ssd1306_draw_bitmap(x - DIST_LOGO_W - 3, 50, dist_logo, DIST_LOGO_W, DIST_LOGO_H, WHITE);
+  // Speed under the pivot, between the ends of the dial
+  ssd1306_set_textsize(1);
+  int length = ssd1306_printf_length("%.1lf", speed);
+  ssd1306_set_cursor((ssd1306_width() - (length * ssd1306_char_width())) / 2, ssd1306_height() - ssd1306_char_height() - 4);
+  ssd1306_printf("%.1lf", speed);
 
-  } else {
+  // Battery Percentage
+  ssd1306_set_cursor(0, 0);
+  ssd1306_printf("%.0lf%%", 100.0d * ninebot_data->battery_percentage);
+
+  // Which scooter, when there is more than one
+  if (count > 1) {
+    length = ssd1306_printf_length("%d/%d", number, count);
+    ssd1306_set_cursor(ssd1306_width() - (length * ssd1306_char_width()), 0);
+    ssd1306_printf("%d/%d", number, count);
+  }
+}
+
+// The needle XOR draws over the frame, so it steps in the main loop with the renders.
+static void needle_timer_handler(void *p_context) {
+  m_needle_frame_due = true;
+}
+
+// Eases the needle towards the target, only the needle is redrawn.
+static void needle_process(void) {
+  if (!m_needle_frame_due) {
+    return;
+  }
+  m_needle_frame_due = false;
+
+  int16_t delta = m_needle_target - m_needle_value;
+  if (!m_needle_shown || delta == 0) {
+    m_needle_running = false;
+    UNUSED_RETURN_VALUE(app_timer_stop(m_needle_timer_id));
+    return;
+  }
+  // a third of the way each frame, at least a step
+  int16_t step = delta / 3;
+  if (step == 0) {
+    step = delta > 0 ? 1 : -1;
+  }
+  m_needle_value += step;
+  gauge_needle_draw(&m_gauge, m_needle_value);
+  m_display_dirty = true;
+}
+
+static void needle_update(bool shown) {
+  m_needle_shown = shown;
+  if (!shown) {
+    return;
+  }
+  // the frame was redrawn, so is the needle
+  gauge_needle_reset(&m_gauge);
+  gauge_needle_draw(&m_gauge, m_needle_value);
+  if (!m_needle_running && m_needle_value != m_needle_target) {
+    m_needle_running = true;
+    APP_ERROR_CHECK(app_timer_start(m_needle_timer_id, APP_TIMER_TICKS(VIEW_NEEDLE_FRAME_MS, APP_TIMER_PRESCALER), NULL));
+  }
+}
+#endif
+
+// Performance HUD, refreshed every perf_monitor window.
+static void draw_hud_page(void) {
+#if PERF_MONITOR_ENABLED
+  perf_monitor_stats_t stats;
+
+  perf_monitor_stats_get(&stats);
+  ssd1306_set_textsize(1);
+  ssd1306_set_cursor(0, 0);
+  ssd1306_printf("cpu %3d%%  fps %2d/%2d\n", stats.cpu_load, stats.frames_per_s, stats.renders_per_s);
+  ssd1306_printf("render %5d/%5dus\n", stats.render_us, stats.render_max_us);
+  ssd1306_printf("flush  %5d/%5dus\n", stats.flush_us, stats.flush_max_us);
+  ssd1306_printf("req %3d/s  rsp %3d/s\n", stats.requests_per_s, stats.responses_per_s);
+  ssd1306_printf("rtt %4dms max %4lu\n", stats.rtt_ms, stats.rtt_max_ms);
+  ssd1306_printf("timeout %lu\n", stats.timeouts);
+  ssd1306_printf("checksum %lu\n", stats.checksum_errors);
+  ssd1306_printf("log dropped %lu", NRF_LOG_DROPPED_COUNT());
+#endif
+}
+
+static void perf_updated_handler(void) {
+  if (m_hud_shown) {
+    display_render_request();
+  }
+}
+
+// A line per scooter: link, speed and battery.
+static void draw_summary_page(void) {
+  uint16_t y = 0;
+
+  ssd1306_set_textsize(1);
+  for (uint8_t link = 0; link < NINEBOT_MAX_LINKS; link++) {
+    const ninebot_data_t *ninebot_data = &m_scooters[link];
+    if (!ninebot_data->connected) {
+      continue;
+    }
+    ssd1306_set_cursor(0, y);
+#if USE_METRIC
+    ssd1306_printf("%d %5.1lfkm/h %3.0lf%%", link + 1, ninebot_data->speed_kph, 100.0d * ninebot_data->battery_percentage);
+#else
+    ssd1306_printf("%d %5.1lfmph %3.0lf%%", link + 1, ninebot_data->speed_mph, 100.0d * ninebot_data->battery_percentage);
+#endif
+    y += VIEW_SUMMARY_ROW_HEIGHT;
+  }
+}
+
+// Parts of a screen that only change with the screen.
+static void draw_static_page(uint8_t screen) {
+  static const char *resolution_labels[time_series_resolution_count] = { "raw", "10s", "60s" };
+  int16_t h = ssd1306_height() / 2 - 1;
+
+  switch (screen >> 4) {
+  case display_screen_search:
     // Scooter Logo + Searching text
     ssd1306_draw_bitmap(48, 14, scooter_logo, SCOOTER_LOGO_W, SCOOTER_LOGO_H, WHITE);
     ssd1306_set_textsize(1);
     ssd1306_set_cursor((ssd1306_width() - (ssd1306_char_width() * 9)) / 2, ssd1306_height() - ssd1306_char_height());
     ssd1306_putstring("Searching..");
+    break;
+
+#if GAUGE_ENABLED
+  case display_screen_gauge:
+    gauge_dial_draw(&m_gauge);
+    break;
+#endif
+
+  case display_screen_scooter:
+    // Battery Icon
+    ssd1306_draw_bitmap(0, 50, bat_logo, BAT_LOGO_W, BAT_LOGO_H, WHITE);
+    break;
+
+  case display_screen_graph:
+    ssd1306_set_textsize(1);
+    ssd1306_set_cursor(0, 0);
+    ssd1306_putstring("km/h");
+    ssd1306_set_cursor(0, h + 2);
+    ssd1306_putstring("W");
+    ssd1306_set_cursor(0, ssd1306_height() - ssd1306_char_height());
+    ssd1306_putstring((char *)resolution_labels[screen & 0x0F]);
+    break;
+
+  default:
+    break;
+  }
+}
+
+// Pixels every frame of the screen clears, in color.
+static void draw_static_mask(uint8_t screen, uint16_t color) {
+  if ((screen >> 4) == display_screen_scooter) {
+    // Battery Bar Ticks
+    for (int16_t y = ssd1306_height() - 2; y < ssd1306_height(); y++) {
+      ssd1306_draw_pixel(32, y, color);
+      ssd1306_draw_pixel(64, y, color);
+      ssd1306_draw_pixel(96, y, color);
+    }
+  }
+}
+
+// With layers the static parts are drawn once per screen and composited into
+// every frame, otherwise they are drawn over it.
+static void draw_static(uint8_t screen) {
+#if SSD1306_LAYERS_ENABLED
+  if (screen != m_static_screen) {
+    m_static_screen = screen;
+    ssd1306_layer_select(ssd1306_layer_static);
+    ssd1306_clear_display();
+    draw_static_page(screen);
+    ssd1306_layer_select(ssd1306_layer_mask);
+    ssd1306_clear_display();
+    draw_static_mask(screen, WHITE);
+    ssd1306_layer_select(ssd1306_layer_frame);
+  }
+  ssd1306_layers_composite();
+#else
+  draw_static_page(screen);
+  draw_static_mask(screen, BLACK);
+#endif
+}
+
+static void display_render(void) {
+  uint8_t count = scooters_connected();
+  uint8_t link;
+  uint8_t screen;
+  warm_start_display_t display;
+
+  if (m_splash_shown) {
+    // splash_timer_handler renders once it's done
+    return;
+  }
+  uint32_t start = perf_monitor_span_begin();
+
+  display.view_page = m_view_page;
+  display.graph_shown = m_graph_shown;
+  display.graph_resolution = (uint8_t)m_graph_resolution;
+  warm_start_display_store(&display);
+
+  // Reset
+  ssd1306_clear_display();
+  ssd1306_set_textcolor(WHITE);
+  ssd1306_set_cursor(0, 0);
+
+  // Draw, only what changes from frame to frame
+  if (m_hud_shown) {
+    screen = DISPLAY_SCREEN(display_screen_hud, 0);
+    draw_hud_page();
+  } else if (count == 0) {
+    screen = DISPLAY_SCREEN(display_screen_search, 0);
+  } else if ((link = view_page_link()) != NO_LINK) {
+    if (m_graph_shown) {
+      screen = DISPLAY_SCREEN(display_screen_graph, m_graph_resolution);
+      draw_graph_page(link, m_view_page + 1, count);
+#if GAUGE_ENABLED
+    } else if (m_gauge_shown) {
+      screen = DISPLAY_SCREEN(display_screen_gauge, 0);
+      draw_gauge_page(&m_scooters[link], m_view_page + 1, count);
+#endif
+    } else {
+      screen = DISPLAY_SCREEN(display_screen_scooter, 0);
+      draw_scooter_page(&m_scooters[link], m_view_page + 1, count);
+    }
+  } else {
+    screen = DISPLAY_SCREEN(display_screen_summary, 0);
+    draw_summary_page();
+  }
+  draw_static(screen);
+#if GAUGE_ENABLED
+  // over the composited frame, it erases itself as it moves
+  needle_update(screen == DISPLAY_SCREEN(display_screen_gauge, 0));
+#endif
+
+  // Flushed from the main loop while the radio is idle, see display_flush.
+  m_display_dirty = true;
+  perf_monitor_span_end(perf_monitor_render, start);
+}
+
+/** @brief Function for asking the main loop for a new frame.
+ *
+ * @details The handlers run at more than one interrupt priority and display_render isn't
+ *          reentrant (layers, the needle), so they only ask and all drawing is done in
+ *          thread mode by display_process.
+ */
+static void display_render_request(void) {
+  m_render_requested = true;
+}
+
+/** @brief Function for rendering the frame the handlers asked for, from the main loop.
+ */
+static void display_process(void) {
+  if (m_render_requested) {
+    // Cleared first, a request that lands during the render renders again.
+    m_render_requested = false;
+    display_render();
+  }
+#if GAUGE_ENABLED
+  // after the render, which redraws the needle where it was
+  needle_process();
+#endif
+}
+
+/** @brief Function for sending a rendered frame to the display between radio events.
+ */
+static void display_flush(void) {
+  // Frames wait while the panel is off, the last one goes out when it wakes.
+  if (m_display_dirty && radio_timing_idle() && power_manager_display_begin()) {
+    // Cleared first, a render that lands during the transfer flushes again.
+    uint32_t start = perf_monitor_span_begin();
+    m_display_dirty = false;
+    ssd1306_display();
+    perf_monitor_span_end(perf_monitor_flush, start);
+    power_manager_display_end();
+  }
+}
+
+/** @brief Function for bringing back what the display showed before a warm start.
+ */
+static void display_restore(void) {
+  warm_start_display_t display;
+
+  for (uint8_t link = 0; link < NINEBOT_MAX_LINKS; link++) {
+    UNUSED_RETURN_VALUE(warm_start_telemetry_get(link, &m_scooters[link]));
+  }
+  if (warm_start_display_get(&display)) {
+    m_view_page = display.view_page;
+    m_graph_shown = display.graph_shown && display.graph_resolution < time_series_resolution_count;
+    m_graph_resolution = m_graph_shown ? (time_series_resolution_t)display.graph_resolution : time_series_raw;
   }
+  m_live_links = 0;
+  m_restored = true;
+}
 
-  ssd1306_display();
+/** @brief Scooters that haven't come back by now are shown as gone.
+ */
+static void display_restore_expire(void) {
+  for (uint8_t link = 0; link < NINEBOT_MAX_LINKS; link++) {
+    if (!(m_live_links & (1 << link)) && m_scooters[link].connected) {
+      m_scooters[link].connected = false;
+      m_view_page = 0;
+    }
+  }
+  m_restored = false;
+}
+
+// Ends the splash, or the retained screen after a warm start.
+static void splash_timer_handler(void *p_context) {
+  m_splash_shown = false;
+  if (m_restored) {
+    display_restore_expire();
+  }
+  display_render_request();
+}
+
+static void view_page_next(void) {
+  uint8_t pages = view_page_count();
+  if (pages > 1) {
+    m_view_page = (m_view_page + 1) % pages;
+    display_render_request();
+  }
+}
+
+static void view_timer_handler(void *p_context) {
+  view_page_next();
+}
+
+static void sleep_button_handler(void) {
+  sleep_mode_enter();
+}
+
+static void view_button_handler(void) {
+  power_manager_activity();
+#if GAUGE_ENABLED
+  // scooter page, the gauge, then the graphs
+  if (!m_gauge_shown && !m_graph_shown) {
+    m_gauge_shown = true;
+    display_render_request();
+    return;
+  }
+  if (m_gauge_shown) {
+    m_gauge_shown = false;
+#if RIDE_HISTORY_ENABLED
+    m_graph_shown = true;
+    m_graph_resolution = time_series_raw;
+#endif
+    display_render_request();
+    return;
+  }
+#endif
+#if RIDE_HISTORY_ENABLED
+  // scooter page, then the graphs at each resolution
+  if (!m_graph_shown) {
+    m_graph_shown = true;
+    m_graph_resolution = time_series_raw;
+  } else if (++m_graph_resolution >= time_series_resolution_count) {
+    m_graph_shown = false;
+  }
+  display_render_request();
+#endif
+}
+
+static void view_double_button_handler(void) {
+  power_manager_activity();
+  view_page_next();
+}
+
+#if PERF_MONITOR_ENABLED
+static void hud_button_handler(void) {
+  power_manager_activity();
+  m_hud_shown = !m_hud_shown;
+  display_render_request();
+}
+#endif
+
+static const buttons_action_t m_button_actions[] = {
+  { BTN_PIN_SLEEP, buttons_press_short, sleep_button_handler },
+  { BTN_PIN_VIEW, buttons_press_short, view_button_handler },
+  { BTN_PIN_VIEW, buttons_press_double, view_double_button_handler },
+#if PERF_MONITOR_ENABLED
+  { BTN_PIN_VIEW, buttons_press_long, hud_button_handler },
+#endif
+};
+
+/**@brief Function for initializing the event driven buttons, after bsp_configuration.
+ */
+static void buttons_configuration(void) {
+  uint32_t err_code = buttons_init(m_button_actions, ARRAY_SIZE(m_button_actions));
+  APP_ERROR_CHECK(err_code);
+}
+
+void ninebot_data_updated_handler(uint8_t link, ninebot_data_t *ninebot_data) {
+  bool connection_changed = m_scooters[link].connected != ninebot_data->connected;
+  uint8_t shown = view_page_link();
+  uint32_t time_ms = ms_clock_now();
+  ninebot_data_t display_data = *ninebot_data;
+
+  m_live_links |= (1 << link);
+  warm_start_telemetry_store(link, ninebot_data);
+  telemetry_beacon_update(link, ninebot_data);
+  telemetry_relay_sample(link, ninebot_data);
+  ride_log_sample(link, ninebot_data);
+  if (!connection_changed && ninebot_data->connected) {
+    // the first poll of a link asks for the speed
+    boot_profile_mark(boot_phase_first_speed);
+  }
+  if (connection_changed) {
+    power_manager_links_set(scooters_connected());
+  }
+  if (connection_changed || ninebot_data->speed_kph != 0.0) {
+    // Riding keeps the display bright, parked it dims and then goes dark.
+    power_manager_activity();
+  }
+
+  // Everything above takes the raw data. The display gets the smoothed speed,
+  // and keeps what it has until something moved past its deadband.
+  ninebot_filter_smooth(link, &display_data);
+  if (!connection_changed && !ninebot_filter_changed(link, &display_data, time_ms)) {
+    return;
+  }
+  m_scooters[link] = display_data;
+  ninebot_filter_shown(link, &display_data, time_ms);
+  if (connection_changed) {
+    if (ninebot_data->connected) {
+      boot_profile_mark(boot_phase_connected);
+      // Straight to the scooter, the splash has had its time.
+      m_splash_shown = false;
+    }
+    // Pages shift when scooters come and go, start over on the first one.
+    m_view_page = 0;
+    display_render_request();
+  } else if (shown == link || shown == NO_LINK) {
+    // Only redraw when this scooter is on screen, the summary shows them all.
+    display_render_request();
+  }
 }
 
 /**@brief Function for application main entry. Does not return. */
@@ -363,45 +949,113 @@ int main(void) {
 
   // Setup bsp module.
   bsp_configuration();
+  buttons_configuration();
+  boot_profile_mark(boot_phase_clocks);
+
+  // Before the SoftDevice owns POWER, picks up what survived the reset
+  APP_ERROR_CHECK(warm_start_init());
   NRF_LOG_FLUSH();
 
-  // display
+  // Display rail first, it settles while the stack comes up.
   ssd1306_power_on();
-  ssd1306_init_i2c(SSD1306_CONFIG_SCL_PIN, SSD1306_CONFIG_SDA_PIN);
-  ssd1306_begin(SSD1306_SWITCHCAPVCC, SSD1306_I2C_ADDRESS, false);
 
-  // Initial display state
-  ssd1306_clear_display();
-  ssd1306_display();
-
-  // Initial Boot Logo
-  ssd1306_draw_bitmap(48, 14, scooter_logo, SCOOTER_LOGO_W, SCOOTER_LOGO_H, WHITE);
-  ssd1306_set_textcolor(WHITE);
-  ssd1306_set_textsize(1);
-  char* message = "RH 2018";
-  ssd1306_set_cursor((ssd1306_width()-(ssd1306_char_width() * strlen(message)))/2, ssd1306_height() - ssd1306_char_height());
-  ssd1306_printf(message);
-  ssd1306_display();
-  nrf_delay_ms(500);
+  // Binary protocol trace on RTT channel 1
+  protocol_trace_init();
 
   // BLE
   ble_stack_init();
+  boot_profile_mark(boot_phase_softdevice);
+
+  // Scooter requests go out just ahead of a radio event
+  APP_ERROR_CHECK(radio_timing_init(ninebot_radio_prepare));
 
   // Nordic uart service
   nus_c_init();
 
-  // Ninebot init
+  // Telemetry for gateways, advertised alongside the central links
+  APP_ERROR_CHECK(telemetry_beacon_init());
+
+  // Live telemetry to a phone over a peripheral link
+  APP_ERROR_CHECK(telemetry_relay_init());
+
+  // Trip energy and speed, fed by the ninebot module
+  ride_stats_init();
+  ride_history_init();
+
+  // Ninebot init, its renders wait for the splash
+  m_splash_shown = true;
   ninebot_init(ninebot_data_updated_handler);
+  if (warm_start_is_warm()) {
+    display_restore();
+  }
+
+  // Cycles through the scooters when more than one is connected
+  APP_ERROR_CHECK(app_timer_create(&m_view_timer_id, APP_TIMER_MODE_REPEATED, view_timer_handler));
+  APP_ERROR_CHECK(app_timer_start(m_view_timer_id, APP_TIMER_TICKS(VIEW_CYCLE_MS, APP_TIMER_PRESCALER), NULL));
+  APP_ERROR_CHECK(app_timer_create(&m_splash_timer_id, APP_TIMER_MODE_SINGLE_SHOT, splash_timer_handler));
+#if GAUGE_ENABLED
+  APP_ERROR_CHECK(app_timer_create(&m_needle_timer_id, APP_TIMER_MODE_REPEATED, needle_timer_handler));
+#endif
 
   // Start scanning for peripherals and initiate connection
-  // with devices that advertise NUS UUID.
-  nrf_delay_ms(10);
+  // with devices that advertise NUS UUID, before the display so the scooter is found sooner.
   NRF_LOG_INFO("Calling scan_start.\r\n");
   scan_start();
+  boot_profile_mark(boot_phase_scanning);
+
+  // display
+  display_power_wait();
+  ssd1306_init_i2c(SSD1306_CONFIG_SCL_PIN, SSD1306_CONFIG_SDA_PIN);
+  ssd1306_begin(SSD1306_SWITCHCAPVCC, SSD1306_I2C_ADDRESS, false);
+  boot_profile_mark(boot_phase_display);
+
+  // Scanning is already on, a scooter connecting ends the splash. Its handler only asks
+  // for a frame, the main loop draws it once this one is out.
+  if (m_restored) {
+    // Warm start, the last screen straight away. Scooters get WARM_START_HOLD_MS to reconnect.
+    m_splash_shown = false;
+    display_render();
+    m_display_dirty = false;
+    ssd1306_display();
+    boot_profile_mark(boot_phase_splash);
+    APP_ERROR_CHECK(app_timer_start(m_splash_timer_id, APP_TIMER_TICKS(WARM_START_HOLD_MS, APP_TIMER_PRESCALER), NULL));
+  } else {
+    // Boot logo, drawn straight into a clear frame unless a scooter got there first
+    if (m_splash_shown) {
+      ssd1306_clear_display();
+      ssd1306_draw_bitmap(48, 14, scooter_logo, SCOOTER_LOGO_W, SCOOTER_LOGO_H, WHITE);
+      ssd1306_set_textcolor(WHITE);
+      ssd1306_set_textsize(1);
+      char* message = "RH 2018";
+      ssd1306_set_cursor((ssd1306_width()-(ssd1306_char_width() * strlen(message)))/2, ssd1306_height() - ssd1306_char_height());
+      ssd1306_printf(message);
+    }
+    m_display_dirty = false;
+    ssd1306_display();
+    boot_profile_mark(boot_phase_splash);
+    APP_ERROR_CHECK(app_timer_start(m_splash_timer_id, APP_TIMER_TICKS(SPLASH_MS, APP_TIMER_PRESCALER), NULL));
+  }
+
+  // Dims and blanks the display when parked, powers off without a scooter
+  APP_ERROR_CHECK(power_manager_init(sleep_mode_enter));
+
+  // Load and throughput for the HUD page, a long press on the view button
+  APP_ERROR_CHECK(perf_monitor_init(perf_updated_handler));
+
+  boot_profile_mark(boot_phase_main_loop);
 
   while (1) {
-    power_manage();
-    NRF_LOG_FLUSH();
+    power_manager_process();
+    display_process();
+    display_flush();
+    protocol_trace_flush();
+    log_dropped_report();
+
+    // Logs are deferred; drain one entry per pass so BLE events are never
+    // held up behind the backend, and only sleep once the queue is empty.
+    if (NRF_LOG_PROCESS() == false) {
+      power_manage();
+    }
   }
 
 }
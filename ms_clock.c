@@ -0,0 +1,73 @@
+/*
+  ms_clock.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdint.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "sdk_macros.h"
+
+#include "ms_clock.h"
+
+#define APP_TIMER_PRESCALER     0                               /**< Value of the RTC1 PRESCALER register. */
+#define RTC_COUNTER_MASK        0x00FFFFFF                      /**< app_timer_cnt_get is 24 bit. */
+#define REFRESH_INTERVAL_MS     (256 * 1000)                    /**< Half the counter's wrap. */
+
+// vars
+APP_TIMER_DEF(m_refresh_timer_id);
+static uint32_t m_clock_ms;
+static uint32_t m_clock_ticks;                                  // counter value m_clock_ms was taken at
+
+// internal
+
+static void refresh_timer_handler(void *p_context) {
+  UNUSED_RETURN_VALUE(ms_clock_now());
+}
+
+// Clock
+
+uint32_t ms_clock_init(void) {
+  uint32_t error_code;
+
+  m_clock_ticks = app_timer_cnt_get();
+  m_clock_ms = 0;
+  error_code = app_timer_create(&m_refresh_timer_id, APP_TIMER_MODE_REPEATED, refresh_timer_handler);
+  VERIFY_SUCCESS(error_code);
+  return app_timer_start(m_refresh_timer_id, APP_TIMER_TICKS(REFRESH_INTERVAL_MS, APP_TIMER_PRESCALER), NULL);
+}
+
+uint32_t ms_clock_now(void) {
+  uint32_t diff = 0;
+  uint32_t ms;
+  uint32_t now_ms;
+
+  CRITICAL_REGION_ENTER();
+  UNUSED_RETURN_VALUE(app_timer_cnt_diff_compute(app_timer_cnt_get(), m_clock_ticks, &diff));
+  ms = (uint32_t)(((uint64_t)diff * 1000) / APP_TIMER_CLOCK_FREQ);
+  // Only whole ms are consumed, the remainder carries over.
+  m_clock_ticks = (m_clock_ticks + (uint32_t)(((uint64_t)ms * APP_TIMER_CLOCK_FREQ) / 1000)) & RTC_COUNTER_MASK;
+  m_clock_ms += ms;
+  now_ms = m_clock_ms;
+  CRITICAL_REGION_EXIT();
+  return now_ms;
+}
@@ -0,0 +1,44 @@
+/*
+  ms_clock.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Milliseconds since boot, built on the 24 bit RTC1 counter app_timer runs.
+// A slow timer keeps it current, the counter wraps every 512 s.
+
+#ifndef __MS_CLOCK_H
+#define __MS_CLOCK_H
+
+#include <stdint.h>
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+// After APP_TIMER_INIT.
+uint32_t ms_clock_init(void);
+
+// Wraps after ~49 days.
+uint32_t ms_clock_now(void);
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __MS_CLOCK_H */
@@ -110,6 +110,12 @@ typedef uint32_t (*nrf_log_timestamp_func_t)(void);
 #define NRF_LOG_HANDLERS_SET(default_handler, bytes_handler) \
     NRF_LOG_INTERNAL_HANDLERS_SET(default_handler, bytes_handler)
 
+/** @brief Macro for getting the number of log entries dropped on a full deferred buffer.
+ *
+ * Evaluates to 0 when the logger is disabled.
+ */
+#define NRF_LOG_DROPPED_COUNT() NRF_LOG_INTERNAL_DROPPED_COUNT()
+
 /**
  * @brief Function prototype for handling a log entry.
  *
@@ -221,6 +227,13 @@ void nrf_log_handlers_set(nrf_log_std_handler_t     std_handler,
  */
 bool nrf_log_frontend_dequeue(void);
 
+/**
+ * @brief Function for getting the number of log entries dropped because the deferred buffer was full.
+ *
+ * @return Number of dropped entries since init. Always 0 when logs are not deferred.
+ */
+uint32_t nrf_log_dropped_count_get(void);
+
 
 #endif // NRF_LOG_CTRL_H
 
@@ -82,6 +82,8 @@
 #define NRF_LOG_INTERNAL_HANDLERS_SET(default_handler, bytes_handler) \
     nrf_log_handlers_set(default_handler, bytes_handler)
 
+#define NRF_LOG_INTERNAL_DROPPED_COUNT() nrf_log_dropped_count_get()
+
 #else // NRF_MODULE_ENABLED(NRF_LOG)
 #define NRF_LOG_INTERNAL_PROCESS()            false
 #define NRF_LOG_INTERNAL_FLUSH()
@@ -89,6 +91,7 @@
 #define NRF_LOG_INTERNAL_HANDLERS_SET(default_handler, bytes_handler) \
     UNUSED_PARAMETER(default_handler); UNUSED_PARAMETER(bytes_handler)
 #define NRF_LOG_INTERNAL_FINAL_FLUSH()
+#define NRF_LOG_INTERNAL_DROPPED_COUNT()      0
 #endif // NRF_MODULE_ENABLED(NRF_LOG)
 
 /** @}
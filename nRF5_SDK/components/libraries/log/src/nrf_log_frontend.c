@@ -75,6 +75,7 @@ typedef struct
 static log_data_t   m_log_data;
 #if (NRF_LOG_DEFERRED == 1)
 static const char * m_overflow_info = NRF_LOG_ERROR_COLOR_CODE "Overflow\r\n";
+static uint32_t     m_dropped_count;   // Entries lost because the buffer was full (never reset)
 #endif //(NRF_LOG_DEFERRED == 1)
 
 /**
@@ -342,6 +343,7 @@ static inline bool buf_prealloc(uint32_t nargs, uint32_t * p_wr_idx)
 #endif //NRF_LOG_USES_TIMESTAMP
         }
         // overflow case
+        m_dropped_count++;
         ret = false;
     }
     else
@@ -399,6 +401,10 @@ static inline uint32_t * cont_buf_prealloc(uint32_t len32,
     {
         p_buf = NULL;
     }
+    if (p_buf == NULL)
+    {
+        m_dropped_count++;
+    }
     CRITICAL_REGION_EXIT();
 
     return p_buf;
@@ -428,6 +434,16 @@ static inline void nrf_log_direct_feed(uint8_t            type,
 #endif //(NRF_LOG_DEFERRED == 0)
 
 
+uint32_t nrf_log_dropped_count_get(void)
+{
+#if (NRF_LOG_DEFERRED == 0)
+    return 0;
+#else //(NRF_LOG_DEFERRED == 0)
+    return m_dropped_count;
+#endif //(NRF_LOG_DEFERRED == 0)
+}
+
+
 uint32_t nrf_log_push(char * const p_str)
 {
 #if (NRF_LOG_DEFERRED == 0)
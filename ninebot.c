@@ -31,8 +31,14 @@
 //uint8_t dataUART_NB_buffer[256];
 //It takes an array that comes from serial and tranforms it into a pack
 uint8_t ninebot_parse(uint8_t *dataUART, uint8_t size, NinebotPack *message){
-		static uint16_t data_index=0;
-		static uint16_t checksum=0;
+		static NinebotParser parser;
+		return ninebot_parse_r(&parser, dataUART, size, message);
+}
+
+//same as ninebot_parse, with the reassembly state kept by the caller (one per link)
+uint8_t ninebot_parse_r(NinebotParser *parser, uint8_t *dataUART, uint8_t size, NinebotPack *message){
+		uint16_t data_index=parser->data_index;
+		uint16_t checksum=parser->checksum;
     int16_t uart_index=-1;
     if (data_index==0){
         checksum=0;
@@ -40,6 +46,7 @@ uint8_t ninebot_parse(uint8_t *dataUART, uint8_t size, NinebotPack *message){
         if (dataUART[0]!=NinebotHeader0) return 2;
         if (dataUART[1]!=NinebotHeader1) return 2;
         if (dataUART[2]<3) return 2;//messaje deforme
+        if (dataUART[2]>(NinebotMaxPayload+2)) return 2;//no cabe en message->data
             else message->len=dataUART[2];
         checksum=checksum+dataUART[2];
         message->direction=dataUART[3];
@@ -53,7 +60,11 @@ uint8_t ninebot_parse(uint8_t *dataUART, uint8_t size, NinebotPack *message){
     }
     while(data_index<(message->len)){
         uart_index++;
-        if (uart_index > 19 | uart_index==size) return 1;//mensaje incompleto, espera nuevo
+        if (uart_index>=size) {//mensaje incompleto, espera nuevo (size depende del ATT MTU)
+            parser->data_index=data_index;
+            parser->checksum=checksum;
+            return 1;
+        }
         if(data_index==(message->len-2)) 
             message->CheckSum[0]=dataUART[uart_index];
         else if(data_index==(message->len-1)) 
@@ -64,7 +75,7 @@ uint8_t ninebot_parse(uint8_t *dataUART, uint8_t size, NinebotPack *message){
         }
         data_index++;
     }
-    data_index=0;
+    parser->data_index=0;
     checksum= checksum ^ 0xFFFF;//xor
     if (((checksum>>8)== message->CheckSum[1] )&& ((checksum & 0xff)== message->CheckSum[0])) return 0;
     else return 3;
@@ -43,10 +43,17 @@ typedef struct {
     uint8_t CheckSum[2];
 } NinebotPack;
 
+//reassembly state for ninebot_parse_r, zero to start
+typedef struct {
+    uint16_t data_index;
+    uint16_t checksum;
+} NinebotParser;
+
 extern uint16_t ninebot_mem_scooter[256];
 extern uint16_t ninebot_mem_batt[256];
 
 uint8_t ninebot_parse(uint8_t *uart_data_in, uint8_t size_in, NinebotPack *message_out);
+uint8_t ninebot_parse_r(NinebotParser *parser, uint8_t *uart_data_in, uint8_t size_in, NinebotPack *message_out);
 uint8_t ninebot_serialyze(NinebotPack *message_in, uint8_t *uart_data_out);
 
 uint8_t ninebot_slave_answer(NinebotPack *message_in, NinebotPack *message_out);
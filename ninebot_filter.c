@@ -0,0 +1,121 @@
+/*
+  ninebot_filter.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+
+#include "ninebot_filter.h"
+
+#if CHANGE_FILTER_ENABLED
+
+#define EMA_SHIFT           CHANGE_FILTER_SPEED_EMA_SHIFT
+
+typedef struct {
+  int32_t speed_average;               // m/h << EMA_SHIFT
+  bool speed_primed;
+  int16_t speed_smoothed;              // m/h
+  ninebot_data_t shown;
+  uint32_t shown_ms;
+} filter_link_t;
+
+// vars
+static filter_link_t m_links[NINEBOT_MAX_LINKS];
+
+// internal
+static bool moved(double value, double reference, double band) {
+  return fabs(value - reference) >= band;
+}
+
+// Filter
+void ninebot_filter_reset(uint8_t link) {
+  if (link < NINEBOT_MAX_LINKS) {
+    m_links[link].speed_average = 0;
+    m_links[link].speed_primed = false;
+    m_links[link].speed_smoothed = 0;
+  }
+}
+
+void ninebot_filter_speed_sample(uint8_t link, int16_t speed) {
+  if (link >= NINEBOT_MAX_LINKS) {
+    return;
+  }
+
+  filter_link_t *p_link = &m_links[link];
+  if (EMA_SHIFT == 0 || speed == 0 || !p_link->speed_primed) {
+    // standing still reads 0 at once rather than decaying towards it
+    p_link->speed_average = (int32_t)speed << EMA_SHIFT;
+    p_link->speed_primed = true;
+    p_link->speed_smoothed = speed;
+    return;
+  }
+
+  // average += (speed - average) / 2^EMA_SHIFT
+  p_link->speed_average += speed - (p_link->speed_average >> EMA_SHIFT);
+  p_link->speed_smoothed = (int16_t)((p_link->speed_average + (1 << (EMA_SHIFT - 1))) >> EMA_SHIFT);
+}
+
+void ninebot_filter_smooth(uint8_t link, ninebot_data_t *p_data) {
+  if (link < NINEBOT_MAX_LINKS && m_links[link].speed_primed) {
+    p_data->speed_kph = (double)m_links[link].speed_smoothed / 1000.0;
+    p_data->speed_mph = p_data->speed_kph * 0.621371;
+  }
+}
+
+bool ninebot_filter_changed(uint8_t link, const ninebot_data_t *p_data, uint32_t time_ms) {
+  if (link >= NINEBOT_MAX_LINKS) {
+    return true;
+  }
+
+  const ninebot_data_t *p_ref = &m_links[link].shown;
+  if (p_data->connected != p_ref->connected || p_data->error_code != p_ref->error_code) {
+    return true;
+  }
+  // the reference only ever shows a stop as exactly 0
+  if ((p_data->speed_kph == 0.0) != (p_ref->speed_kph == 0.0)) {
+    return true;
+  }
+  if (time_ms - m_links[link].shown_ms >= CHANGE_FILTER_HEARTBEAT_MS) {
+    return true;
+  }
+
+  return moved(p_data->speed_kph, p_ref->speed_kph, CHANGE_FILTER_SPEED_BAND / 1000.0)
+      || moved(p_data->battery_percentage, p_ref->battery_percentage, CHANGE_FILTER_BATTERY_BAND / 100.0)
+      || moved(p_data->distance_remaining_km, p_ref->distance_remaining_km, CHANGE_FILTER_RANGE_BAND / 100.0)
+      || moved(p_data->odometer_km, p_ref->odometer_km, CHANGE_FILTER_ODOMETER_BAND / 1000.0)
+      || moved(p_data->current_a, p_ref->current_a, CHANGE_FILTER_CURRENT_BAND / 100.0)
+      || moved(p_data->voltage_v, p_ref->voltage_v, CHANGE_FILTER_VOLTAGE_BAND / 100.0)
+      || moved(p_data->frame_temp_c, p_ref->frame_temp_c, CHANGE_FILTER_TEMP_BAND)
+      || moved(p_data->battery_temp_c, p_ref->battery_temp_c, CHANGE_FILTER_TEMP_BAND);
+}
+
+void ninebot_filter_shown(uint8_t link, const ninebot_data_t *p_data, uint32_t time_ms) {
+  if (link < NINEBOT_MAX_LINKS) {
+    m_links[link].shown = *p_data;
+    m_links[link].shown_ms = time_ms;
+  }
+}
+
+#endif // CHANGE_FILTER_ENABLED
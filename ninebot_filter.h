@@ -0,0 +1,74 @@
+/*
+  ninebot_filter.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+// Keeps unchanged responses away from the display. A field only counts as
+// changed once it has moved a deadband away from the value last shown,
+// which is also the hysteresis: a reading sitting on a rounding boundary
+// stays put until it really moves. Speed is optionally smoothed by a fixed
+// point EMA first, and a heartbeat redraws anyway every CHANGE_FILTER_HEARTBEAT_MS.
+// Only the display goes through here, the ride log, relay, beacon and
+// snapshots get every response raw.
+
+#ifndef __NINEBOT_FILTER_H
+#define __NINEBOT_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ninebot_module.h"
+#include "sdk_config.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+#if CHANGE_FILTER_ENABLED
+
+// Link up and down, the average starts over.
+void ninebot_filter_reset(uint8_t link);
+
+// Every speed reading in m/h, feeds the average. A stop passes straight through.
+void ninebot_filter_speed_sample(uint8_t link, int16_t speed);
+
+// Replaces the raw speed of a copy for the display with the average.
+void ninebot_filter_smooth(uint8_t link, ninebot_data_t *p_data);
+
+// True when p_data differs from the data last shown by more than a deadband.
+bool ninebot_filter_changed(uint8_t link, const ninebot_data_t *p_data, uint32_t time_ms);
+
+// Whatever is shown, changed or not, becomes the new reference.
+void ninebot_filter_shown(uint8_t link, const ninebot_data_t *p_data, uint32_t time_ms);
+
+#else
+
+#define ninebot_filter_reset(link)
+#define ninebot_filter_speed_sample(link, speed)
+#define ninebot_filter_smooth(link, p_data)
+#define ninebot_filter_changed(link, p_data, time_ms) true
+#define ninebot_filter_shown(link, p_data, time_ms)
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __NINEBOT_FILTER_H */
@@ -22,6 +22,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "ble_module.h"
 
@@ -35,6 +36,7 @@
 #include "app_error.h"
 #include "app_timer.h"
 #include "app_util.h"
+#include "app_util_platform.h"
 
 #include "boards.h"
 #include "bsp.h"
@@ -50,27 +52,101 @@
 #include "ble_advdata.h"
 #include "ble_nus_c.h"
 
+#include "conn_param_manager.h"
 #include "ninebot.h"
 #include "ninebot_module.h"
-
+#include "ninebot_filter.h"
+#include "ninebot_stats.h"
+#include "protocol_trace.h"
+#include "ms_clock.h"
+#include "radio_timing.h"
+#include "ride_history.h"
+#include "ride_stats.h"
+#include "tx_power_control.h"
+
+#include "sdk_config.h"
 #define NRF_LOG_MODULE_NAME "NBM"
+#if NINEBOT_MODULE_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       NINEBOT_MODULE_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
 #include "nrf_log.h"
 #include "nrf_log_ctrl.h"
 
 #define APP_TIMER_PRESCALER     0           /**< Value of the RTC1 PRESCALER register. */
+#define POLL_INTERVAL_MS        333         /**< Every link is polled 3 times a second, the timer ticks once per active link. */
+#define SLOW_POLL_INTERVAL      100         /**< Distance remaining is requested every n polls of a link. */
+#if RIDE_LOG_ENABLED
+#define BATTERY_POLL_INTERVAL   MAX(RIDE_LOG_INTERVAL_MS / POLL_INTERVAL_MS, 1) /**< BMS status every n polls, as often as the ride log samples. */
+#else
+#define BATTERY_POLL_INTERVAL   3           /**< BMS status every n polls of a link (~1s). */
+#endif
+#define STATS_LOG_INTERVAL      30          /**< Log link statistics every n polls of each link (~10s). */
+
+#define ATT_HEADER_LENGTH       3           /**< Opcode + handle in front of every notification. */
+#define NINEBOT_FRAME_OVERHEAD  8           /**< 55 aa, len, direction, rw, command and 2 byte checksum. */
+#define STATUS_BLOCK_REG        M365errorREG                                  /**< The status block read starts here. */
+#define STATUS_BLOCK_MIN_LEN    ((M365speedREG - STATUS_BLOCK_REG + 1) * 2)   /**< error .. speed, fits the default MTU. */
+#define STATUS_BLOCK_MAX_LEN    ((M365frametemp2REG - STATUS_BLOCK_REG + 1) * 2)  /**< error .. frame temperature. */
+#define BATTERY_BLOCK_REG       BATTcurrentREG                                /**< BMS current, voltage and cell temperatures. */
+#define BATTERY_BLOCK_LEN       ((BATTtempREG - BATTERY_BLOCK_REG + 1) * 2)
+#define SNAPSHOT_READ_TRIES     4           /**< Copies attempted before a reader gives up on a write in progress. */
+
+STATIC_ASSERT(NINEBOT_MAX_LINKS <= 8);      // ninebot_stats_check_timeouts reports links in a byte
+
+typedef struct {
+  bool active;
+  ble_nus_c_t nus_c;                 // Nordic UART Service of this scooter
+  ninebot_data_t data;
+  NinebotPack pack;                  // a frame may span notifications, so the pack lives with the link
+  NinebotParser parser;
+  uint16_t max_frame_length;
+  uint8_t tx_credits;                // packets the softdevice will still take on this link, TX_COMPLETE adds
+                                     // to it from the softdevice event handler, so changes go in a critical region
+  uint8_t slow_counter;
+  bool slow_pending;                 // distance request owed, waiting for a tx credit
+  uint8_t battery_counter;
+  bool battery_pending;              // BMS status request owed, waiting for a tx credit
+  uint8_t poll_skip;                 // turns to pass up while the last requests can still be answered
+#if RADIO_TIMING_ENABLED
+  radio_timing_anchor_t anchor;      // where its connection events fall
+#endif
+} ninebot_link_t;
+
+// Published copy of ninebot_link_t.data. The writer bumps the sequence to odd,
+// copies, then bumps it to even again; a reader retries when the sequence was
+// odd or moved under it. Writes only come from the BLE and timer handlers.
+typedef struct {
+  volatile uint32_t sequence;
+  ninebot_data_t data;
+} ninebot_snapshot_t;
 
 // vars
 APP_TIMER_DEF(m_ninebot_polling_timer_id); /** ninebot polling timer id. */
-static ble_nus_c_t m_ninebot_nus_c;        /** Nordic UART Service */
 static ninebot_data_callback_t m_data_callback;
-static ninebot_data_t m_ninebot_data;
-
-typedef enum {ninebot_expect_none, ninebot_expect_batt, ninebot_expect_speed} ninebot_expect_t; 
-static ninebot_expect_t m_ninebot_expect;
+static ninebot_link_t m_links[NINEBOT_MAX_LINKS];
+static ninebot_snapshot_t m_snapshots[NINEBOT_MAX_LINKS];
+static uint8_t m_active_count;
+static uint8_t m_next_link;                // round robin cursor
+#if RADIO_TIMING_ENABLED
+static uint8_t m_poll_link = NINEBOT_MAX_LINKS; // picked by the timer, sent ahead of one of its connection events
+static uint32_t m_polls_aligned;           // sent from the notification of the link's own event
+static uint32_t m_polls_unanchored;        // link events not known yet, sent from the first notification
+static uint32_t m_polls_late;              // none of the link's events within a tick, sent from the timer
+static bool m_align = true;                // false sends from the timer, see RADIO_TIMING_AB_LOGS
+#if RADIO_TIMING_AB_LOGS
+static uint8_t m_ab_logs;                  // stats logs in the current mode
+#endif
+#endif
 
 // internal defs
 void polling_timer_handler(void *p_context);
-void handle_ninebot_pack(NinebotPack *pack);
+void handle_ninebot_pack(uint8_t link, NinebotPack *pack);
+static uint32_t send_register_request(uint8_t link, uint8_t direction, uint8_t reg, uint8_t length);
+static void polling_timer_restart(void);
+static uint8_t request_target(uint8_t response_direction);
+static void data_publish(uint8_t link);
 
 // Ninebot
 
@@ -81,11 +157,21 @@ uint32_t ninebot_init(ninebot_data_callback_t data_callback) {
   } else {
     m_data_callback = data_callback;
     error_code = app_timer_create(&m_ninebot_polling_timer_id, APP_TIMER_MODE_REPEATED, polling_timer_handler);
-    m_ninebot_data.connected = false;
-    m_ninebot_data.battery_percentage = 1.0;
-    m_ninebot_data.speed_kph = 0;
-    m_ninebot_data.speed_mph = 0;
-    m_data_callback(&m_ninebot_data);
+    for (uint8_t link = 0; link < NINEBOT_MAX_LINKS; link++) {
+      ninebot_link_t *p_link = &m_links[link];
+      memset(p_link, 0, sizeof(ninebot_link_t));
+      p_link->data.connected = false;
+      p_link->data.battery_percentage = 1.0;
+      p_link->data.speed_kph = 0;
+      p_link->data.speed_mph = 0;
+      p_link->max_frame_length = GATT_MTU_SIZE_DEFAULT - ATT_HEADER_LENGTH;
+      data_publish(link);
+    }
+    m_active_count = 0;
+    m_next_link = 0;
+#if RADIO_TIMING_ENABLED
+    m_poll_link = NINEBOT_MAX_LINKS;
+#endif
   }
 
   NRF_LOG_DEBUG("ninebot_init finished.\r\n");
@@ -99,168 +185,476 @@ uint32_t ninebot_uninit(void) {
   return error_code;
 }
 
-uint32_t ninebot_get_current_data(ninebot_data_t *data_out) {
-  uint32_t error_code = NRF_SUCCESS;
-  if (data_out) {
-    data_out = &m_ninebot_data;
-  } else {
-    error_code = NRF_ERROR_INVALID_PARAM;
+uint32_t ninebot_get_current_data(uint8_t link, ninebot_data_t *data_out) {
+  return ninebot_snapshot_get(link, data_out, NULL);
+}
+
+uint32_t ninebot_snapshot_get(uint8_t link, ninebot_data_t *data_out, uint32_t *p_version) {
+  if (!data_out || link >= NINEBOT_MAX_LINKS) {
+    return NRF_ERROR_INVALID_PARAM;
   }
-  return error_code;
+
+  ninebot_snapshot_t *p_snapshot = &m_snapshots[link];
+  for (uint8_t tries = 0; tries < SNAPSHOT_READ_TRIES; tries++) {
+    uint32_t sequence = p_snapshot->sequence;
+    if (sequence & 1) {
+      // only a reader that preempted the writer lands here
+      continue;
+    }
+    __DMB();
+    *data_out = p_snapshot->data;
+    __DMB();
+    if (sequence == p_snapshot->sequence) {
+      if (p_version) {
+        *p_version = sequence >> 1;
+      }
+      return NRF_SUCCESS;
+    }
+  }
+  return NRF_ERROR_BUSY;
+}
+
+uint32_t ninebot_snapshot_version(uint8_t link) {
+  return link < NINEBOT_MAX_LINKS ? m_snapshots[link].sequence >> 1 : 0;
+}
+
+// Copies the working data out for ninebot_snapshot_get, then tells the app.
+static void data_publish(uint8_t link) {
+  ninebot_snapshot_t *p_snapshot = &m_snapshots[link];
+  p_snapshot->sequence++;
+  __DMB();
+  p_snapshot->data = m_links[link].data;
+  __DMB();
+  p_snapshot->sequence++;
+
+  m_data_callback(link, &m_links[link].data);
 }
 
 // nus handlers
-uint32_t ninebot_nus_start_polling(ble_nus_c_t *nus_c) {
+uint32_t ninebot_nus_start_polling(uint8_t link, ble_nus_c_t *nus_c) {
   uint32_t error_code = NRF_SUCCESS;
-  if (nus_c) {
-    m_ninebot_nus_c = *nus_c;
-    m_ninebot_data.connected = true;
-    m_data_callback(&m_ninebot_data);
-    // 3 times a second
-    uint32_t ticks = APP_TIMER_TICKS(333, APP_TIMER_PRESCALER);
-    uint32_t error_code = app_timer_start(m_ninebot_polling_timer_id, ticks, NULL);
-    APP_ERROR_CHECK(error_code);
+  if (nus_c && link < NINEBOT_MAX_LINKS) {
+    ninebot_link_t *p_link = &m_links[link];
+    uint8_t tx_credits = 0;
+    p_link->nus_c = *nus_c;
+    memset(&p_link->parser, 0, sizeof(NinebotParser));
+    p_link->pack.len = 0;
+    // First poll also fetches distance remaining and the BMS status.
+    p_link->slow_counter = SLOW_POLL_INTERVAL - 1;
+    p_link->slow_pending = false;
+    p_link->battery_counter = BATTERY_POLL_INTERVAL - 1;
+    p_link->battery_pending = false;
+    p_link->poll_skip = 0;
+#if RADIO_TIMING_ENABLED
+    p_link->anchor.valid = false;
+#endif
+    if (sd_ble_tx_packet_count_get(nus_c->conn_handle, &tx_credits) != NRF_SUCCESS) {
+      tx_credits = 1;
+    }
+    p_link->tx_credits = tx_credits;
+    p_link->data.connected = true;
+    ride_stats_link_up(link, ms_clock_now());
+    ninebot_filter_reset(link);
+    if (!p_link->active) {
+      p_link->active = true;
+      m_active_count++;
+      polling_timer_restart();
+    }
+    data_publish(link);
   } else {
     error_code = NRF_ERROR_INVALID_PARAM;
   }
 
-  NRF_LOG_DEBUG("ninebot_nus_start_polling finished.\r\n");
+  NRF_LOG_DEBUG("ninebot_nus_start_polling(%d) finished.\r\n", link);
   return error_code;
 }
 
-void ninebot_nus_received_data(uint8_t *p_data, uint8_t data_len) {
+void ninebot_nus_received_data(uint8_t link, uint8_t *p_data, uint8_t data_len) {
 //  NRF_LOG_HEXDUMP_DEBUG(p_data, data_len);
-  NinebotPack *pack = calloc(sizeof(NinebotPack), 1);
-  ninebot_parse(p_data, data_len, pack);
-  handle_ninebot_pack(pack);
-  free(pack);
+  if (link >= NINEBOT_MAX_LINKS || !m_links[link].active) {
+    return;
+  }
+  ninebot_link_t *p_link = &m_links[link];
+  NinebotPack *pack = &p_link->pack;
+#if RADIO_TIMING_ENABLED
+  radio_timing_anchor_update(&p_link->anchor);
+#endif
+  uint8_t result = ninebot_parse_r(&p_link->parser, p_data, data_len, pack);
+  protocol_trace_record(protocol_trace_rx, link, pack->command, data_len, result);
+  if (result == 0) {
+    ninebot_stats_response_received(link, request_target(pack->direction), pack->command);
+    handle_ninebot_pack(link, pack);
+  } else if (result == 3 && pack->len != 0) {
+    // header was parsed, so the register is known; checksum mismatch
+    ninebot_stats_checksum_failed(link, request_target(pack->direction), pack->command);
+  }
+  if (result != 1) {
+    // frame finished (or dropped), the next notification starts a new one
+    pack->len = 0;
+  }
 //  NRF_LOG_DEBUG("ninebot_nus_received_data finished.\r\n");
 }
 
-uint32_t ninebot_nus_stop_polling(void) {
-  m_ninebot_data.connected = false;
-  m_data_callback(&m_ninebot_data);
+uint32_t ninebot_nus_stop_polling(uint8_t link) {
+  if (link >= NINEBOT_MAX_LINKS || !m_links[link].active) {
+    return NRF_ERROR_INVALID_STATE;
+  }
+  ninebot_link_t *p_link = &m_links[link];
+  p_link->active = false;
+  p_link->data.connected = false;
+  p_link->max_frame_length = GATT_MTU_SIZE_DEFAULT - ATT_HEADER_LENGTH;
+  p_link->tx_credits = 0;
+#if RADIO_TIMING_ENABLED
+  if (m_poll_link == link) {
+    m_poll_link = NINEBOT_MAX_LINKS;
+  }
+#endif
+  m_active_count--;
+  ride_stats_link_down(link, ms_clock_now());
+  data_publish(link);
+
+  polling_timer_restart();
+  NRF_LOG_DEBUG("ninebot_nus_stop_polling(%d) finished.\r\n", link);
+  return NRF_SUCCESS;
+}
+
+void ninebot_nus_tx_complete(uint8_t link, uint8_t count) {
+  if (link < NINEBOT_MAX_LINKS && m_links[link].active) {
+    CRITICAL_REGION_ENTER();
+    m_links[link].tx_credits += count;
+    CRITICAL_REGION_EXIT();
+#if RADIO_TIMING_ENABLED
+    radio_timing_anchor_update(&m_links[link].anchor);
+#endif
+  }
+}
+
+void ninebot_nus_mtu_update(uint8_t link, uint16_t att_mtu) {
+  if (link < NINEBOT_MAX_LINKS) {
+    m_links[link].max_frame_length = MAX(att_mtu, GATT_MTU_SIZE_DEFAULT) - ATT_HEADER_LENGTH;
+    NRF_LOG_DEBUG("link %d max frame length %d\r\n", link, m_links[link].max_frame_length);
+  }
+}
+
+uint16_t ninebot_nus_max_frame_length(uint8_t link) {
+  return link < NINEBOT_MAX_LINKS ? m_links[link].max_frame_length : GATT_MTU_SIZE_DEFAULT - ATT_HEADER_LENGTH;
+}
 
+// internal
+
+// One repeated timer for all links, it ticks once per active link so each link keeps
+// its POLL_INTERVAL_MS rate and the requests of different scooters don't bunch up.
+static void polling_timer_restart(void) {
   uint32_t error_code = app_timer_stop(m_ninebot_polling_timer_id);
   APP_ERROR_CHECK(error_code);
-  NRF_LOG_DEBUG("ninebot_nus_stop_polling finished.\r\n");
-  return error_code;
+  if (m_active_count > 0) {
+    uint32_t ticks = APP_TIMER_TICKS(POLL_INTERVAL_MS, APP_TIMER_PRESCALER) / m_active_count;
+    error_code = app_timer_start(m_ninebot_polling_timer_id, ticks, NULL);
+    APP_ERROR_CHECK(error_code);
+  }
 }
 
-// internal
+// The request direction a response answers, the stats key requests by it.
+static uint8_t request_target(uint8_t response_direction) {
+  switch (response_direction) {
+  case M365toMaster:
+    return MastertoM365;
+  case BATTtoMaster:
+    return MastertoBATT;
+  default:
+    return response_direction;
+  }
+}
 
-void polling_timer_handler(void *p_context) {
-  static uint8_t counter = 100;
+// Bytes of the status block to read so the response still fits a single notification.
+static uint8_t status_block_length(uint8_t link) {
+  uint16_t length = m_links[link].max_frame_length - NINEBOT_FRAME_OVERHEAD;
+  length = MIN(length, STATUS_BLOCK_MAX_LEN);
+  return (uint8_t)MAX(length & ~1, STATUS_BLOCK_MIN_LEN);
+}
 
-  request_speed();
-  // Only request these properties every 100 times.
-  if (counter++ == 100) {
-    counter = 0;
-    nrf_delay_ms(100);
-    request_battery_percentage();
-    nrf_delay_ms(100);
-    request_distance_remaining();
+static void poll_link(uint8_t link) {
+  ninebot_link_t *p_link = &m_links[link];
+
+  // Parked and charging parameters let the scooter sleep through several connection
+  // events, a round trip then takes longer than a poll. Allow for it in the timeout
+  // and skip turns until it's up, so requests don't overlap and count as lost.
+  ninebot_stats_link_sleep_set(link, conn_param_manager_sleep_ms(p_link->nus_c.conn_handle));
+  p_link->poll_skip = (uint8_t)MIN((ninebot_stats_timeout_ms(link) - 1) / POLL_INTERVAL_MS, UINT8_MAX);
+
+  // Battery comes with speed in the status block.
+  request_speed(link);
+  // The BMS has its own registers, one more packet every BATTERY_POLL_INTERVAL
+  // polls when the link can take it.
+  if (++p_link->battery_counter >= BATTERY_POLL_INTERVAL) {
+    p_link->battery_counter = 0;
+    p_link->battery_pending = true;
+  }
+  if (p_link->battery_pending && p_link->tx_credits > 0) {
+    p_link->battery_pending = false;
+    request_battery_status(link);
+  }
+  // Only request these properties every SLOW_POLL_INTERVAL polls,
+  // held over to a later poll when the link has no credit left for it.
+  if (++p_link->slow_counter >= SLOW_POLL_INTERVAL) {
+    p_link->slow_counter = 0;
+    p_link->slow_pending = true;
+  }
+  if (p_link->slow_pending && p_link->tx_credits > 0) {
+    p_link->slow_pending = false;
+    request_distance_remaining(link);
   }
 }
 
-void request_speed(void) {
-  if (m_ninebot_data.connected) {
-    NRF_LOG_DEBUG("request_speed\r\n");
-    m_ninebot_expect = ninebot_expect_speed;
-    NinebotPack message;
-    static uint8_t send_data_array[NinebotMaxPayload] = {0x0};
-    static uint16_t length = 0;
-
-    if (length == 0) {
-      if (ninebot_create_request(MastertoM365, Ninebotread, M365speedREG, M365speedLEN + 2, &message) == 0) {
-        length = ninebot_serialyze(&message, send_data_array);
-        NRF_LOG_HEXDUMP_DEBUG(send_data_array, length);
+// Pick the next link in turn that can take a packet, NINEBOT_MAX_LINKS for none.
+// A link out of credits is skipped without losing its place, it's first in line on
+// the next tick. A link passing up its turn still uses the tick, the other links
+// keep their rate.
+static uint8_t poll_next_link(void) {
+  for (uint8_t i = 0; i < NINEBOT_MAX_LINKS; i++) {
+    uint8_t link = (m_next_link + i) % NINEBOT_MAX_LINKS;
+    if (m_links[link].active && m_links[link].tx_credits > 0) {
+      m_next_link = (link + 1) % NINEBOT_MAX_LINKS;
+      if (m_links[link].poll_skip > 0) {
+        m_links[link].poll_skip--;
+        break;
       }
+      return link;
     }
+  }
+  return NINEBOT_MAX_LINKS;
+}
+
+void polling_timer_handler(void *p_context) {
+  static uint8_t stats_counter = 0;
+  uint8_t timed_out = ninebot_stats_check_timeouts();
 
-    uint8_t retries = 3;
-    while (ble_nus_c_string_send(&m_ninebot_nus_c, (uint8_t *)&send_data_array, length) != NRF_SUCCESS && m_ninebot_nus_c.conn_handle != BLE_CONN_HANDLE_INVALID && retries-- > 0) {
-      // repeat until sent
-      NRF_LOG_DEBUG("Looping...\r\n");
+  // A lost response may be a link running short of TX power.
+  for (uint8_t link = 0; link < NINEBOT_MAX_LINKS; link++) {
+    if ((timed_out & (1 << link)) && m_links[link].active) {
+      tx_power_control_link_loss(m_links[link].nus_c.conn_handle);
     }
+  }
+  if (++stats_counter >= STATS_LOG_INTERVAL * m_active_count) {
+    stats_counter = 0;
+    ninebot_stats_log();
+#if RADIO_TIMING_ENABLED
+    NRF_LOG_INFO("polls %s: aligned %d, unanchored %d, late %d\r\n", (uint32_t)(m_align ? "radio" : "timer"),
+        m_polls_aligned, m_polls_unanchored, m_polls_late);
+#if RADIO_TIMING_AB_LOGS
+    // A/B run: each mode gets its own RTT histograms, taken under the same conditions.
+    if (++m_ab_logs >= RADIO_TIMING_AB_LOGS) {
+      m_ab_logs = 0;
+      m_align = !m_align;
+      m_polls_aligned = 0;
+      m_polls_unanchored = 0;
+      m_polls_late = 0;
+      ninebot_stats_reset();
+    }
+#endif
+#endif
+  }
+
+#if RADIO_TIMING_ENABLED
+  // One still owed from the last tick saw none of its link's events, so it goes out now.
+  if (m_poll_link < NINEBOT_MAX_LINKS) {
+    m_polls_late++;
+    poll_link(m_poll_link);
+    m_poll_link = NINEBOT_MAX_LINKS;
+  }
+#endif
+  uint8_t link = poll_next_link();
+#if RADIO_TIMING_ENABLED
+  // Sent ahead of the link's next connection event instead, see ninebot_radio_prepare.
+  if (m_align) {
+    m_poll_link = link;
+    return;
+  }
+#endif
+  if (link < NINEBOT_MAX_LINKS) {
+    poll_link(link);
+  }
+}
+
+void ninebot_radio_prepare(void) {
+#if RADIO_TIMING_ENABLED
+  if (m_poll_link >= NINEBOT_MAX_LINKS) {
+    return;
+  }
+  // The notification comes ahead of every radio event, only the polled link's will do.
+  ninebot_link_t *p_link = &m_links[m_poll_link];
+  if (!p_link->anchor.valid) {
+    m_polls_unanchored++;
+  } else if (radio_timing_anchor_match(&p_link->anchor, conn_param_manager_interval_us(p_link->nus_c.conn_handle))) {
+    m_polls_aligned++;
+  } else {
+    return;
+  }
+  uint8_t link = m_poll_link;
+  m_poll_link = NINEBOT_MAX_LINKS;
+  poll_link(link);
+#endif
+}
+
+// Reads the status block (error .. speed, and further registers as the MTU allows) in one request.
+void request_speed(uint8_t link) {
+  if (link < NINEBOT_MAX_LINKS && m_links[link].data.connected) {
+    send_register_request(link, MastertoM365, STATUS_BLOCK_REG, status_block_length(link));
 //    NRF_LOG_DEBUG("request_speed done\r\n");
   }
 }
 
-void request_battery_percentage(void) {
-  if (m_ninebot_data.connected) {
+void request_battery_percentage(uint8_t link) {
+  if (link < NINEBOT_MAX_LINKS && m_links[link].data.connected) {
     NRF_LOG_DEBUG("request_battery_percentage\r\n");
-    NinebotPack message;
-    static uint8_t send_data_array[NinebotMaxPayload] = {0x0};
-    static uint16_t length = 0;
-
-    if (length == 0) {
-      if (ninebot_create_request(MastertoM365, Ninebotread, M365battREG, M365battLEN + 2, &message) == 0) {
-        length = ninebot_serialyze(&message, send_data_array);
-        NRF_LOG_HEXDUMP_DEBUG(send_data_array, length);
-      }
-    }
-
-    uint8_t retries = 3;
-    while (ble_nus_c_string_send(&m_ninebot_nus_c, (uint8_t *)&send_data_array, length) != NRF_SUCCESS && m_ninebot_nus_c.conn_handle != BLE_CONN_HANDLE_INVALID && retries-- > 0) {
-      // repeat until sent
-      NRF_LOG_DEBUG("Looping...\r\n");
-    }
+    send_register_request(link, MastertoM365, M365battREG, M365battLEN + 2);
 //    NRF_LOG_DEBUG("request_battery_percentage done\r\n");
   }
 }
 
-void request_distance_remaining(void) {
-  if (m_ninebot_data.connected) {
+void request_distance_remaining(uint8_t link) {
+  if (link < NINEBOT_MAX_LINKS && m_links[link].data.connected) {
     NRF_LOG_DEBUG("request_distance_remaining\r\n");
-    NinebotPack message;
-    static uint8_t send_data_array[NinebotMaxPayload] = {0x0};
-    static uint16_t length = 0;
-
-    if (length == 0) {
-      if (ninebot_create_request(MastertoM365, Ninebotread, M365kmremainREG, M365kmremainLEN + 2, &message) == 0) {
-        length = ninebot_serialyze(&message, send_data_array);
-        NRF_LOG_HEXDUMP_DEBUG(send_data_array, length);
-      }
-    }
-    uint8_t retries = 3;
-    while (ble_nus_c_string_send(&m_ninebot_nus_c, (uint8_t *)&send_data_array, length) != NRF_SUCCESS && m_ninebot_nus_c.conn_handle != BLE_CONN_HANDLE_INVALID && retries-- > 0) {
-      // repeat until sent
-      NRF_LOG_DEBUG("Looping...\r\n");
-    }
+    send_register_request(link, MastertoM365, M365kmremainREG, M365kmremainLEN + 2);
 //    NRF_LOG_DEBUG("request_distance_remaining done\r\n");
   }
 }
 
+void request_battery_status(uint8_t link) {
+  if (link < NINEBOT_MAX_LINKS && m_links[link].data.connected) {
+    send_register_request(link, MastertoBATT, BATTERY_BLOCK_REG, BATTERY_BLOCK_LEN);
+  }
+}
 
+// Requests are built per call, their size depends on the link's MTU.
+static uint32_t send_register_request(uint8_t link, uint8_t direction, uint8_t reg, uint8_t length) {
+  uint32_t error_code;
+  ninebot_link_t *p_link = &m_links[link];
+  NinebotPack message;
+  uint8_t send_data_array[NinebotMaxPayload];
+  uint16_t size;
+  uint8_t tx_credits = p_link->tx_credits;
+
+  if (tx_credits == 0) {
+    return BLE_ERROR_NO_TX_PACKETS;
+  }
+  if (ninebot_create_request(direction, Ninebotread, reg, length, &message) != 0) {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+  size = ninebot_serialyze(&message, send_data_array);
+
+  error_code = ble_nus_c_string_send(&p_link->nus_c, send_data_array, size);
+  protocol_trace_record(protocol_trace_tx, link, reg, (uint8_t)size, error_code == NRF_SUCCESS ? 0 : 1);
+  if (error_code == NRF_SUCCESS) {
+    CRITICAL_REGION_ENTER();
+    p_link->tx_credits--;
+    CRITICAL_REGION_EXIT();
+    ninebot_stats_request_sent(link, direction, reg);
+  } else if (error_code == BLE_ERROR_NO_TX_PACKETS) {
+    // Out of step with the softdevice, none were free. Drop what we thought we had,
+    // keeping whatever TX_COMPLETE handed back since.
+    CRITICAL_REGION_ENTER();
+    p_link->tx_credits -= tx_credits;
+    CRITICAL_REGION_EXIT();
+  }
+  return error_code;
+}
 
+// BMS registers, they overlap the scooter's numbers so they are decoded apart.
+static bool handle_battery_register(ninebot_data_t *data, uint8_t reg, uint16_t value) {
+  if (reg == BATTcurrentREG) {
+    data->current_a = (double)(int16_t)value / 100.0;
+  } else if (reg == BATTvoltREG) {
+    // 10 mV, a full pack reads around 4200
+    data->voltage_v = (double)value / 100.0;
+  } else if (reg == BATTtempREG) {
+    // one byte per sensor, degrees + 20
+    int16_t temp1 = (int16_t)(value & 0xFF) - 20;
+    int16_t temp2 = (int16_t)(value >> 8) - 20;
+    data->battery_temp_c = (double)MAX(temp1, temp2);
+  } else {
+    return false;
+  }
+  return true;
+}
 
-void handle_ninebot_pack(NinebotPack *pack) {
+// A response covers consecutive 16 bit registers starting at pack->command.
+void handle_ninebot_pack(uint8_t link, NinebotPack *pack) {
   bool update = false;
-  if (pack->command == M365battREG) {
-    NRF_LOG_DEBUG("handle_attribute_data - battery_percentage\r\n");
-    uint16_t batt = ((uint16_t)pack->data[1] << 8) + pack->data[0];
-    m_ninebot_data.battery_percentage = batt == 0 ? 0.0 : (double)batt /100.0;
-    update = true;
-  } else if (pack->command == M365speedREG) {
-    int16_t speed = ((uint16_t)pack->data[1] << 8) + pack->data[0];
-    m_ninebot_data.speed_kph = (double)((double)speed / 1000.0);      
-    m_ninebot_data.speed_mph = m_ninebot_data.speed_kph * 0.621371;
-    update = true;
-    NRF_LOG_DEBUG("handle_attribute_data - speed = %d \r\n", speed);
-  } else if (pack->command == M365kmremainREG) {
-    uint16_t distance = ((uint16_t)pack->data[1] << 8) + pack->data[0]; //km restantes, ex 123= 1.23km
-    m_ninebot_data.distance_remaining_km = (double)distance / 100.0;
-    m_ninebot_data.distance_remaining_mi = m_ninebot_data.distance_remaining_km * 0.621371;
-    update = true;
-    NRF_LOG_DEBUG("handle_attribute_data - distance_remaining\r\n");
-  } else {
+  ninebot_data_t *data = &m_links[link].data;
+  uint16_t totalkm_low = 0;
+  bool have_totalkm_low = false;
+  // raw register values for ride_stats and ride_history, which stay in integers
+  int16_t speed = 0;
+  bool have_speed = false;
+  int16_t current = 0;
+  uint16_t voltage = 0;
+  uint8_t have_power = 0;
+  uint8_t data_length = pack->len - 2;
+  for (uint8_t offset = 0; offset + 1 < data_length; offset += 2) {
+    uint8_t reg = pack->command + (offset / 2);
+    uint16_t value = ((uint16_t)pack->data[offset + 1] << 8) + pack->data[offset];
+    if (pack->direction == BATTtoMaster) {
+      update |= handle_battery_register(data, reg, value);
+      if (reg == BATTcurrentREG) {
+        current = (int16_t)value;
+        have_power |= 1;
+      } else if (reg == BATTvoltREG) {
+        voltage = value;
+        have_power |= 2;
+      }
+    } else if (reg == M365errorREG) {
+      data->error_code = value;
+      update = true;
+    } else if (reg == M365totalkmREG) {
+      // 32 bit metres over two registers, low word first
+      totalkm_low = value;
+      have_totalkm_low = true;
+    } else if (reg == M365totalkmREG + 1 && have_totalkm_low) {
+      data->odometer_km = (double)(((uint32_t)value << 16) | totalkm_low) / 1000.0;
+      update = true;
+    } else if (reg == M365frametemp2REG) {
+      data->frame_temp_c = (double)(int16_t)value / 10.0;
+      update = true;
+    } else if (reg == M365battREG) {
+      data->battery_percentage = value == 0 ? 0.0 : (double)value /100.0;
+      update = true;
+    } else if (reg == M365speedREG) {
+      speed = (int16_t)value;
+      have_speed = true;
+      // the display smooths it, everything else gets the raw value
+      ninebot_filter_speed_sample(link, speed);
+      data->speed_kph = (double)((double)speed / 1000.0);
+      data->speed_mph = data->speed_kph * 0.621371;
+      update = true;
+    } else if (reg == M365kmremainREG) {
+      uint16_t distance = value; //km restantes, ex 123= 1.23km
+      data->distance_remaining_km = (double)distance / 100.0;
+      data->distance_remaining_mi = data->distance_remaining_km * 0.621371;
+      update = true;
+      NRF_LOG_DEBUG("handle_attribute_data - distance_remaining\r\n");
+    }
+  }
+
+  if (!update) {
     NRF_LOG_INFO("handle_attribute_data - other\r\n");
     NRF_LOG_HEXDUMP_INFO(pack->data, pack->len);
   }
 
+  if (have_speed || have_power == 3) {
+    uint32_t time_ms = ms_clock_now();
+    if (have_speed) {
+      ride_stats_speed_update(link, speed, time_ms);
+      ride_history_speed_update(link, speed, time_ms);
+    }
+    if (have_power == 3) {
+      ride_stats_power_update(link, voltage, current, time_ms);
+      ride_history_power_update(link, voltage, current, time_ms);
+    }
+  }
+
   if (update) {
-    m_data_callback(&m_ninebot_data);
+    conn_param_manager_data_update(m_links[link].nus_c.conn_handle, data);
+    data_publish(link);
   }
 }
-
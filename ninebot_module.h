@@ -24,6 +24,7 @@
 
 #include <stdint.h>
 #include "ble_nus_c.h"
+#include "sdk_config.h"
 
 #ifdef __splusplus
 extern "C" {
@@ -36,24 +37,45 @@ typedef struct {
   double battery_percentage;    // 0.0 - 1.0
   double distance_remaining_km; // 0.0 - 30.0
   double distance_remaining_mi; // 0.0 - 22.0
+  uint16_t error_code;          // 0 when fine, see the scooter's error table
+  double odometer_km;           // total distance, only read when the MTU fits the whole status block
+  double frame_temp_c;          // controller, likewise
+  double current_a;             // battery, negative while charging or braking
+  double voltage_v;             // battery
+  double battery_temp_c;        // warmer of the two cell sensors
 } ninebot_data_t;
 
-typedef void (*ninebot_data_callback_t)(ninebot_data_t *data);
+#define NINEBOT_MAX_LINKS SCOOTER_LINK_COUNT  /**< Scooters polled at once, link indexes are 0 .. NINEBOT_MAX_LINKS - 1. */
+
+typedef void (*ninebot_data_callback_t)(uint8_t link, ninebot_data_t *data);
 
 uint32_t ninebot_init(ninebot_data_callback_t data_callback);
 uint32_t ninebot_uninit(void);
 
-uint32_t ninebot_get_current_data(ninebot_data_t *data_out);
+// Consistent copies of a link's data for any context, interrupts stay enabled.
+// The version goes up with every update, compare it to skip unchanged data.
+// NRF_ERROR_BUSY only when called from above APP_IRQ_PRIORITY_LOWEST while
+// an update is being published.
+uint32_t ninebot_snapshot_get(uint8_t link, ninebot_data_t *data_out, uint32_t *p_version);
+uint32_t ninebot_snapshot_version(uint8_t link);
+uint32_t ninebot_get_current_data(uint8_t link, ninebot_data_t *data_out);  // snapshot, without the version
+
+// nus handlers, link is the caller's slot for the connection
+uint32_t ninebot_nus_start_polling(uint8_t link, ble_nus_c_t *nus_c);
+void ninebot_nus_received_data(uint8_t link, uint8_t *p_data, uint8_t data_len);
+uint32_t ninebot_nus_stop_polling(uint8_t link);
+void ninebot_nus_tx_complete(uint8_t link, uint8_t count);        // BLE_EVT_TX_COMPLETE, returns tx credits
+void ninebot_nus_mtu_update(uint8_t link, uint16_t att_mtu);      // negotiated ATT_MTU, sizes the status block read
+uint16_t ninebot_nus_max_frame_length(uint8_t link);              // largest frame that fits one notification
 
-// nus handlers
-uint32_t ninebot_nus_start_polling(ble_nus_c_t *nus_c);
-void ninebot_nus_received_data(uint8_t *p_data, uint8_t data_len);
-uint32_t ninebot_nus_stop_polling(void);
+// radio_timing prepare handler, sends the poll the timer left due
+void ninebot_radio_prepare(void);
 
 // fetch updated data
-void request_distance_remaining(void);
-void request_speed(void);
-void request_battery_percentage(void);
+void request_distance_remaining(uint8_t link);
+void request_speed(uint8_t link);
+void request_battery_percentage(uint8_t link);
+void request_battery_status(uint8_t link);
 
 #ifdef __splusplus
 }
@@ -0,0 +1,227 @@
+/*
+  ninebot_stats.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+
+#include "ninebot_stats.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "NBS"
+#if NINEBOT_STATS_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       NINEBOT_STATS_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+// RTC1 ticks -> milliseconds, app_timer runs with prescaler 0.
+#define TICKS_TO_MS(ticks) ((uint32_t)(((uint64_t)(ticks) * 1000) / APP_TIMER_CLOCK_FREQ))
+
+typedef struct {
+  ninebot_register_stats_t stats;
+  bool pending;        // request sent, response not yet seen
+  uint32_t sent_ticks; // app_timer_cnt_get() at send
+} ninebot_stats_slot_t;
+
+#define STATS_MAX_LINKS 8              // links are reported in a byte by ninebot_stats_check_timeouts
+
+static ninebot_stats_slot_t m_slots[NINEBOT_STATS_MAX_REGISTERS];
+static uint8_t m_slot_count;
+static uint32_t m_link_sleep_ms[STATS_MAX_LINKS];
+
+// internal
+
+static ninebot_stats_slot_t *slot_find(uint8_t link, uint8_t target, uint8_t reg) {
+  for (uint8_t i = 0; i < m_slot_count; i++) {
+    if (m_slots[i].stats.reg == reg && m_slots[i].stats.link == link && m_slots[i].stats.target == target) {
+      return &m_slots[i];
+    }
+  }
+  return NULL;
+}
+
+static ninebot_stats_slot_t *slot_find_or_add(uint8_t link, uint8_t target, uint8_t reg) {
+  ninebot_stats_slot_t *slot = slot_find(link, target, reg);
+  if (!slot && m_slot_count < NINEBOT_STATS_MAX_REGISTERS) {
+    slot = &m_slots[m_slot_count++];
+    memset(slot, 0, sizeof(ninebot_stats_slot_t));
+    slot->stats.link = link;
+    slot->stats.target = target;
+    slot->stats.reg = reg;
+    slot->stats.rtt_min_ms = UINT32_MAX;
+  }
+  return slot;
+}
+
+static uint8_t rtt_bucket(uint32_t rtt_ms) {
+  // bucket 0 is < 16ms, each following bucket doubles.
+  uint8_t bucket = 0;
+  uint32_t limit = 16;
+  while (rtt_ms >= limit && bucket < (NINEBOT_STATS_RTT_BUCKETS - 1)) {
+    limit <<= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+static uint32_t elapsed_ms(uint32_t from_ticks) {
+  uint32_t diff = 0;
+  UNUSED_RETURN_VALUE(app_timer_cnt_diff_compute(app_timer_cnt_get(), from_ticks, &diff));
+  return TICKS_TO_MS(diff);
+}
+
+// Stats
+
+void ninebot_stats_reset(void) {
+  CRITICAL_REGION_ENTER();
+  memset(m_slots, 0, sizeof(m_slots));
+  m_slot_count = 0;
+  CRITICAL_REGION_EXIT();
+}
+
+void ninebot_stats_link_sleep_set(uint8_t link, uint32_t sleep_ms) {
+  if (link < STATS_MAX_LINKS) {
+    m_link_sleep_ms[link] = sleep_ms;
+  }
+}
+
+uint32_t ninebot_stats_timeout_ms(uint8_t link) {
+  return NINEBOT_STATS_TIMEOUT_MS + (link < STATS_MAX_LINKS ? m_link_sleep_ms[link] : 0);
+}
+
+void ninebot_stats_request_sent(uint8_t link, uint8_t target, uint8_t reg) {
+  CRITICAL_REGION_ENTER();
+  ninebot_stats_slot_t *slot = slot_find_or_add(link, target, reg);
+  if (slot) {
+    // A newer request supersedes one that was never answered.
+    if (slot->pending) {
+      slot->stats.timed_out++;
+    }
+    slot->stats.sent++;
+    slot->pending = true;
+    slot->sent_ticks = app_timer_cnt_get();
+  }
+  CRITICAL_REGION_EXIT();
+}
+
+void ninebot_stats_response_received(uint8_t link, uint8_t target, uint8_t reg) {
+  CRITICAL_REGION_ENTER();
+  ninebot_stats_slot_t *slot = slot_find(link, target, reg);
+  // Unsolicited or late responses have no matching request, ignore them.
+  if (slot && slot->pending) {
+    uint32_t rtt_ms = elapsed_ms(slot->sent_ticks);
+    slot->pending = false;
+    slot->stats.answered++;
+    slot->stats.rtt_total_ms += rtt_ms;
+    slot->stats.rtt_min_ms = MIN(slot->stats.rtt_min_ms, rtt_ms);
+    slot->stats.rtt_max_ms = MAX(slot->stats.rtt_max_ms, rtt_ms);
+    slot->stats.rtt_histogram[rtt_bucket(rtt_ms)]++;
+  }
+  CRITICAL_REGION_EXIT();
+}
+
+void ninebot_stats_checksum_failed(uint8_t link, uint8_t target, uint8_t reg) {
+  CRITICAL_REGION_ENTER();
+  ninebot_stats_slot_t *slot = slot_find_or_add(link, target, reg);
+  if (slot) {
+    slot->stats.checksum_failed++;
+  }
+  CRITICAL_REGION_EXIT();
+}
+
+uint8_t ninebot_stats_check_timeouts(void) {
+  uint8_t links = 0;
+  CRITICAL_REGION_ENTER();
+  for (uint8_t i = 0; i < m_slot_count; i++) {
+    ninebot_stats_slot_t *slot = &m_slots[i];
+    if (slot->pending && elapsed_ms(slot->sent_ticks) >= ninebot_stats_timeout_ms(slot->stats.link)) {
+      slot->pending = false;
+      slot->stats.timed_out++;
+      links |= (uint8_t)(1 << slot->stats.link);
+    }
+  }
+  CRITICAL_REGION_EXIT();
+  return links;
+}
+
+uint32_t ninebot_stats_get(uint8_t link, uint8_t target, uint8_t reg, ninebot_register_stats_t *stats_out) {
+  uint32_t error_code = NRF_SUCCESS;
+  if (!stats_out) {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  CRITICAL_REGION_ENTER();
+  ninebot_stats_slot_t *slot = slot_find(link, target, reg);
+  if (slot) {
+    *stats_out = slot->stats;
+  } else {
+    error_code = NRF_ERROR_NOT_FOUND;
+  }
+  CRITICAL_REGION_EXIT();
+  return error_code;
+}
+
+uint8_t ninebot_stats_register_count(void) {
+  return m_slot_count;
+}
+
+uint32_t ninebot_stats_get_index(uint8_t index, ninebot_register_stats_t *stats_out) {
+  uint32_t error_code = NRF_SUCCESS;
+  if (!stats_out) {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  CRITICAL_REGION_ENTER();
+  if (index < m_slot_count) {
+    *stats_out = m_slots[index].stats;
+  } else {
+    error_code = NRF_ERROR_NOT_FOUND;
+  }
+  CRITICAL_REGION_EXIT();
+  return error_code;
+}
+
+void ninebot_stats_log(void) {
+  ninebot_register_stats_t stats;
+  for (uint8_t i = 0; i < ninebot_stats_register_count(); i++) {
+    if (ninebot_stats_get_index(i, &stats) != NRF_SUCCESS) {
+      continue;
+    }
+    uint32_t rtt_avg_ms = stats.answered ? (stats.rtt_total_ms / stats.answered) : 0;
+    uint32_t rtt_min_ms = stats.answered ? stats.rtt_min_ms : 0;
+    NRF_LOG_INFO("link %d 0x%02x reg 0x%02x: sent %d ok %d\r\n",
+        stats.link, stats.target, stats.reg, stats.sent, stats.answered);
+    NRF_LOG_INFO("reg 0x%02x: timeout %d csum %d rtt min %d avg %d max %d ms\r\n",
+        stats.reg, stats.timed_out, stats.checksum_failed, rtt_min_ms, rtt_avg_ms, stats.rtt_max_ms);
+    NRF_LOG_INFO("reg 0x%02x: hist %d %d %d %d\r\n",
+        stats.reg, stats.rtt_histogram[0], stats.rtt_histogram[1], stats.rtt_histogram[2], stats.rtt_histogram[3]);
+    NRF_LOG_INFO("reg 0x%02x: hist %d %d %d %d\r\n",
+        stats.reg, stats.rtt_histogram[4], stats.rtt_histogram[5], stats.rtt_histogram[6], stats.rtt_histogram[7]);
+  }
+}
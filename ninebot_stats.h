@@ -0,0 +1,73 @@
+/*
+  ninebot_stats.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __NINEBOT_STATS_H
+#define __NINEBOT_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+#define NINEBOT_STATS_MAX_REGISTERS 16   /**< Number of distinct (link, target, register) entries tracked (see m365_register_map.h). */
+#define NINEBOT_STATS_RTT_BUCKETS   8    /**< RTT histogram buckets: <16, <32, <64, <128, <256, <512, <1024, >=1024 ms. */
+#define NINEBOT_STATS_TIMEOUT_MS    300  /**< A request without a response after this long counts as timed out, */
+                                         /**< plus the link's sleep, see ninebot_stats_link_sleep_set. */
+
+typedef struct {
+  uint8_t  link;                                     // scooter link index, see ninebot_module.h
+  uint8_t  target;                                   // addressed device, eg. MastertoM365 or MastertoBATT
+  uint8_t  reg;                                      // register id, eg. M365speedREG
+  uint32_t sent;                                     // requests handed to the softdevice
+  uint32_t answered;                                 // valid responses matched to a request
+  uint32_t timed_out;                                // requests that never got a response
+  uint32_t checksum_failed;                          // responses dropped by ninebot_parse
+  uint32_t rtt_min_ms;
+  uint32_t rtt_max_ms;
+  uint32_t rtt_total_ms;                             // rtt_total_ms / answered = average
+  uint32_t rtt_histogram[NINEBOT_STATS_RTT_BUCKETS];
+} ninebot_register_stats_t;
+
+void ninebot_stats_reset(void);
+
+// Slave latency and long intervals stretch the round trip, the timeout grows with them.
+void ninebot_stats_link_sleep_set(uint8_t link, uint32_t sleep_ms);
+uint32_t ninebot_stats_timeout_ms(uint8_t link);
+
+// link events, the scooter and its BMS share register numbers so the target is part of the key
+void ninebot_stats_request_sent(uint8_t link, uint8_t target, uint8_t reg);
+void ninebot_stats_response_received(uint8_t link, uint8_t target, uint8_t reg);
+void ninebot_stats_checksum_failed(uint8_t link, uint8_t target, uint8_t reg);
+uint8_t ninebot_stats_check_timeouts(void);       // bit n set when link n had a request time out
+
+// readers
+uint32_t ninebot_stats_get(uint8_t link, uint8_t target, uint8_t reg, ninebot_register_stats_t *stats_out);
+uint8_t ninebot_stats_register_count(void);
+uint32_t ninebot_stats_get_index(uint8_t index, ninebot_register_stats_t *stats_out);
+void ninebot_stats_log(void);
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __NINEBOT_STATS_H */
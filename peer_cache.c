@@ -0,0 +1,249 @@
+/*
+  peer_cache.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_util.h"
+#include "fds.h"
+
+#include "peer_cache.h"
+#include "warm_start.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "PCH"
+#if BLE_MODULE_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       BLE_MODULE_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#define PEER_CACHE_VERSION 1 /**< Bump when peer_cache_record_t changes, old records are ignored. */
+
+typedef struct {
+  uint32_t version;
+  peer_cache_entry_t entry;
+} peer_cache_record_t;
+
+static peer_cache_record_t m_record;           // also the fds write source, must stay put until written
+static fds_record_desc_t m_record_desc;
+static bool m_record_exists;                   // a record is in flash (m_record_desc is valid)
+static bool m_valid;                           // m_record holds a usable entry
+static bool m_persisted;                       // m_record is what flash holds, set by the write event
+static bool m_ready;
+static bool m_write_pending;
+static bool m_gc_pending;                      // flash was full, m_record is written again after fds_gc
+static peer_cache_ready_handler_t m_ready_handler;
+
+// internal
+
+static void peer_cache_load(void) {
+  fds_find_token_t token;
+  fds_flash_record_t flash_record;
+
+  memset(&token, 0, sizeof(token));
+  if (fds_record_find(PEER_CACHE_FILE_ID, PEER_CACHE_RECORD_KEY, &m_record_desc, &token) != FDS_SUCCESS) {
+    NRF_LOG_INFO("No cached peer.\r\n");
+    return;
+  }
+  m_record_exists = true;
+
+  if (fds_record_open(&m_record_desc, &flash_record) == FDS_SUCCESS) {
+    const peer_cache_record_t *p_record = (const peer_cache_record_t *)flash_record.p_data;
+    if (p_record->version == PEER_CACHE_VERSION) {
+      if (!m_valid) {
+        m_record = *p_record;
+        m_valid = true;
+        NRF_LOG_INFO("Cached peer loaded.\r\n");
+      }
+      // A retained peer from a warm start may be newer than what flash holds.
+      m_persisted = (memcmp(&m_record.entry, &p_record->entry, sizeof(peer_cache_entry_t)) == 0);
+    }
+    UNUSED_RETURN_VALUE(fds_record_close(&m_record_desc));
+  }
+}
+
+// Writes m_record, which stays put until the write event.
+static uint32_t record_write(void) {
+  uint32_t error_code;
+  fds_record_chunk_t chunk;
+  fds_record_t record;
+
+  chunk.p_data = &m_record;
+  chunk.length_words = CEIL_DIV(sizeof(peer_cache_record_t), sizeof(uint32_t));
+  record.file_id = PEER_CACHE_FILE_ID;
+  record.key = PEER_CACHE_RECORD_KEY;
+  record.data.p_chunks = &chunk;
+  record.data.num_chunks = 1;
+
+  if (m_record_exists) {
+    error_code = fds_record_update(&m_record_desc, &record);
+  } else {
+    error_code = fds_record_write(&m_record_desc, &record);
+  }
+
+  if (error_code == FDS_ERR_NO_SPACE_IN_FLASH && !m_gc_pending) {
+    // Reclaim the space held by superseded records, written again once that's done.
+    if (fds_gc() == FDS_SUCCESS) {
+      m_gc_pending = true;
+      m_write_pending = true;
+      error_code = FDS_SUCCESS;
+    }
+  } else if (error_code == FDS_SUCCESS) {
+    m_write_pending = true;
+  } else {
+    NRF_LOG_WARNING("Peer write failed: %d\r\n", error_code);
+  }
+  return error_code;
+}
+
+static void fds_evt_handler(fds_evt_t const *const p_evt) {
+  switch (p_evt->id) {
+  case FDS_EVT_INIT:
+    if (p_evt->result == FDS_SUCCESS) {
+      peer_cache_load();
+    } else {
+      NRF_LOG_ERROR("fds init failed: %d\r\n", p_evt->result);
+    }
+    // Without flash we just always do a full scan.
+    m_ready = true;
+    if (p_evt->result == FDS_SUCCESS && m_valid && !m_persisted) {
+      // the retained peer never made it to flash
+      UNUSED_RETURN_VALUE(record_write());
+    }
+    if (m_ready_handler) {
+      m_ready_handler();
+    }
+    break;
+
+  case FDS_EVT_WRITE:
+  case FDS_EVT_UPDATE:
+    if (p_evt->write.file_id == PEER_CACHE_FILE_ID) {
+      m_write_pending = false;
+      if (p_evt->result == FDS_SUCCESS) {
+        m_record_exists = true;
+        m_persisted = true;
+        UNUSED_RETURN_VALUE(fds_descriptor_from_rec_id(&m_record_desc, p_evt->write.record_id));
+        NRF_LOG_DEBUG("Peer cached.\r\n");
+      } else {
+        // the next store writes it again
+        m_persisted = false;
+        NRF_LOG_WARNING("Peer write failed: %d\r\n", p_evt->result);
+      }
+    }
+    break;
+
+  case FDS_EVT_GC:
+    if (m_gc_pending) {
+      m_write_pending = false;
+      // a second full flash gives up until the next store
+      UNUSED_RETURN_VALUE(record_write());
+      m_gc_pending = false;
+    }
+    break;
+
+  case FDS_EVT_DEL_RECORD:
+    if (p_evt->del.file_id == PEER_CACHE_FILE_ID) {
+      m_write_pending = false;
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+// Peer cache
+
+uint32_t peer_cache_init(peer_cache_ready_handler_t ready_handler) {
+  uint32_t error_code;
+
+  m_ready_handler = ready_handler;
+  // A warm start already has the peer, the reconnect needn't wait for fds.
+  if (warm_start_peer_get(&m_record.entry)) {
+    m_record.version = PEER_CACHE_VERSION;
+    m_valid = true;
+    NRF_LOG_INFO("Retained peer loaded.\r\n");
+  }
+  error_code = fds_register(fds_evt_handler);
+
+  NRF_LOG_DEBUG("peer_cache_init finished.\r\n");
+  return error_code;
+}
+
+bool peer_cache_is_ready(void) {
+  return m_ready || m_valid;
+}
+
+bool peer_cache_get(peer_cache_entry_t *entry_out) {
+  if (!m_valid || !entry_out) {
+    return false;
+  }
+  *entry_out = m_record.entry;
+  return true;
+}
+
+bool peer_cache_matches(const ble_gap_addr_t *peer_addr) {
+  return m_valid && peer_addr &&
+         (m_record.entry.peer_addr.addr_type == peer_addr->addr_type) &&
+         (memcmp(m_record.entry.peer_addr.addr, peer_addr->addr, BLE_GAP_ADDR_LEN) == 0);
+}
+
+uint32_t peer_cache_store(const peer_cache_entry_t *entry) {
+  if (!entry) {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+  warm_start_peer_store(entry);
+  if (!m_ready || m_write_pending) {
+    return NRF_ERROR_BUSY;
+  }
+
+  // Flash writes are slow and wear the page, skip them when flash already has it.
+  if (m_persisted && memcmp(&m_record.entry, entry, sizeof(peer_cache_entry_t)) == 0) {
+    return NRF_SUCCESS;
+  }
+
+  m_record.version = PEER_CACHE_VERSION;
+  m_record.entry = *entry;
+  m_valid = true;
+  m_persisted = false;
+  return record_write();
+}
+
+uint32_t peer_cache_clear(void) {
+  uint32_t error_code = NRF_SUCCESS;
+  m_valid = false;
+  m_persisted = false;
+  warm_start_peer_store(NULL);
+  if (m_record_exists && !m_write_pending) {
+    error_code = fds_record_delete(&m_record_desc);
+    if (error_code == FDS_SUCCESS) {
+      m_record_exists = false;
+      m_write_pending = true;
+    }
+  }
+  return error_code;
+}
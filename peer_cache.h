@@ -0,0 +1,60 @@
+/*
+  peer_cache.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Last connected scooter (address + NUS handles) kept in flash, so a
+// reconnect can skip both the open scan and service discovery.
+
+#ifndef __PEER_CACHE_H
+#define __PEER_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble_gap.h"
+#include "ble_nus_c.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+#define PEER_CACHE_FILE_ID     0x4D33  /**< fds file id ("M3"). */
+#define PEER_CACHE_RECORD_KEY  0x0001  /**< fds record key for the peer entry. */
+
+typedef struct {
+  ble_gap_addr_t peer_addr;
+  ble_nus_c_handles_t handles;
+} peer_cache_entry_t;
+
+typedef void (*peer_cache_ready_handler_t)(void);
+
+// Registers with fds, ready once the caller's fds_init has finished.
+uint32_t peer_cache_init(peer_cache_ready_handler_t ready_handler);
+bool peer_cache_is_ready(void);
+
+bool peer_cache_get(peer_cache_entry_t *entry_out);
+bool peer_cache_matches(const ble_gap_addr_t *peer_addr);
+uint32_t peer_cache_store(const peer_cache_entry_t *entry);
+uint32_t peer_cache_clear(void);
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __PEER_CACHE_H */
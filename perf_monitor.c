@@ -0,0 +1,191 @@
+/*
+  perf_monitor.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "sdk_macros.h"
+
+#include "ninebot_stats.h"
+#include "perf_monitor.h"
+
+#include "sdk_config.h"
+
+#if PERF_MONITOR_ENABLED
+
+#define WINDOW_MS           1000
+#define TICKS_TO_US(ticks)  ((uint32_t)(((uint64_t)(ticks) * 1000000) >> 15))  /**< RTC1 runs at 32768 Hz. */
+
+typedef struct {
+  uint16_t count;
+  uint32_t ticks;
+  uint32_t max_ticks;
+} span_window_t;
+
+typedef struct {
+  uint32_t sent;
+  uint32_t answered;
+  uint32_t rtt_total_ms;
+} link_totals_t;
+
+APP_TIMER_DEF(m_window_timer_id);
+
+// vars
+static perf_monitor_update_handler_t m_update_handler;
+static perf_monitor_stats_t m_stats;                  // last finished window
+static span_window_t m_spans[perf_monitor_span_count];
+static uint32_t m_idle_ticks;
+static uint32_t m_idle_start;
+static volatile bool m_idle;                          // main loop is in sd_app_evt_wait
+static uint32_t m_window_start;
+static link_totals_t m_totals;                        // ninebot_stats at the last window
+
+// internal
+
+static uint32_t ticks_since(uint32_t start) {
+  uint32_t elapsed;
+  UNUSED_RETURN_VALUE(app_timer_cnt_diff_compute(app_timer_cnt_get(), start, &elapsed));
+  return elapsed;
+}
+
+// Sums every (link, target, register) entry, the totals only grow so a window is the difference.
+static void link_totals_read(link_totals_t *p_totals) {
+  ninebot_register_stats_t stats;
+
+  memset(p_totals, 0, sizeof(link_totals_t));
+  m_stats.timeouts = 0;
+  m_stats.checksum_errors = 0;
+  for (uint8_t index = 0; index < ninebot_stats_register_count(); index++) {
+    if (ninebot_stats_get_index(index, &stats) != NRF_SUCCESS) {
+      continue;
+    }
+    p_totals->sent += stats.sent;
+    p_totals->answered += stats.answered;
+    p_totals->rtt_total_ms += stats.rtt_total_ms;
+    m_stats.timeouts += stats.timed_out;
+    m_stats.checksum_errors += stats.checksum_failed;
+    m_stats.rtt_max_ms = MAX(m_stats.rtt_max_ms, stats.rtt_max_ms);
+  }
+}
+
+static void span_stats(perf_monitor_span_t span, uint16_t *p_avg_us, uint16_t *p_max_us) {
+  span_window_t *p_span = &m_spans[span];
+  *p_avg_us = p_span->count ? (uint16_t)MIN(TICKS_TO_US(p_span->ticks / p_span->count), UINT16_MAX) : 0;
+  *p_max_us = (uint16_t)MIN(TICKS_TO_US(p_span->max_ticks), UINT16_MAX);
+}
+
+static void window_timer_handler(void *p_context) {
+  link_totals_t totals;
+  uint32_t window;
+  uint32_t idle;
+
+  CRITICAL_REGION_ENTER();
+  window = ticks_since(m_window_start);
+  idle = m_idle_ticks;
+  if (m_idle) {
+    // still asleep, the part so far belongs to this window
+    idle += MIN(ticks_since(m_idle_start), window);
+  }
+  m_window_start = app_timer_cnt_get();
+  m_idle_ticks = 0;
+  CRITICAL_REGION_EXIT();
+
+  m_stats.cpu_load = window ? (uint8_t)(100 - MIN(idle, window) * 100 / window) : 0;
+  m_stats.renders_per_s = (uint8_t)MIN(m_spans[perf_monitor_render].count, UINT8_MAX);
+  m_stats.frames_per_s = (uint8_t)MIN(m_spans[perf_monitor_flush].count, UINT8_MAX);
+  span_stats(perf_monitor_render, &m_stats.render_us, &m_stats.render_max_us);
+  span_stats(perf_monitor_flush, &m_stats.flush_us, &m_stats.flush_max_us);
+  memset(m_spans, 0, sizeof(m_spans));
+
+  link_totals_read(&totals);
+  m_stats.requests_per_s = (uint16_t)(totals.sent - m_totals.sent);
+  m_stats.responses_per_s = (uint16_t)(totals.answered - m_totals.answered);
+  m_stats.rtt_ms = m_stats.responses_per_s ? (uint16_t)((totals.rtt_total_ms - m_totals.rtt_total_ms) / m_stats.responses_per_s) : 0;
+  m_totals = totals;
+
+  if (m_update_handler) {
+    m_update_handler();
+  }
+}
+
+// Perf monitor
+
+uint32_t perf_monitor_init(perf_monitor_update_handler_t update_handler) {
+  uint32_t error_code;
+
+  m_update_handler = update_handler;
+  memset(&m_stats, 0, sizeof(m_stats));
+  memset(m_spans, 0, sizeof(m_spans));
+  m_idle_ticks = 0;
+  m_window_start = app_timer_cnt_get();
+  link_totals_read(&m_totals);
+
+  error_code = app_timer_create(&m_window_timer_id, APP_TIMER_MODE_REPEATED, window_timer_handler);
+  VERIFY_SUCCESS(error_code);
+  return app_timer_start(m_window_timer_id, APP_TIMER_TICKS(WINDOW_MS, 0), NULL);
+}
+
+void perf_monitor_idle_begin(void) {
+  m_idle_start = app_timer_cnt_get();
+  m_idle = true;
+}
+
+void perf_monitor_idle_end(void) {
+  CRITICAL_REGION_ENTER();
+  // A window that started meanwhile already has the part before it.
+  m_idle_ticks += MIN(ticks_since(m_idle_start), ticks_since(m_window_start));
+  m_idle = false;
+  CRITICAL_REGION_EXIT();
+}
+
+uint32_t perf_monitor_span_begin(void) {
+  return app_timer_cnt_get();
+}
+
+void perf_monitor_span_end(perf_monitor_span_t span, uint32_t start) {
+  uint32_t elapsed = ticks_since(start);
+  span_window_t *p_span;
+
+  if (span >= perf_monitor_span_count) {
+    return;
+  }
+  p_span = &m_spans[span];
+  CRITICAL_REGION_ENTER();
+  p_span->count++;
+  p_span->ticks += elapsed;
+  p_span->max_ticks = MAX(p_span->max_ticks, elapsed);
+  CRITICAL_REGION_EXIT();
+}
+
+void perf_monitor_stats_get(perf_monitor_stats_t *stats_out) {
+  if (stats_out) {
+    CRITICAL_REGION_ENTER();
+    *stats_out = m_stats;
+    CRITICAL_REGION_EXIT();
+  }
+}
+
+#endif // PERF_MONITOR_ENABLED
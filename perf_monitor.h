@@ -0,0 +1,89 @@
+/*
+  perf_monitor.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// CPU load and display/link throughput, summed over one second windows on
+// RTC1 ticks. Load is the time outside sd_app_evt_wait, render and flush
+// times bracket display_render and the flush. Shown by the HUD page.
+
+#ifndef __PERF_MONITOR_H
+#define __PERF_MONITOR_H
+
+#include <stdint.h>
+#include "sdk_config.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+typedef struct {
+  uint8_t  cpu_load;                   // percent awake
+  uint8_t  renders_per_s;
+  uint8_t  frames_per_s;               // flushed to the display
+  uint16_t render_us;                  // average
+  uint16_t render_max_us;
+  uint16_t flush_us;
+  uint16_t flush_max_us;
+  uint16_t requests_per_s;             // scooter requests sent
+  uint16_t responses_per_s;
+  uint16_t rtt_ms;                     // average over the window's responses
+  uint32_t rtt_max_ms;                 // since boot, from here on
+  uint32_t timeouts;
+  uint32_t checksum_errors;
+} perf_monitor_stats_t;
+
+typedef void (*perf_monitor_update_handler_t)(void);
+
+typedef enum {
+  perf_monitor_render = 0,
+  perf_monitor_flush,
+  perf_monitor_span_count
+} perf_monitor_span_t;
+
+#if PERF_MONITOR_ENABLED
+
+// The handler runs after every window, from the timer.
+uint32_t perf_monitor_init(perf_monitor_update_handler_t update_handler);
+
+// Around sd_app_evt_wait.
+void perf_monitor_idle_begin(void);
+void perf_monitor_idle_end(void);
+
+// begin returns the start tick to hand to end
+uint32_t perf_monitor_span_begin(void);
+void perf_monitor_span_end(perf_monitor_span_t span, uint32_t start);
+
+void perf_monitor_stats_get(perf_monitor_stats_t *stats_out);
+
+#else
+
+#define perf_monitor_init(update_handler) NRF_SUCCESS
+#define perf_monitor_idle_begin()
+#define perf_monitor_idle_end()
+#define perf_monitor_span_begin() 0
+#define perf_monitor_span_end(span, start) UNUSED_VARIABLE(start)
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __PERF_MONITOR_H */
@@ -0,0 +1,256 @@
+/*
+  power_manager.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "nrf_soc.h"
+#include "sdk_macros.h"
+
+#include "ms_clock.h"
+#include "ssd1306.h"
+#include "power_manager.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "PWR"
+#if POWER_MANAGER_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       POWER_MANAGER_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#if POWER_MANAGER_ENABLED
+
+#define TICK_MS             1000
+#define REPORT_TICKS        60                                  /**< Charge report every minute. */
+#define RTC_TICKS_PER_HOUR  (32768ULL * 3600)                   /**< app_timer runs RTC1 unprescaled. */
+
+typedef enum {
+  display_full = 0,
+  display_dim,
+  display_off
+} display_state_t;
+
+// Estimated draw in uA at 3 V, from the nRF52832 and SSD1306 datasheets.
+static const uint16_t m_current_ua[power_subsystem_count] = {
+  7400,                                // cpu, 64 MHz from flash on the LDO
+  12000,                               // display at 0xCF, about a third of the pixels lit
+  3000,                                // display at contrast 0
+  10,                                  // display asleep
+  150,                                 // twi enabled, keeps the HFCLK requested
+  2700,                                // scanning, 5.4 mA RX at about half duty
+  200,                                 // per link, a few packets every connection interval
+};
+
+static const char *m_subsystem_names[power_subsystem_count] = {
+  "cpu", "display", "display dim", "display off", "twi", "scan", "links"
+};
+
+APP_TIMER_DEF(m_tick_timer_id);
+
+// vars
+static power_manager_system_off_handler_t m_system_off_handler;
+static uint64_t m_on_ticks[power_subsystem_count];    // RTC ticks, link weighted for radio_link
+static uint32_t m_account_tick;                       // accounted up to
+static uint32_t m_wake_tick;                          // cpu awake since
+static display_state_t m_display;                     // what the panel is doing
+static volatile display_state_t m_target;             // what it should be doing, applied from the main loop
+static bool m_twi_enabled;
+static uint8_t m_links;
+static volatile uint32_t m_activity_ms;
+static uint32_t m_disconnected_ms;
+static volatile bool m_system_off_pending;
+static uint8_t m_report_counter;
+
+// internal
+
+// Adds the time since the last call to everything that's on, before any of it changes.
+static void account_update(void) {
+  uint32_t now;
+  uint32_t elapsed;
+
+  CRITICAL_REGION_ENTER();
+  now = app_timer_cnt_get();
+  UNUSED_RETURN_VALUE(app_timer_cnt_diff_compute(now, m_account_tick, &elapsed));
+  m_account_tick = now;
+
+  m_on_ticks[power_subsystem_display_full + m_display] += elapsed;
+  if (m_twi_enabled) {
+    m_on_ticks[power_subsystem_twi] += elapsed;
+  }
+  if (m_links == 0) {
+    m_on_ticks[power_subsystem_radio_scan] += elapsed;
+  } else {
+    m_on_ticks[power_subsystem_radio_link] += (uint64_t)elapsed * m_links;
+  }
+  CRITICAL_REGION_EXIT();
+}
+
+static void twi_enable(bool enable) {
+  if (enable != m_twi_enabled) {
+    account_update();
+    m_twi_enabled = enable;
+    ssd1306_twi_enable(enable);
+  }
+}
+
+static void display_apply(display_state_t state) {
+  account_update();
+  twi_enable(true);
+  if (m_display == display_off) {
+    ssd1306_sleep(false);
+  }
+  if (state == display_off) {
+    ssd1306_sleep(true);
+  } else {
+    ssd1306_dim(state == display_dim);
+  }
+  twi_enable(false);
+  m_display = state;
+  NRF_LOG_DEBUG("Display %s.\r\n", (uint32_t)m_subsystem_names[power_subsystem_display_full + state]);
+}
+
+static void tick_timer_handler(void *p_context) {
+  uint32_t now = ms_clock_now();
+  uint32_t idle = now - m_activity_ms;
+
+  if (idle >= POWER_MANAGER_OFF_MS) {
+    m_target = display_off;
+  } else if (idle >= POWER_MANAGER_DIM_MS) {
+    m_target = display_dim;
+  }
+  if (m_links == 0 && now - m_disconnected_ms >= POWER_MANAGER_SYSTEM_OFF_MS) {
+    m_system_off_pending = true;
+  }
+
+  if (++m_report_counter >= REPORT_TICKS) {
+    m_report_counter = 0;
+    power_manager_report_log();
+  }
+}
+
+// Power manager
+
+uint32_t power_manager_init(power_manager_system_off_handler_t system_off_handler) {
+  uint32_t error_code;
+
+  m_system_off_handler = system_off_handler;
+  memset(m_on_ticks, 0, sizeof(m_on_ticks));
+  m_account_tick = app_timer_cnt_get();
+  m_wake_tick = m_account_tick;
+  m_display = display_full;
+  m_target = display_full;
+  m_activity_ms = ms_clock_now();
+  m_disconnected_ms = m_activity_ms;
+
+  // Left on by ssd1306_init_i2c.
+  m_twi_enabled = true;
+  twi_enable(false);
+
+  error_code = app_timer_create(&m_tick_timer_id, APP_TIMER_MODE_REPEATED, tick_timer_handler);
+  VERIFY_SUCCESS(error_code);
+  error_code = app_timer_start(m_tick_timer_id, APP_TIMER_TICKS(TICK_MS, 0), NULL);
+
+  NRF_LOG_DEBUG("power_manager_init finished.\r\n");
+  return error_code;
+}
+
+void power_manager_activity(void) {
+  m_activity_ms = ms_clock_now();
+  m_target = display_full;
+}
+
+void power_manager_links_set(uint8_t links) {
+  account_update();
+  if (links == 0 && m_links != 0) {
+    m_disconnected_ms = ms_clock_now();
+  }
+  m_links = links;
+}
+
+void power_manager_process(void) {
+  display_state_t target = m_target;
+
+  if (target != m_display) {
+    display_apply(target);
+  }
+  if (m_system_off_pending) {
+    m_system_off_pending = false;
+    NRF_LOG_INFO("No scooter for %d s, powering off.\r\n", POWER_MANAGER_SYSTEM_OFF_MS / 1000);
+    power_manager_report_log();
+    if (m_system_off_handler) {
+      m_system_off_handler();
+    }
+  }
+}
+
+bool power_manager_display_begin(void) {
+  if (m_display == display_off) {
+    return false;
+  }
+  twi_enable(true);
+  return true;
+}
+
+void power_manager_display_end(void) {
+  twi_enable(false);
+}
+
+uint32_t power_manager_sleep(void) {
+  uint32_t now = app_timer_cnt_get();
+  uint32_t elapsed;
+  uint32_t error_code;
+
+  UNUSED_RETURN_VALUE(app_timer_cnt_diff_compute(now, m_wake_tick, &elapsed));
+  m_on_ticks[power_subsystem_cpu] += elapsed;
+  error_code = sd_app_evt_wait();
+  m_wake_tick = app_timer_cnt_get();
+  return error_code;
+}
+
+uint32_t power_manager_charge_get(power_subsystem_t subsystem) {
+  if (subsystem >= power_subsystem_count) {
+    return 0;
+  }
+  return (uint32_t)(m_on_ticks[subsystem] * m_current_ua[subsystem] / RTC_TICKS_PER_HOUR);
+}
+
+void power_manager_report_log(void) {
+  uint32_t total = 0;
+  uint32_t uptime_s = MAX(ms_clock_now() / 1000, 1);
+
+  account_update();
+  for (uint8_t subsystem = 0; subsystem < power_subsystem_count; subsystem++) {
+    uint32_t charge = power_manager_charge_get((power_subsystem_t)subsystem);
+    total += charge;
+    NRF_LOG_INFO("%6d uAh %s\r\n", charge, (uint32_t)m_subsystem_names[subsystem]);
+  }
+  NRF_LOG_INFO("%d uAh in %d s, %d uA average\r\n", total, uptime_s, (uint32_t)((uint64_t)total * 3600 / uptime_s));
+}
+
+#endif // POWER_MANAGER_ENABLED
@@ -0,0 +1,93 @@
+/*
+  power_manager.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Display and peripheral power policy: full contrast while riding, dimmed
+// after POWER_MANAGER_DIM_MS without activity, panel and charge pump off after
+// POWER_MANAGER_OFF_MS, system-off once no scooter has been connected for
+// POWER_MANAGER_SYSTEM_OFF_MS. The TWI is only enabled around display traffic.
+// Charge per subsystem is estimated from on-time and logged every minute.
+
+#ifndef __POWER_MANAGER_H
+#define __POWER_MANAGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_config.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+typedef enum {
+  power_subsystem_cpu = 0,             // awake, outside sd_app_evt_wait
+  power_subsystem_display_full,
+  power_subsystem_display_dim,
+  power_subsystem_display_off,         // panel asleep, controller powered
+  power_subsystem_twi,
+  power_subsystem_radio_scan,          // no scooter connected, scanning
+  power_subsystem_radio_link,          // per connected scooter
+  power_subsystem_count
+} power_subsystem_t;
+
+typedef void (*power_manager_system_off_handler_t)(void);
+
+#if POWER_MANAGER_ENABLED
+
+// After the display is up, leaves the TWI disabled.
+uint32_t power_manager_init(power_manager_system_off_handler_t system_off_handler);
+
+// Button presses, connection changes and a moving scooter.
+void power_manager_activity(void);
+void power_manager_links_set(uint8_t links);
+
+// From the main loop, applies the display state the timer picked and powers off.
+void power_manager_process(void);
+
+// Wraps display traffic, false while the panel is off (frames wait).
+bool power_manager_display_begin(void);
+void power_manager_display_end(void);
+
+// Replaces sd_app_evt_wait, accounting the time awake.
+uint32_t power_manager_sleep(void);
+
+// uAh since boot
+uint32_t power_manager_charge_get(power_subsystem_t subsystem);
+void power_manager_report_log(void);
+
+#else
+
+#define power_manager_init(system_off_handler) NRF_SUCCESS
+#define power_manager_activity()
+#define power_manager_links_set(links)
+#define power_manager_process()
+#define power_manager_display_begin() true
+#define power_manager_display_end()
+#define power_manager_sleep() sd_app_evt_wait()
+#define power_manager_charge_get(subsystem) 0
+#define power_manager_report_log()
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __POWER_MANAGER_H */
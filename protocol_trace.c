@@ -0,0 +1,124 @@
+/*
+  protocol_trace.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nordic_common.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "SEGGER_RTT.h"
+
+#include "protocol_trace.h"
+
+#if PROTOCOL_TRACE_ENABLED
+
+STATIC_ASSERT(sizeof(protocol_trace_record_t) == 8);
+STATIC_ASSERT(IS_POWER_OF_TWO(PROTOCOL_TRACE_RING_SIZE));
+
+#define RING_MASK (PROTOCOL_TRACE_RING_SIZE - 1)
+
+// The RTT buffer only needs to cover the host's polling gap, the RAM ring absorbs bursts.
+static uint8_t m_rtt_buffer[PROTOCOL_TRACE_RING_SIZE * sizeof(protocol_trace_record_t)];
+
+static protocol_trace_record_t m_ring[PROTOCOL_TRACE_RING_SIZE];
+static volatile uint32_t m_write_index;
+static volatile uint32_t m_read_index;
+static uint32_t m_dropped;
+static uint32_t m_drop_index;          // m_write_index when the ring ran full, the lost records go after it
+static uint32_t m_drop_ticks;          // app_timer_cnt_get() at the first lost record
+
+static void record_fill(protocol_trace_record_t *record, uint32_t ticks, uint8_t direction, uint8_t reg, uint8_t length, uint8_t status) {
+  record->sync = PROTOCOL_TRACE_SYNC;
+  record->direction = direction;
+  record->reg = reg;
+  record->length = length;
+  record->status = status;
+  record->timestamp[0] = (uint8_t)(ticks);
+  record->timestamp[1] = (uint8_t)(ticks >> 8);
+  record->timestamp[2] = (uint8_t)(ticks >> 16);
+}
+
+void protocol_trace_init(void) {
+  m_write_index = 0;
+  m_read_index = 0;
+  m_dropped = 0;
+  m_drop_index = 0;
+  UNUSED_RETURN_VALUE(SEGGER_RTT_ConfigUpBuffer(PROTOCOL_TRACE_RTT_CHANNEL, "NinebotTrace",
+      m_rtt_buffer, sizeof(m_rtt_buffer), SEGGER_RTT_MODE_NO_BLOCK_SKIP));
+}
+
+// Cheap enough for the BLE and timer handlers, the RTT copy happens in protocol_trace_flush.
+void protocol_trace_record(protocol_trace_direction_t direction, uint8_t link, uint8_t reg, uint8_t length, uint8_t status) {
+  CRITICAL_REGION_ENTER();
+  if ((m_write_index - m_read_index) < PROTOCOL_TRACE_RING_SIZE) {
+    record_fill(&m_ring[m_write_index & RING_MASK], app_timer_cnt_get(), (uint8_t)(direction | (link << 4)), reg, length, status);
+    m_write_index++;
+  } else {
+    if (m_dropped == 0) {
+      m_drop_index = m_write_index;
+      m_drop_ticks = app_timer_cnt_get();
+    }
+    m_dropped++;
+  }
+  CRITICAL_REGION_EXIT();
+}
+
+// Called from the main loop, moves as many records as fit into the RTT channel.
+// The drop record goes out in its place, after the records the ring held when it
+// ran full, so the timeline stays in order.
+void protocol_trace_flush(void) {
+  for (;;) {
+    uint32_t dropped;
+    uint32_t drop_index;
+    uint32_t drop_ticks;
+    CRITICAL_REGION_ENTER();
+    dropped = m_dropped;
+    drop_index = m_drop_index;
+    drop_ticks = m_drop_ticks;
+    CRITICAL_REGION_EXIT();
+
+    if (dropped && m_read_index == drop_index) {
+      protocol_trace_record_t record;
+      uint8_t count = (uint8_t)MIN(dropped, UINT8_MAX);
+      record_fill(&record, drop_ticks, protocol_trace_drop, 0, count, 0);
+      if (SEGGER_RTT_Write(PROTOCOL_TRACE_RTT_CHANNEL, &record, sizeof(record)) == 0) {
+        break;
+      }
+      // only what was reported, more may have been lost since
+      CRITICAL_REGION_ENTER();
+      m_dropped -= count;
+      CRITICAL_REGION_EXIT();
+    } else if (m_read_index != m_write_index) {
+      protocol_trace_record_t *record = &m_ring[m_read_index & RING_MASK];
+      if (SEGGER_RTT_Write(PROTOCOL_TRACE_RTT_CHANNEL, record, sizeof(protocol_trace_record_t)) == 0) {
+        // Host isn't keeping up (or not attached), keep the records for later.
+        break;
+      }
+      m_read_index++;
+    } else {
+      break;
+    }
+  }
+}
+
+#endif // PROTOCOL_TRACE_ENABLED
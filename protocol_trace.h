@@ -0,0 +1,77 @@
+/*
+  protocol_trace.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Compact binary trace of ninebot traffic, streamed over its own RTT channel.
+// Capture with: JLinkRTTLogger -Device NRF52832_XXAA -If SWD -Speed 4000 -RTTChannel 1 trace.bin
+// Decode with:  resources/decode_trace.py trace.bin
+
+#ifndef __PROTOCOL_TRACE_H
+#define __PROTOCOL_TRACE_H
+
+#include <stdint.h>
+
+#ifndef PROTOCOL_TRACE_ENABLED
+#define PROTOCOL_TRACE_ENABLED 1
+#endif
+
+#define PROTOCOL_TRACE_RTT_CHANNEL  1     /**< RTT up-buffer index, 0 is used by NRF_LOG. */
+#define PROTOCOL_TRACE_RING_SIZE    64    /**< Records held in RAM between flushes, must be a power of two. */
+#define PROTOCOL_TRACE_SYNC         0xA5  /**< First byte of every record, lets the decoder resync. */
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+typedef enum {
+  protocol_trace_tx = 0,    // request sent to the scooter
+  protocol_trace_rx = 1,    // response received from the scooter
+  protocol_trace_drop = 2   // records lost to a full ring, count in length
+} protocol_trace_direction_t;
+
+// 8 bytes, little endian, streamed as is.
+typedef struct __attribute__((packed)) {
+  uint8_t sync;             // PROTOCOL_TRACE_SYNC
+  uint8_t direction;        // protocol_trace_direction_t in the low nibble, link index in the high nibble
+  uint8_t reg;              // register, eg. M365speedREG
+  uint8_t length;           // bytes on air
+  uint8_t status;           // tx: 0 sent, 1 failed. rx: ninebot_parse() result
+  uint8_t timestamp[3];     // RTC1 ticks (32768Hz), 24 bit counter
+} protocol_trace_record_t;
+
+#if PROTOCOL_TRACE_ENABLED
+
+void protocol_trace_init(void);
+void protocol_trace_record(protocol_trace_direction_t direction, uint8_t link, uint8_t reg, uint8_t length, uint8_t status);
+void protocol_trace_flush(void);
+
+#else
+
+#define protocol_trace_init()
+#define protocol_trace_record(direction, link, reg, length, status)
+#define protocol_trace_flush()
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __PROTOCOL_TRACE_H */
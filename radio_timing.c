@@ -0,0 +1,84 @@
+/*
+  radio_timing.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nordic_common.h"
+#include "app_util_platform.h"
+#include "app_timer.h"
+#include "ble_radio_notification.h"
+
+#include "radio_timing.h"
+
+#if RADIO_TIMING_ENABLED
+
+#define APP_TIMER_PRESCALER   0      /**< Value of the RTC1 PRESCALER register. */
+#define ANCHOR_TOLERANCE_US   250    // RTC quantisation at both ends, with room to spare
+
+// vars
+static radio_timing_prepare_handler_t m_prepare_handler;
+static volatile bool m_idle = true;
+static uint32_t m_active_ticks;      // app_timer counter at the last notification
+
+// internal
+
+static void radio_notification_handler(bool radio_active) {
+  m_idle = !radio_active;
+  if (radio_active) {
+    m_active_ticks = app_timer_cnt_get();
+    if (m_prepare_handler) {
+      m_prepare_handler();
+    }
+  }
+}
+
+// Radio timing
+
+uint32_t radio_timing_init(radio_timing_prepare_handler_t prepare_handler) {
+  m_prepare_handler = prepare_handler;
+  m_idle = true;
+  // Same priority as the app_timer handlers, so the prepare handler and the polling timer never preempt each other.
+  return ble_radio_notification_init(APP_IRQ_PRIORITY_LOWEST, RADIO_TIMING_DISTANCE, radio_notification_handler);
+}
+
+bool radio_timing_idle(void) {
+  return m_idle;
+}
+
+void radio_timing_anchor_update(radio_timing_anchor_t *p_anchor) {
+  p_anchor->ticks = m_active_ticks;
+  p_anchor->valid = true;
+}
+
+bool radio_timing_anchor_match(const radio_timing_anchor_t *p_anchor, uint32_t interval_us) {
+  if (!p_anchor->valid || interval_us == 0) {
+    return false;
+  }
+  uint32_t ticks = 0;
+  app_timer_cnt_diff_compute(m_active_ticks, p_anchor->ticks, &ticks);
+  // an interval isn't a whole number of ticks, compare in microseconds
+  uint64_t elapsed_us = (uint64_t)ticks * (APP_TIMER_PRESCALER + 1) * 1000000 / APP_TIMER_CLOCK_FREQ;
+  uint32_t phase_us = (uint32_t)(elapsed_us % interval_us);
+  return phase_us <= ANCHOR_TOLERANCE_US || interval_us - phase_us <= ANCHOR_TOLERANCE_US;
+}
+
+#endif // RADIO_TIMING_ENABLED
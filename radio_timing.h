@@ -0,0 +1,77 @@
+/*
+  radio_timing.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Radio notification: a callback just ahead of every radio event, and a flag for
+// the quiet time after one. Requests queued from the callback go out in the
+// coming connection event instead of waiting in the softdevice for up to an
+// interval, and the display is flushed while the radio is idle.
+//
+// The notification covers all radio activity (every link, scanning, advertising),
+// with more than one link the next event isn't necessarily the polled link's.
+
+#ifndef __RADIO_TIMING_H
+#define __RADIO_TIMING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_config.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+// Runs RADIO_TIMING_DISTANCE ahead of the radio, at the app_timer interrupt priority.
+typedef void (*radio_timing_prepare_handler_t)(void);
+
+// Where a link's connection events fall. The notification runs ahead of every radio
+// event (all links, scanning, advertising), the anchor tells the link's own apart.
+typedef struct {
+  bool valid;
+  uint32_t ticks;                    // app_timer counter at the notification of one of its events
+} radio_timing_anchor_t;
+
+#if RADIO_TIMING_ENABLED
+
+// Needs the softdevice enabled.
+uint32_t radio_timing_init(radio_timing_prepare_handler_t prepare_handler);
+
+// True between the end of a radio event and the notification for the next one.
+bool radio_timing_idle(void);
+
+// Call on a BLE event of the link, it came out of the radio event last notified.
+void radio_timing_anchor_update(radio_timing_anchor_t *p_anchor);
+
+// From the prepare handler, true when the coming radio event is on the anchor's
+// connection interval grid.
+bool radio_timing_anchor_match(const radio_timing_anchor_t *p_anchor, uint32_t interval_us);
+
+#else
+
+#define radio_timing_init(prepare_handler) NRF_SUCCESS
+#define radio_timing_idle() true
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __RADIO_TIMING_H */
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+# -*- mode: python; coding: utf-8 -*-
+#
+# Decode the telemetry beacon (see telemetry_beacon.h) from manufacturer data.
+#
+# Takes one hex string per line, the manufacturer data including the 2 byte company id,
+# as printed by most scanners (eg. `btmon`, nRF Connect):
+#   ./decode_beacon.py < adverts.txt
+#   echo ffff0107117b0050d2040040e20100 | ./decode_beacon.py
+
+import sys
+from struct import calcsize, unpack
+
+COMPANY_ID = 0xFFFF
+VERSION = 1
+FRAME = '<HBBBhBHBI'  # company id, then telemetry_beacon_frame_t
+NO_LINK = 0x0F
+
+
+def decode(data):
+    if len(data) < calcsize(FRAME):
+        return None
+    company, version, sequence, links, speed, battery, range_, error, odometer = unpack(FRAME, data[:calcsize(FRAME)])
+    if company != COMPANY_ID or version != VERSION:
+        return None
+    return {
+        'sequence': sequence,
+        'link': None if (links & 0x0f) == NO_LINK else links & 0x0f,
+        'connected': links >> 4,
+        'speed_kph': speed / 10.0,
+        'battery': battery,
+        'range_km': range_ / 100.0,
+        'error': error,
+        'odometer_km': odometer / 1000.0,
+    }
+
+
+def main():
+    last_sequence = None
+    for line in sys.stdin:
+        line = line.strip().replace(' ', '').replace(':', '')
+        if not line:
+            continue
+        frame = decode(bytes.fromhex(line))
+        if frame is None:
+            print('not a v%d telemetry frame: %s' % (VERSION, line))
+            continue
+        # the same frame repeats every advertising interval, only print changes
+        if frame['sequence'] == last_sequence:
+            continue
+        last_sequence = frame['sequence']
+        if frame['link'] is None:
+            print('#%3d  no scooter' % frame['sequence'])
+        else:
+            print('#%3d  link %d/%d  %5.1f km/h  %3d%%  %6.2f km left  error %2d  odo %9.3f km' % (
+                frame['sequence'], frame['link'], frame['connected'], frame['speed_kph'], frame['battery'],
+                frame['range_km'], frame['error'], frame['odometer_km']))
+
+
+if __name__ == '__main__':
+    main()
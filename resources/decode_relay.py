@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+# -*- mode: python; coding: utf-8 -*-
+#
+# Decode telemetry relay notifications (see telemetry_relay.h) into samples.
+#
+# Takes one hex string per line, the notification value as logged by the phone
+# (eg. nRF Connect's log export):
+#   ./decode_relay.py < notifications.txt
+
+import sys
+
+VERSION = 1
+KEYFRAME = 0x80
+FIELDS = ['speed', 'battery', 'range', 'error', 'odometer']
+SCALES = [10.0, 1.0, 100.0, 1.0, 1000.0]  # to km/h, %, km, code, km
+
+
+def varint(data, index):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[index]
+        index += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if byte < 0x80:
+            return value, index
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+class Decoder(object):
+    def __init__(self):
+        self.sequence = None
+        self.links = {}  # link -> [time_ms, fields]
+
+    def notification(self, data):
+        if len(data) < 2 or data[0] != VERSION:
+            raise ValueError('not a v%d notification' % VERSION)
+        sequence = data[1]
+        if self.sequence is not None and sequence != (self.sequence + 1) & 0xff:
+            # notifications were dropped, deltas are useless until each link's next keyframe
+            print('-- %d notification(s) lost' % ((sequence - self.sequence - 1) & 0xff))
+            self.links = {}
+        self.sequence = sequence
+
+        index = 2
+        while index < len(data):
+            header = data[index]
+            index += 1
+            link = (header >> 5) & 0x03
+            time, index = varint(data, index)
+            values = []
+            for field in range(len(FIELDS)):
+                if header & (1 << field):
+                    value, index = varint(data, index)
+                    values.append(unzigzag(value))
+                else:
+                    values.append(0)
+
+            if header & KEYFRAME:
+                state = [time, values]
+            elif link in self.links:
+                previous = self.links[link]
+                state = [previous[0] + time, [a + b for a, b in zip(previous[1], values)]]
+            else:
+                continue  # waiting for a keyframe
+            self.links[link] = state
+            yield link, state[0], [value / scale for value, scale in zip(state[1], SCALES)], bool(header & KEYFRAME)
+
+
+def main():
+    decoder = Decoder()
+    for line in sys.stdin:
+        line = line.strip().replace(' ', '').replace(':', '').replace('-', '')
+        if not line:
+            continue
+        try:
+            for link, time, values, keyframe in decoder.notification(bytearray.fromhex(line)):
+                speed, battery, range_, error, odometer = values
+                print('%10.3f  %d%s  %5.1f km/h  %3d%%  %6.2f km left  error %2d  odo %9.3f km' % (
+                    time / 1000.0, link, '*' if keyframe else ' ', speed, battery, range_, error, odometer))
+        except (ValueError, IndexError) as e:
+            print('bad notification %s: %s' % (line, e))
+
+
+if __name__ == '__main__':
+    main()
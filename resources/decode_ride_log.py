@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+# -*- mode: python; coding: utf-8 -*-
+#
+# Decode a ride log export (see ride_log.h and telemetry_relay.h) into samples.
+#
+# Takes the log characteristic's notifications, one hex string per line, as
+# logged by the phone (eg. nRF Connect's log export):
+#   ./decode_ride_log.py < notifications.txt
+# or the raw block stream with --raw:
+#   ./decode_ride_log.py --raw < export.bin
+
+import struct
+import sys
+
+VERSION = 1
+HEADER = struct.Struct('<BBHIIHH')  # version, reserved, boot, sequence, time_ms, length, dropped
+TIME_UNIT_MS = 10
+NOTIFY_END = 0
+NOTIFY_DATA = 1
+FIELDS = ['speed', 'battery', 'current', 'voltage', 'battery_temp', 'frame_temp']
+SCALES = [10.0, 1.0, 10.0, 10.0, 1.0, 1.0]  # to km/h, %, A, V, C, C
+
+
+def varint(data, index):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[index]
+        index += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if byte < 0x80:
+            return value, index
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def blocks(stream):
+    index = 0
+    while index + HEADER.size <= len(stream):
+        version, _, boot, sequence, time_ms, length, dropped = HEADER.unpack_from(stream, index)
+        if version != VERSION:
+            raise ValueError('not a v%d block at byte %d' % (VERSION, index))
+        start = index + HEADER.size
+        yield boot, sequence, time_ms, dropped, stream[start:start + length]
+        index = start + length
+
+
+def samples(block_time_ms, data):
+    links = {}  # link -> [time_ms, fields], every block starts over
+    index = 0
+    while index < len(data):
+        header = data[index]
+        index += 1
+        link = header >> 6
+        time, index = varint(data, index)
+        values = []
+        for field in range(len(FIELDS)):
+            if header & (1 << field):
+                value, index = varint(data, index)
+                values.append(unzigzag(value))
+            else:
+                values.append(0)
+
+        if link in links:
+            previous = links[link]
+            state = [previous[0] + time * TIME_UNIT_MS, [a + b for a, b in zip(previous[1], values)]]
+        else:
+            state = [block_time_ms + time * TIME_UNIT_MS, values]
+        links[link] = state
+        yield link, state[0], [value / scale for value, scale in zip(state[1], SCALES)]
+
+
+def notifications(lines):
+    stream = bytearray()
+    for line in lines:
+        line = line.strip().replace(' ', '').replace(':', '').replace('-', '')
+        if not line:
+            continue
+        data = bytearray.fromhex(line)
+        if data[0] == NOTIFY_END:
+            break
+        if data[0] == NOTIFY_DATA:
+            stream += data[1:]
+    return stream
+
+
+def main():
+    if '--raw' in sys.argv[1:]:
+        stream = bytearray(sys.stdin.buffer.read())
+    else:
+        stream = notifications(sys.stdin)
+
+    for boot, sequence, time_ms, dropped, data in blocks(stream):
+        print('-- block %d, boot %d, %d bytes%s' % (sequence, boot, len(data),
+                                                   ', %d samples dropped before' % dropped if dropped else ''))
+        for link, time, values in samples(time_ms, data):
+            speed, battery, current, voltage, battery_temp, frame_temp = values
+            print('%10.2f  %d  %5.1f km/h  %3d%%  %6.1f A  %5.1f V  %3d C  %3d C' % (
+                time / 1000.0, link, speed, battery, current, voltage, battery_temp, frame_temp))
+
+
+if __name__ == '__main__':
+    main()
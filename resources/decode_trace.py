@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+# -*- mode: python; coding: utf-8 -*-
+#
+# Decode the binary ninebot protocol trace (see protocol_trace.h) into a timeline.
+#
+# Capture:
+#   JLinkRTTLogger -Device NRF52832_XXAA -If SWD -Speed 4000 -RTTChannel 1 trace.bin
+# Decode:
+#   ./decode_trace.py trace.bin
+
+import sys
+from struct import unpack
+
+SYNC = 0xA5
+RECORD_LEN = 8
+TICKS_PER_SECOND = 32768.0
+COUNTER_WRAP = 1 << 24
+
+DIRECTIONS = {0: 'TX', 1: 'RX', 2: 'DROP'}
+RX_STATUS = {0: 'ok', 1: 'partial', 2: 'malformed', 3: 'checksum'}
+TX_STATUS = {0: 'sent', 1: 'failed'}
+
+REGISTERS = {
+    0x10: 'serial', 0x17: 'pin', 0x1a: 'firmver', 0x25: 'kmremain',
+    0x3b: 'triptime', 0x3e: 'frametemp', 0xb0: 'error', 0xb4: 'batt',
+    0xb5: 'speed', 0xb6: 'tripspeed', 0xb7: 'totalkm', 0xb9: 'tripkm',
+    0xbb: 'frametemp2',
+}
+
+
+def records(data):
+    index = 0
+    while index + RECORD_LEN <= len(data):
+        if data[index] != SYNC:
+            # lost alignment, scan forward for the next sync byte
+            index += 1
+            continue
+        _, direction, reg, length, status, t0, t1, t2 = unpack('<BBBBBBBB', data[index:index + RECORD_LEN])
+        # high nibble is the scooter link index
+        yield direction & 0x0f, direction >> 4, reg, length, status, t0 | (t1 << 8) | (t2 << 16)
+        index += RECORD_LEN
+
+
+def main(path):
+    with open(path, 'rb') as f:
+        data = bytearray(f.read())
+
+    elapsed = 0
+    last_ticks = None
+    pending = {}
+    for direction, link, reg, length, status, ticks in records(data):
+        if last_ticks is not None:
+            elapsed += (ticks - last_ticks) % COUNTER_WRAP
+        last_ticks = ticks
+        ms = elapsed * 1000.0 / TICKS_PER_SECOND
+
+        name = REGISTERS.get(reg, '0x%02x' % reg)
+        kind = DIRECTIONS.get(direction, '?')
+        if direction == 0:
+            pending[(link, reg)] = ms
+            detail = TX_STATUS.get(status, status)
+        elif direction == 1:
+            detail = RX_STATUS.get(status, status)
+            if status == 0 and (link, reg) in pending:
+                detail += '  rtt %.1f ms' % (ms - pending.pop((link, reg)))
+        else:
+            print('%10.1f  %-4s  %d records lost' % (ms, kind, length))
+            continue
+        print('%10.1f  %d  %-4s  %-10s  %3d bytes  %s' % (ms, link, kind, name, length, detail))
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 2:
+        print('usage: %s trace.bin' % sys.argv[0])
+        sys.exit(1)
+    main(sys.argv[1])
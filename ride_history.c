@@ -0,0 +1,69 @@
+/*
+  ride_history.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nordic_common.h"
+
+#include "ninebot_module.h"
+#include "ride_history.h"
+
+#include "sdk_config.h"
+
+#if RIDE_HISTORY_ENABLED
+
+// vars
+static time_series_t m_series[NINEBOT_MAX_LINKS][ride_history_value_count];
+
+// Ride history
+
+void ride_history_init(void) {
+  for (uint8_t link = 0; link < NINEBOT_MAX_LINKS; link++) {
+    for (uint8_t value = 0; value < ride_history_value_count; value++) {
+      time_series_init(&m_series[link][value]);
+    }
+  }
+}
+
+void ride_history_speed_update(uint8_t link, int16_t speed, uint32_t time_ms) {
+  if (link < NINEBOT_MAX_LINKS) {
+    // m/h to 0.1 km/h
+    time_series_add(&m_series[link][ride_history_speed], speed / 100, time_ms);
+  }
+}
+
+void ride_history_power_update(uint8_t link, uint16_t voltage, int16_t current, uint32_t time_ms) {
+  if (link < NINEBOT_MAX_LINKS) {
+    // 10 mV x 10 mA to W
+    time_series_add(&m_series[link][ride_history_power], (int16_t)((int32_t)voltage * current / 10000), time_ms);
+  }
+}
+
+const time_series_t *ride_history_get(uint8_t link, ride_history_value_t value) {
+  if (link >= NINEBOT_MAX_LINKS || value >= ride_history_value_count) {
+    return NULL;
+  }
+  return &m_series[link][value];
+}
+
+#endif // RIDE_HISTORY_ENABLED
@@ -0,0 +1,66 @@
+/*
+  ride_history.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Speed and power history of every scooter link for the graph page, kept in
+// time_series stores (~1.2 KB each) fed from the decoded frames.
+
+#ifndef __RIDE_HISTORY_H
+#define __RIDE_HISTORY_H
+
+#include <stdint.h>
+#include "sdk_config.h"
+#include "time_series.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+typedef enum {
+  ride_history_speed = 0,              // 0.1 km/h
+  ride_history_power,                  // W, negative into the battery
+  ride_history_value_count
+} ride_history_value_t;
+
+#if RIDE_HISTORY_ENABLED
+
+void ride_history_init(void);
+
+// decoded frames, same units as ride_stats.h
+void ride_history_speed_update(uint8_t link, int16_t speed, uint32_t time_ms);
+void ride_history_power_update(uint8_t link, uint16_t voltage, int16_t current, uint32_t time_ms);
+
+// NULL for an unknown link
+const time_series_t *ride_history_get(uint8_t link, ride_history_value_t value);
+
+#else
+
+#define ride_history_init()
+#define ride_history_speed_update(link, speed, time_ms)
+#define ride_history_power_update(link, voltage, current, time_ms)
+#define ride_history_get(link, value) NULL
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __RIDE_HISTORY_H */
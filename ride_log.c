@@ -0,0 +1,511 @@
+/*
+  ride_log.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_util.h"
+#include "fds.h"
+
+#include "ms_clock.h"
+#include "varint.h"
+#include "ride_log.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "RLG"
+#if RIDE_LOG_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       RIDE_LOG_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#if RIDE_LOG_ENABLED
+
+#define BLOCK_BYTES             (RIDE_LOG_BLOCK_WORDS * sizeof(uint32_t))
+#define BLOCK_HEADER_LENGTH     sizeof(ride_log_block_header_t)
+#define SAMPLE_MAX_LENGTH       (1 + VARINT_MAX_LENGTH * (1 + ride_log_field_count))
+#define SAMPLE_LINK_SHIFT       6
+#define TIME_UNIT_MS            10
+#define RECLAIM_BLOCKS          4                               /**< Deleted when flash is full, a virtual page worth. */
+#define KEY_RANGE               0xBFFF                          /**< fds record keys are 0x0001 .. 0xBFFF. */
+
+STATIC_ASSERT(NINEBOT_MAX_LINKS <= 4);                          // 2 bit link index
+STATIC_ASSERT(ride_log_field_count <= 6);                       // 6 bit field mask
+STATIC_ASSERT(sizeof(ride_log_block_header_t) % sizeof(uint32_t) == 0);
+
+typedef enum {
+  write_idle = 0,
+  write_waiting,                   // sealed, fds not ready or its queue was full
+  write_pending,                   // queued in fds
+  write_reclaiming,                // flash full, deleting the oldest blocks
+  write_collecting,                // garbage collection before the next attempt
+} write_state_t;
+
+typedef struct {
+  bool connected;
+  bool sample_due;                 // log the next update whatever the interval
+  bool keyframe_due;               // the link's first sample in the block is absolute
+  uint32_t time_ms;                // of the previous logged sample
+  int32_t fields[ride_log_field_count];
+} ride_log_link_t;
+
+// vars
+static uint32_t m_blocks[2][RIDE_LOG_BLOCK_WORDS];              // one filling, the other written to flash
+static uint8_t m_fill;                                          // index of the filling block
+static uint16_t m_fill_length;                                  // bytes with the header, 0 before the first sample
+static write_state_t m_write_state;
+static bool m_collected;                                        // gc already ran for the block being written
+static uint8_t m_reclaim_left;
+static bool m_erasing;
+static fds_record_desc_t m_write_desc;
+static ride_log_link_t m_links[NINEBOT_MAX_LINKS];
+static bool m_ready;
+static uint16_t m_boot;
+static uint32_t m_next_sequence;
+static uint16_t m_dropped;                                      // samples lost since the filling block started
+
+// internal
+
+static ride_log_block_header_t *block_header(uint8_t index) {
+  return (ride_log_block_header_t *)m_blocks[index];
+}
+
+static uint16_t key_for(uint32_t sequence) {
+  return (uint16_t)(1 + (sequence % KEY_RANGE));
+}
+
+static int32_t scaled(double value, double scale) {
+  value *= scale;
+  return (int32_t)(value < 0.0 ? value - 0.5 : value + 0.5);
+}
+
+// Header of a stored block, NULL when it isn't one of ours.
+static const ride_log_block_header_t *record_header(const fds_flash_record_t *p_record) {
+  const ride_log_block_header_t *p_header = (const ride_log_block_header_t *)p_record->p_data;
+  uint32_t length = p_record->p_header->tl.length_words * sizeof(uint32_t);
+  if (length < BLOCK_HEADER_LENGTH || p_header->version != RIDE_LOG_VERSION ||
+      BLOCK_HEADER_LENGTH + p_header->length > length) {
+    return NULL;
+  }
+  return p_header;
+}
+
+// Picks up the sequence and boot count where the stored blocks left off.
+static void blocks_scan(void) {
+  fds_record_desc_t desc;
+  fds_find_token_t token;
+  fds_flash_record_t record;
+  uint32_t count = 0;
+  bool found = false;
+  uint32_t last_sequence = 0;
+  uint16_t last_boot = 0;
+
+  memset(&token, 0, sizeof(token));
+  while (fds_record_find_in_file(RIDE_LOG_FILE_ID, &desc, &token) == FDS_SUCCESS) {
+    if (fds_record_open(&desc, &record) != FDS_SUCCESS) {
+      continue;
+    }
+    const ride_log_block_header_t *p_header = record_header(&record);
+    if (p_header) {
+      if (!found || p_header->sequence > last_sequence) {
+        last_sequence = p_header->sequence;
+      }
+      if (!found || p_header->boot > last_boot) {
+        last_boot = p_header->boot;
+      }
+      found = true;
+      count++;
+    }
+    UNUSED_RETURN_VALUE(fds_record_close(&desc));
+  }
+
+  m_next_sequence = found ? last_sequence + 1 : 0;
+  m_boot = found ? last_boot + 1 : 0;
+  NRF_LOG_INFO("%d blocks stored, boot %d\r\n", count, m_boot);
+}
+
+// Stored blocks from an older encoding count as the oldest.
+static bool oldest_find(fds_record_desc_t *desc_out) {
+  fds_record_desc_t desc;
+  fds_find_token_t token;
+  fds_flash_record_t record;
+  bool found = false;
+  uint32_t oldest = 0;
+
+  memset(&token, 0, sizeof(token));
+  while (fds_record_find_in_file(RIDE_LOG_FILE_ID, &desc, &token) == FDS_SUCCESS) {
+    if (fds_record_open(&desc, &record) != FDS_SUCCESS) {
+      continue;
+    }
+    const ride_log_block_header_t *p_header = record_header(&record);
+    UNUSED_RETURN_VALUE(fds_record_close(&desc));
+    if (!p_header) {
+      *desc_out = desc;
+      return true;
+    }
+    if (!found || p_header->sequence < oldest) {
+      oldest = p_header->sequence;
+      *desc_out = desc;
+      found = true;
+    }
+  }
+  return found;
+}
+
+static void block_write(void);
+
+static void garbage_collect(void) {
+  ret_code_t ret = fds_gc();
+  m_collected = true;
+  if (ret == FDS_SUCCESS) {
+    m_write_state = write_collecting;
+  } else {
+    // Queue full, the next fds event retries the write.
+    m_write_state = write_waiting;
+  }
+}
+
+static void reclaim_next(void) {
+  fds_record_desc_t desc;
+
+  if (m_reclaim_left > 0 && oldest_find(&desc)) {
+    if (fds_record_delete(&desc) == FDS_SUCCESS) {
+      m_reclaim_left--;
+      m_write_state = write_reclaiming;
+      return;
+    }
+  }
+  // Deleted records only free their space once collected.
+  garbage_collect();
+}
+
+static void block_write(void) {
+  ret_code_t ret;
+  fds_record_chunk_t chunk;
+  fds_record_t record;
+  uint8_t index = m_fill ^ 1;
+  const ride_log_block_header_t *p_header = block_header(index);
+
+  chunk.p_data = m_blocks[index];
+  chunk.length_words = CEIL_DIV(BLOCK_HEADER_LENGTH + p_header->length, sizeof(uint32_t));
+  record.file_id = RIDE_LOG_FILE_ID;
+  record.key = key_for(p_header->sequence);
+  record.data.p_chunks = &chunk;
+  record.data.num_chunks = 1;
+
+  // Set first, in case the event comes back before the call does.
+  m_write_state = write_pending;
+  ret = fds_record_write(&m_write_desc, &record);
+  if (ret == FDS_SUCCESS) {
+    return;
+  }
+  if (ret == FDS_ERR_NO_SPACE_IN_FLASH && !m_collected) {
+    m_reclaim_left = RECLAIM_BLOCKS;
+    reclaim_next();
+  } else if (ret == FDS_ERR_NO_SPACE_IN_QUEUES || ret == FDS_ERR_BUSY) {
+    m_write_state = write_waiting;
+  } else {
+    NRF_LOG_WARNING("Block %d lost: %d\r\n", p_header->sequence, ret);
+    m_write_state = write_idle;
+  }
+}
+
+// Hands the filling block to flash, false while the previous one is still on its way.
+static bool block_seal(void) {
+  ride_log_block_header_t *p_header = block_header(m_fill);
+
+  if (m_write_state != write_idle) {
+    return false;
+  }
+  p_header->length = m_fill_length - BLOCK_HEADER_LENGTH;
+  p_header->sequence = m_next_sequence++;
+  m_fill ^= 1;
+  m_fill_length = 0;
+  m_collected = false;
+  if (m_ready) {
+    block_write();
+  } else {
+    m_write_state = write_waiting;
+  }
+  return true;
+}
+
+static void block_start(uint32_t now_ms) {
+  ride_log_block_header_t *p_header = block_header(m_fill);
+
+  memset(p_header, 0, BLOCK_HEADER_LENGTH);
+  p_header->version = RIDE_LOG_VERSION;
+  p_header->boot = m_boot;
+  p_header->time_ms = now_ms;
+  p_header->dropped = m_dropped;
+  m_dropped = 0;
+  m_fill_length = BLOCK_HEADER_LENGTH;
+  for (uint8_t link = 0; link < NINEBOT_MAX_LINKS; link++) {
+    m_links[link].keyframe_due = true;
+  }
+}
+
+// What the sample's time counts from.
+static uint32_t sample_base_ms(uint8_t link) {
+  return m_links[link].keyframe_due ? block_header(m_fill)->time_ms : m_links[link].time_ms;
+}
+
+static uint8_t sample_encode(uint8_t link, const int32_t *fields, uint32_t now_ms, uint8_t *p_out) {
+  ride_log_link_t *p_link = &m_links[link];
+  uint8_t header = (uint8_t)(link << SAMPLE_LINK_SHIFT);
+  uint8_t length = 1;
+
+  length += varint_encode((now_ms - sample_base_ms(link)) / TIME_UNIT_MS, &p_out[length]);
+  for (uint8_t field = 0; field < ride_log_field_count; field++) {
+    int32_t value = p_link->keyframe_due ? fields[field] : fields[field] - p_link->fields[field];
+    if (p_link->keyframe_due || value != 0) {
+      header |= (1 << field);
+      length += varint_encode(zigzag(value), &p_out[length]);
+    }
+  }
+  p_out[0] = header;
+  return length;
+}
+
+static void sample_append(uint8_t link, const int32_t *fields, uint32_t now_ms) {
+  ride_log_link_t *p_link = &m_links[link];
+  uint8_t sample[SAMPLE_MAX_LENGTH];
+  uint8_t length;
+  uint32_t base_ms;
+
+  if (m_fill_length == 0) {
+    block_start(now_ms);
+  }
+  length = sample_encode(link, fields, now_ms, sample);
+  if (m_fill_length + length > BLOCK_BYTES) {
+    if (!block_seal()) {
+      m_dropped++;
+      return;
+    }
+    block_start(now_ms);
+    length = sample_encode(link, fields, now_ms, sample);
+  }
+
+  memcpy((uint8_t *)m_blocks[m_fill] + m_fill_length, sample, length);
+  m_fill_length += length;
+  // Kept on the encoded time, so the truncation never accumulates.
+  base_ms = sample_base_ms(link);
+  p_link->time_ms = base_ms + ((now_ms - base_ms) / TIME_UNIT_MS) * TIME_UNIT_MS;
+  p_link->keyframe_due = false;
+  p_link->sample_due = false;
+  memcpy(p_link->fields, fields, sizeof(p_link->fields));
+}
+
+static bool links_connected(void) {
+  for (uint8_t link = 0; link < NINEBOT_MAX_LINKS; link++) {
+    if (m_links[link].connected) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void fds_evt_handler(fds_evt_t const *const p_evt) {
+  switch (p_evt->id) {
+  case FDS_EVT_INIT:
+    if (p_evt->result == FDS_SUCCESS && !m_ready) {
+      blocks_scan();
+      m_ready = true;
+    }
+    break;
+
+  case FDS_EVT_WRITE:
+    if (p_evt->write.file_id == RIDE_LOG_FILE_ID && m_write_state == write_pending) {
+      if (p_evt->result == FDS_SUCCESS) {
+        NRF_LOG_DEBUG("Block written.\r\n");
+      } else {
+        NRF_LOG_WARNING("Block write failed: %d\r\n", p_evt->result);
+      }
+      m_write_state = write_idle;
+    }
+    break;
+
+  case FDS_EVT_DEL_RECORD:
+    if (p_evt->del.file_id == RIDE_LOG_FILE_ID && m_write_state == write_reclaiming) {
+      reclaim_next();
+    }
+    break;
+
+  case FDS_EVT_DEL_FILE:
+    if (p_evt->del.file_id == RIDE_LOG_FILE_ID && m_erasing) {
+      m_erasing = false;
+      UNUSED_RETURN_VALUE(fds_gc());
+      NRF_LOG_INFO("Erased.\r\n");
+    }
+    break;
+
+  case FDS_EVT_GC:
+    if (m_write_state == write_collecting) {
+      block_write();
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  // Whatever finished made room in the fds queue.
+  if (m_write_state == write_waiting && m_ready) {
+    block_write();
+  }
+}
+
+// Ride log
+
+uint32_t ride_log_init(void) {
+  uint32_t error_code;
+
+  memset(m_links, 0, sizeof(m_links));
+  m_fill = 0;
+  m_fill_length = 0;
+  m_write_state = write_idle;
+  m_dropped = 0;
+  m_ready = false;
+
+  error_code = fds_register(fds_evt_handler);
+
+  NRF_LOG_DEBUG("ride_log_init finished.\r\n");
+  return error_code;
+}
+
+void ride_log_sample(uint8_t link, const ninebot_data_t *data) {
+  ride_log_link_t *p_link;
+  int32_t fields[ride_log_field_count];
+  uint32_t now_ms;
+  bool changed = false;
+
+  if (link >= NINEBOT_MAX_LINKS || !data) {
+    return;
+  }
+  p_link = &m_links[link];
+
+  if (!data->connected) {
+    if (p_link->connected) {
+      p_link->connected = false;
+      // Ride over, get it into flash.
+      if (!links_connected()) {
+        ride_log_flush();
+      }
+    }
+    return;
+  }
+  if (!p_link->connected) {
+    p_link->connected = true;
+    p_link->sample_due = true;
+  }
+
+  now_ms = ms_clock_now();
+  if (!p_link->sample_due && now_ms - p_link->time_ms < RIDE_LOG_INTERVAL_MS) {
+    return;
+  }
+
+  fields[ride_log_field_speed] = scaled(data->speed_kph, 10.0);
+  fields[ride_log_field_battery] = scaled(data->battery_percentage, 100.0);
+  fields[ride_log_field_current] = scaled(data->current_a, 10.0);
+  fields[ride_log_field_voltage] = scaled(data->voltage_v, 10.0);
+  fields[ride_log_field_battery_temp] = scaled(data->battery_temp_c, 1.0);
+  fields[ride_log_field_frame_temp] = scaled(data->frame_temp_c, 1.0);
+
+  for (uint8_t field = 0; field < ride_log_field_count; field++) {
+    changed |= (fields[field] != p_link->fields[field]);
+  }
+  // Parked: nothing changes, a sample now and then shows we were still there.
+  if (!changed && !p_link->sample_due && now_ms - p_link->time_ms < RIDE_LOG_IDLE_MS) {
+    return;
+  }
+  sample_append(link, fields, now_ms);
+}
+
+void ride_log_flush(void) {
+  if (m_fill_length > BLOCK_HEADER_LENGTH && !block_seal()) {
+    NRF_LOG_DEBUG("Flush deferred, flash busy.\r\n");
+  }
+}
+
+uint32_t ride_log_block_open(uint32_t min_sequence, ride_log_cursor_t *cursor_out) {
+  fds_record_desc_t desc;
+  fds_find_token_t token;
+  fds_flash_record_t record;
+  bool found = false;
+  uint32_t best = 0;
+
+  if (!cursor_out) {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+
+  memset(&token, 0, sizeof(token));
+  while (fds_record_find_in_file(RIDE_LOG_FILE_ID, &desc, &token) == FDS_SUCCESS) {
+    if (fds_record_open(&desc, &record) != FDS_SUCCESS) {
+      continue;
+    }
+    const ride_log_block_header_t *p_header = record_header(&record);
+    if (p_header && p_header->sequence >= min_sequence && (!found || p_header->sequence < best)) {
+      best = p_header->sequence;
+      cursor_out->desc = desc;
+      found = true;
+    }
+    UNUSED_RETURN_VALUE(fds_record_close(&desc));
+  }
+  if (!found) {
+    return NRF_ERROR_NOT_FOUND;
+  }
+
+  // Stays open, so garbage collection leaves it where it is until closed.
+  if (fds_record_open(&cursor_out->desc, &record) != FDS_SUCCESS) {
+    return NRF_ERROR_NOT_FOUND;
+  }
+  cursor_out->p_data = (const uint8_t *)record.p_data;
+  cursor_out->length = BLOCK_HEADER_LENGTH + ((const ride_log_block_header_t *)record.p_data)->length;
+  cursor_out->sequence = best;
+  return NRF_SUCCESS;
+}
+
+void ride_log_block_close(ride_log_cursor_t *cursor) {
+  if (cursor) {
+    UNUSED_RETURN_VALUE(fds_record_close(&cursor->desc));
+    cursor->p_data = NULL;
+  }
+}
+
+uint32_t ride_log_erase(void) {
+  ret_code_t ret;
+
+  if (m_write_state != write_idle || m_erasing) {
+    return NRF_ERROR_BUSY;
+  }
+  ret = fds_file_delete(RIDE_LOG_FILE_ID);
+  if (ret == FDS_SUCCESS) {
+    m_erasing = true;
+  }
+  return ret;
+}
+
+#endif // RIDE_LOG_ENABLED
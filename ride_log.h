@@ -0,0 +1,115 @@
+/*
+  ride_log.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Ride log in internal flash. Samples are delta and varint encoded into blocks
+// of RIDE_LOG_BLOCK_WORDS, each block one fds record, so four blocks fill a
+// virtual page. When flash runs out the oldest blocks are deleted and fds
+// garbage collection rotates the pages (its swap page moves with every run,
+// which spreads the erases). Export over BLE is in telemetry_relay.c, decode
+// with resources/decode_ride_log.py.
+//
+// Block:
+//   ride_log_block_header_t, then samples until header.length
+// Sample:
+//   header   bits 7..6 link, bits 5..0 which fields follow
+//   time     varint, 10 ms units, since the block's time_ms for the link's first
+//            sample in the block, else since the link's previous sample
+//   fields   zigzag varint each, in ride_log_field_t order, absolute for the link's
+//            first sample in the block (every field present), else the change
+// Samples are taken every RIDE_LOG_INTERVAL_MS while a scooter is connected,
+// a sample without changes is skipped unless RIDE_LOG_IDLE_MS have passed.
+
+#ifndef __RIDE_LOG_H
+#define __RIDE_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fds.h"
+#include "sdk_config.h"
+#include "ninebot_module.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+#define RIDE_LOG_VERSION      1        /**< Bump when the block or sample encoding changes. */
+#define RIDE_LOG_FILE_ID      0x5244   /**< fds file of the blocks, record keys follow the block sequence. */
+#define RIDE_LOG_BLOCK_WORDS  252      /**< 4 * (3 word record header + 252) + 2 word page tag fills a 1024 word page. */
+
+typedef struct __attribute__((packed)) {
+  uint8_t  version;                // RIDE_LOG_VERSION
+  uint8_t  reserved;
+  uint16_t boot;                   // power cycles, times only compare within one
+  uint32_t sequence;               // block number, counts up forever
+  uint32_t time_ms;                // ms since boot at the start of the block
+  uint16_t length;                 // sample bytes after the header
+  uint16_t dropped;                // samples lost before this block, flash was busy
+} ride_log_block_header_t;
+
+typedef enum {
+  ride_log_field_speed = 0,        // 0.1 km/h
+  ride_log_field_battery,          // percent
+  ride_log_field_current,          // 0.1 A
+  ride_log_field_voltage,          // 0.1 V
+  ride_log_field_battery_temp,     // C
+  ride_log_field_frame_temp,       // C
+  ride_log_field_count
+} ride_log_field_t;
+
+// An open block in flash, see ride_log_block_open.
+typedef struct {
+  fds_record_desc_t desc;
+  const uint8_t *p_data;           // header and samples
+  uint16_t length;                 // bytes
+  uint32_t sequence;
+} ride_log_cursor_t;
+
+#if RIDE_LOG_ENABLED
+
+// Registers with fds, the caller runs fds_init once every fds user has registered.
+uint32_t ride_log_init(void);
+
+// Feed every data update, rate limited to RIDE_LOG_INTERVAL_MS per link.
+void ride_log_sample(uint8_t link, const ninebot_data_t *data);
+
+// Writes the partly filled block, done by itself when the last scooter disconnects.
+void ride_log_flush(void);
+
+// readers, oldest first: open the first stored block with a sequence of at least
+// min_sequence, NRF_ERROR_NOT_FOUND past the newest. Close before opening the next.
+uint32_t ride_log_block_open(uint32_t min_sequence, ride_log_cursor_t *cursor_out);
+void ride_log_block_close(ride_log_cursor_t *cursor);
+
+uint32_t ride_log_erase(void);
+
+#else
+
+#define ride_log_init() NRF_SUCCESS
+#define ride_log_sample(link, data)
+#define ride_log_flush()
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __RIDE_LOG_H */
@@ -0,0 +1,212 @@
+/*
+  ride_stats.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_util_platform.h"
+
+#include "ride_stats.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "RST"
+#if RIDE_STATS_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       RIDE_STATS_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#if RIDE_STATS_ENABLED
+
+#define MOVING_SPEED       1000                 /**< m/h, slower than this is standing or pushing. */
+#define MAX_GAP_MS         3000                 /**< Frames further apart aren't integrated across, the link stalled. */
+#define DISTANCE_PER_M     3600000ULL           /**< Distance accumulator, m/h x ms. */
+#define ENERGY_PER_MWH     36000000LL           /**< Energy accumulator, 10 mV x 10 mA x ms = 0.1 uJ. */
+
+typedef struct {
+  // trip
+  uint64_t distance;                   // m/h x ms, while moving
+  int64_t  energy;                     // 0.1 uJ, drawn
+  int64_t  regen;                      // 0.1 uJ, put back while moving
+  uint32_t moving_ms;
+  uint16_t max_speed;                  // m/h
+  bool     started;
+  // previous frames
+  uint16_t speed;                      // m/h
+  uint32_t speed_ms;
+  bool     have_speed;
+  int32_t  power;                      // 10 mV x 10 mA
+  uint32_t power_ms;
+  bool     have_power;
+  uint32_t down_ms;                    // link lost, for the trip gap
+} ride_stats_link_t;
+
+// vars
+static ride_stats_link_t m_links[NINEBOT_MAX_LINKS];
+
+// internal
+
+// Elapsed time since a previous frame, 0 when it's too old to integrate over.
+static uint32_t interval_ms(bool have_previous, uint32_t previous_ms, uint32_t time_ms) {
+  uint32_t elapsed = time_ms - previous_ms;
+  return (have_previous && elapsed <= MAX_GAP_MS) ? elapsed : 0;
+}
+
+static void stats_compute(const ride_stats_link_t *p_link, ride_stats_t *stats_out) {
+  int64_t net = p_link->energy - p_link->regen;
+
+  stats_out->ride_time_s = p_link->moving_ms / 1000;
+  stats_out->distance_m = (uint32_t)(p_link->distance / DISTANCE_PER_M);
+  stats_out->max_speed = p_link->max_speed / 100;
+  stats_out->avg_speed = p_link->moving_ms ? (uint16_t)(p_link->distance / p_link->moving_ms / 100) : 0;
+  stats_out->energy_mwh = (uint32_t)(p_link->energy / ENERGY_PER_MWH);
+  stats_out->regen_mwh = (uint32_t)(p_link->regen / ENERGY_PER_MWH);
+  stats_out->mwh_per_km = 0;
+  if (stats_out->distance_m >= RIDE_STATS_MIN_DISTANCE_M && net > 0) {
+    stats_out->mwh_per_km = (uint32_t)((net / ENERGY_PER_MWH) * 1000 / stats_out->distance_m);
+  }
+}
+
+static void trip_log(uint8_t link, const ride_stats_link_t *p_link) {
+  ride_stats_t stats;
+
+  stats_compute(p_link, &stats);
+  NRF_LOG_INFO("Trip %d: %d m in %d s, avg %d max %d (0.1 km/h)\r\n", link, stats.distance_m, stats.ride_time_s, stats.avg_speed, stats.max_speed);
+  NRF_LOG_INFO("Trip %d: %d mWh used, %d regen, %d mWh/km\r\n", link, stats.energy_mwh, stats.regen_mwh, stats.mwh_per_km);
+}
+
+// Ride stats
+
+void ride_stats_init(void) {
+  memset(m_links, 0, sizeof(m_links));
+  NRF_LOG_DEBUG("ride_stats_init finished.\r\n");
+}
+
+void ride_stats_link_up(uint8_t link, uint32_t time_ms) {
+  ride_stats_link_t *p_link;
+
+  if (link >= NINEBOT_MAX_LINKS) {
+    return;
+  }
+  p_link = &m_links[link];
+  // A short dropout carries on with the same trip, the scooter was most likely not switched off.
+  if (!p_link->started || time_ms - p_link->down_ms > RIDE_STATS_TRIP_GAP_MS) {
+    ride_stats_reset(link);
+    p_link->started = true;
+    NRF_LOG_DEBUG("Trip %d started.\r\n", link);
+  }
+  p_link->have_speed = false;
+  p_link->have_power = false;
+}
+
+void ride_stats_link_down(uint8_t link, uint32_t time_ms) {
+  if (link >= NINEBOT_MAX_LINKS) {
+    return;
+  }
+  m_links[link].down_ms = time_ms;
+  m_links[link].have_speed = false;
+  m_links[link].have_power = false;
+  trip_log(link, &m_links[link]);
+}
+
+void ride_stats_speed_update(uint8_t link, int16_t speed, uint32_t time_ms) {
+  ride_stats_link_t *p_link;
+  uint16_t magnitude;
+  uint32_t elapsed;
+
+  if (link >= NINEBOT_MAX_LINKS) {
+    return;
+  }
+  p_link = &m_links[link];
+  // Reported negative rolling backwards.
+  magnitude = (uint16_t)(speed < 0 ? -(int32_t)speed : speed);
+  elapsed = interval_ms(p_link->have_speed, p_link->speed_ms, time_ms);
+  if (elapsed && (magnitude >= MOVING_SPEED || p_link->speed >= MOVING_SPEED)) {
+    // trapezoid between the two frames
+    p_link->distance += (uint64_t)(p_link->speed + magnitude) * elapsed / 2;
+    p_link->moving_ms += elapsed;
+  }
+  p_link->max_speed = MAX(p_link->max_speed, magnitude);
+  p_link->speed = magnitude;
+  p_link->speed_ms = time_ms;
+  p_link->have_speed = true;
+}
+
+void ride_stats_power_update(uint8_t link, uint16_t voltage, int16_t current, uint32_t time_ms) {
+  ride_stats_link_t *p_link;
+  int32_t power;
+  int64_t energy;
+  uint32_t elapsed;
+
+  if (link >= NINEBOT_MAX_LINKS) {
+    return;
+  }
+  p_link = &m_links[link];
+  power = (int32_t)voltage * current;
+  elapsed = interval_ms(p_link->have_power, p_link->power_ms, time_ms);
+  if (elapsed) {
+    energy = ((int64_t)p_link->power + power) * elapsed / 2;
+    if (energy >= 0) {
+      p_link->energy += energy;
+    } else if (p_link->speed >= MOVING_SPEED) {
+      // Negative while braking, but also on the charger, which isn't regen.
+      p_link->regen -= energy;
+    }
+  }
+  p_link->power = power;
+  p_link->power_ms = time_ms;
+  p_link->have_power = true;
+}
+
+void ride_stats_reset(uint8_t link) {
+  ride_stats_link_t *p_link;
+
+  if (link >= NINEBOT_MAX_LINKS) {
+    return;
+  }
+  p_link = &m_links[link];
+  p_link->distance = 0;
+  p_link->energy = 0;
+  p_link->regen = 0;
+  p_link->moving_ms = 0;
+  p_link->max_speed = 0;
+}
+
+uint32_t ride_stats_get(uint8_t link, ride_stats_t *stats_out) {
+  ride_stats_link_t copy;
+
+  if (link >= NINEBOT_MAX_LINKS || !stats_out) {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+  // Updated from the BLE event handler, copied whole so the fields agree.
+  CRITICAL_REGION_ENTER();
+  copy = m_links[link];
+  CRITICAL_REGION_EXIT();
+  stats_compute(&copy, stats_out);
+  return NRF_SUCCESS;
+}
+
+#endif // RIDE_STATS_ENABLED
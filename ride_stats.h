@@ -0,0 +1,82 @@
+/*
+  ride_stats.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Trip statistics per scooter link, updated in O(1) per decoded frame from the
+// raw register values, integers only. Energy integrates V x I over the frame
+// timestamps (trapezoid), distance integrates speed. A trip starts when a link
+// connects, unless it was only lost for less than RIDE_STATS_TRIP_GAP_MS.
+
+#ifndef __RIDE_STATS_H
+#define __RIDE_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_config.h"
+#include "ninebot_module.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+typedef struct {
+  uint32_t ride_time_s;            // moving
+  uint32_t distance_m;
+  uint16_t max_speed;              // 0.1 km/h
+  uint16_t avg_speed;              // 0.1 km/h, over the ride time
+  uint32_t energy_mwh;             // drawn from the battery while connected
+  uint32_t regen_mwh;              // put back while moving
+  uint32_t mwh_per_km;             // net, 0 until RIDE_STATS_MIN_DISTANCE_M
+} ride_stats_t;
+
+#define RIDE_STATS_MIN_DISTANCE_M 100  /**< Consumption is only given past this, it's noise before. */
+
+#if RIDE_STATS_ENABLED
+
+void ride_stats_init(void);
+
+// link events
+void ride_stats_link_up(uint8_t link, uint32_t time_ms);
+void ride_stats_link_down(uint8_t link, uint32_t time_ms);
+
+// decoded frames: speed in m/h, voltage in 10 mV, current in 10 mA (negative into the battery)
+void ride_stats_speed_update(uint8_t link, int16_t speed, uint32_t time_ms);
+void ride_stats_power_update(uint8_t link, uint16_t voltage, int16_t current, uint32_t time_ms);
+
+void ride_stats_reset(uint8_t link);
+uint32_t ride_stats_get(uint8_t link, ride_stats_t *stats_out);
+
+#else
+
+#define ride_stats_init()
+#define ride_stats_link_up(link, time_ms)
+#define ride_stats_link_down(link, time_ms)
+#define ride_stats_speed_update(link, speed, time_ms)
+#define ride_stats_power_update(link, voltage, current, time_ms)
+#define ride_stats_reset(link)
+#define ride_stats_get(link, stats_out) NRF_ERROR_NOT_SUPPORTED
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __RIDE_STATS_H */
@@ -56,6 +56,31 @@
 #define BLE_RACP_ENABLED 0
 #endif
 
+// <e> NRF_BLE_GATT_ENABLED - nrf_ble_gatt - GATT module (ATT_MTU negotiation)
+//==========================================================
+#ifndef NRF_BLE_GATT_ENABLED
+#define NRF_BLE_GATT_ENABLED 1
+#endif
+#if  NRF_BLE_GATT_ENABLED
+// <o> NRF_BLE_GATT_MAX_MTU_SIZE - Largest ATT_MTU requested and passed to softdevice_enable. 
+// <i> 67 fits the largest ninebot frame (NinebotMaxPayload + 8) in one notification.
+#ifndef NRF_BLE_GATT_MAX_MTU_SIZE
+#define NRF_BLE_GATT_MAX_MTU_SIZE 67
+#endif
+
+// <o> NRF_BLE_CENTRAL_LINK_COUNT - Central links tracked by nrf_ble_gatt. 
+#ifndef NRF_BLE_CENTRAL_LINK_COUNT
+#define NRF_BLE_CENTRAL_LINK_COUNT SCOOTER_LINK_COUNT
+#endif
+
+// <o> NRF_BLE_PERIPHERAL_LINK_COUNT - Peripheral links tracked by nrf_ble_gatt. 
+#ifndef NRF_BLE_PERIPHERAL_LINK_COUNT
+#define NRF_BLE_PERIPHERAL_LINK_COUNT TELEMETRY_RELAY_ENABLED
+#endif
+
+#endif //NRF_BLE_GATT_ENABLED
+// </e>
+
 // <q> NRF_BLE_QWR_ENABLED  - nrf_ble_qwr - Queued writes support module (prepare/execute write)
  
 
@@ -3165,7 +3190,7 @@
  
 
 #ifndef CRC16_ENABLED
-#define CRC16_ENABLED 0
+#define CRC16_ENABLED 1
 #endif
 
 // <q> CRC32_ENABLED  - crc32 - CRC32 calculation routines
@@ -3185,7 +3210,7 @@
 // <e> FDS_ENABLED - fds - Flash data storage module
 //==========================================================
 #ifndef FDS_ENABLED
-#define FDS_ENABLED 0
+#define FDS_ENABLED 1
 #endif
 #if  FDS_ENABLED
 // <o> FDS_OP_QUEUE_SIZE - Size of the internal queue. 
@@ -3211,7 +3236,7 @@
 // <i> @ref FDS_VIRTUAL_PAGE_SIZE * 4 bytes.
 
 #ifndef FDS_VIRTUAL_PAGES
-#define FDS_VIRTUAL_PAGES 3
+#define FDS_VIRTUAL_PAGES 12
 #endif
 
 // <o> FDS_VIRTUAL_PAGE_SIZE  - The size of a virtual page of flash memory, expressed in number of 4-byte words.
@@ -3232,7 +3257,7 @@
 // <e> FSTORAGE_ENABLED - fstorage - Flash storage module
 //==========================================================
 #ifndef FSTORAGE_ENABLED
-#define FSTORAGE_ENABLED 0
+#define FSTORAGE_ENABLED 1
 #endif
 #if  FSTORAGE_ENABLED
 // <o> FS_QUEUE_SIZE - Configures the size of the internal queue. 
@@ -3665,7 +3690,7 @@
 // <i> Log data is buffered and can be processed in idle.
 //==========================================================
 #ifndef NRF_LOG_DEFERRED
-#define NRF_LOG_DEFERRED 0
+#define NRF_LOG_DEFERRED 1
 #endif
 #if  NRF_LOG_DEFERRED
 // <o> NRF_LOG_DEFERRED_BUFSIZE - Size of the buffer for logs in words. 
@@ -3832,6 +3857,586 @@
 // </h> 
 //==========================================================
 
+// <h> nRF_Application 
+
+//==========================================================
+// <o> SCOOTER_LINK_COUNT - Scooters connected and polled at once (central links). 
+// <i> Each link costs SoftDevice RAM, move SRAM_START in the project when changing this.
+#ifndef SCOOTER_LINK_COUNT
+#define SCOOTER_LINK_COUNT 3
+#endif
+
+// <e> TELEMETRY_BEACON_ENABLED - Broadcast scooter telemetry in non-connectable adverts (telemetry_beacon.h).
+//==========================================================
+#ifndef TELEMETRY_BEACON_ENABLED
+#define TELEMETRY_BEACON_ENABLED 1
+#endif
+#if  TELEMETRY_BEACON_ENABLED
+// <o> TELEMETRY_BEACON_INTERVAL_MS - Advertising interval <100-10240>
+// <i> Shorter is found sooner by a gateway, longer costs less power. Change at runtime with telemetry_beacon_interval_set.
+#ifndef TELEMETRY_BEACON_INTERVAL_MS
+#define TELEMETRY_BEACON_INTERVAL_MS 1000
+#endif
+
+// <o> TELEMETRY_BEACON_COMPANY_ID - Company identifier in front of the frame.
+// <i> 0xFFFF is reserved for testing, use an assigned id for shipped devices.
+#ifndef TELEMETRY_BEACON_COMPANY_ID
+#define TELEMETRY_BEACON_COMPANY_ID 0xFFFF
+#endif
+
+#endif //TELEMETRY_BEACON_ENABLED
+// </e>
+
+// <e> TELEMETRY_RELAY_ENABLED - GATT service relaying telemetry to a phone over a peripheral link (telemetry_relay.h).
+// <i> Needs TELEMETRY_BEACON_ENABLED, takes the one peripheral link. Move SRAM_START in the project when changing this.
+//==========================================================
+#ifndef TELEMETRY_RELAY_ENABLED
+#define TELEMETRY_RELAY_ENABLED 1
+#endif
+#if  TELEMETRY_RELAY_ENABLED
+// <o> TELEMETRY_RELAY_BATCH_MS - Samples are collected this long per notification <50-5000>
+// <i> Rounded up to whole connection intervals. Longer batches mean fewer, fuller packets.
+#ifndef TELEMETRY_RELAY_BATCH_MS
+#define TELEMETRY_RELAY_BATCH_MS 1000
+#endif
+
+#endif //TELEMETRY_RELAY_ENABLED
+// </e>
+
+// <e> RADIO_TIMING_ENABLED - Time scooter requests and display flushes from the radio notification (radio_timing.h).
+// <i> Disable to compare, ninebot_stats logs the request round trip times either way.
+//==========================================================
+#ifndef RADIO_TIMING_ENABLED
+#define RADIO_TIMING_ENABLED 1
+#endif
+#if  RADIO_TIMING_ENABLED
+// <o> RADIO_TIMING_DISTANCE  - Notification ahead of the radio becoming active
+ 
+// <1=> 800us 
+// <2=> 1740us 
+// <3=> 2680us 
+// <4=> 3620us 
+// <5=> 4560us 
+// <6=> 5500us 
+
+#ifndef RADIO_TIMING_DISTANCE
+#define RADIO_TIMING_DISTANCE 1
+#endif
+
+// <o> RADIO_TIMING_AB_LOGS - Alternate aligned and timer polls every n stats logs, 0 always aligns
+// <i> Stats restart on every switch, so each RTT histogram covers one mode under the same conditions.
+#ifndef RADIO_TIMING_AB_LOGS
+#define RADIO_TIMING_AB_LOGS 0
+#endif
+
+#endif //RADIO_TIMING_ENABLED
+// </e>
+
+// <e> TX_POWER_CONTROL_ENABLED - Lower the TX power while every link has margin (tx_power_control.h).
+// <i> The softdevice has a single TX power, the beacon advertises at whatever the links need.
+//==========================================================
+#ifndef TX_POWER_CONTROL_ENABLED
+#define TX_POWER_CONTROL_ENABLED 1
+#endif
+#if  TX_POWER_CONTROL_ENABLED
+// <o> TX_POWER_CONTROL_TARGET_DBM - Signal strength in dBm the peers should still receive us at
+// <i> Sensitivity is around -90 dBm, the rest is fading margin.
+#ifndef TX_POWER_CONTROL_TARGET_DBM
+#define TX_POWER_CONTROL_TARGET_DBM -70
+#endif
+
+// <o> TX_POWER_CONTROL_MIN_DBM - Lowest TX power used <-40-4>
+#ifndef TX_POWER_CONTROL_MIN_DBM
+#define TX_POWER_CONTROL_MIN_DBM -20
+#endif
+
+// <o> TX_POWER_CONTROL_MAX_DBM - TX power while searching, connecting and after a lost response <-40-4>
+#ifndef TX_POWER_CONTROL_MAX_DBM
+#define TX_POWER_CONTROL_MAX_DBM 0
+#endif
+
+#endif //TX_POWER_CONTROL_ENABLED
+// </e>
+
+// <e> RIDE_LOG_ENABLED - Record the rides in flash, exported over the telemetry relay (ride_log.h).
+// <i> Uses the fds pages, see FDS_VIRTUAL_PAGES.
+//==========================================================
+#ifndef RIDE_LOG_ENABLED
+#define RIDE_LOG_ENABLED 1
+#endif
+#if  RIDE_LOG_ENABLED
+// <o> RIDE_LOG_INTERVAL_MS - Time between samples of a scooter <100-60000>
+#ifndef RIDE_LOG_INTERVAL_MS
+#define RIDE_LOG_INTERVAL_MS 1000
+#endif
+
+// <o> RIDE_LOG_IDLE_MS - Longest gap between samples while nothing changes <1000-600000>
+#ifndef RIDE_LOG_IDLE_MS
+#define RIDE_LOG_IDLE_MS 60000
+#endif
+
+#endif //RIDE_LOG_ENABLED
+// </e>
+
+// <e> RIDE_STATS_ENABLED - Trip speed, time and energy per scooter (ride_stats.h).
+//==========================================================
+#ifndef RIDE_STATS_ENABLED
+#define RIDE_STATS_ENABLED 1
+#endif
+#if  RIDE_STATS_ENABLED
+// <o> RIDE_STATS_TRIP_GAP_MS - Reconnecting within this carries on with the same trip <0-3600000>
+#ifndef RIDE_STATS_TRIP_GAP_MS
+#define RIDE_STATS_TRIP_GAP_MS 300000
+#endif
+
+#endif //RIDE_STATS_ENABLED
+// </e>
+
+// <q> RIDE_HISTORY_ENABLED  - Speed and power history graphs, button 0 cycles them (ride_history.h).
+// <i> About 2.4 KB of RAM per scooter link.
+
+#ifndef RIDE_HISTORY_ENABLED
+#define RIDE_HISTORY_ENABLED 1
+#endif
+
+// <q> BOOT_PROFILE_ENABLED  - Logs the startup phase times and boot to first speed (boot_profile.h).
+
+#ifndef BOOT_PROFILE_ENABLED
+#define BOOT_PROFILE_ENABLED 1
+#endif
+
+// <e> WARM_START_ENABLED - Keep telemetry, peer and display state in RAM across resets and sleep (warm_start.h).
+// <i> Needs CRC16_ENABLED.
+//==========================================================
+#ifndef WARM_START_ENABLED
+#define WARM_START_ENABLED 1
+#endif
+#if  WARM_START_ENABLED
+// <o> WARM_START_HOLD_MS - The retained screen stays up this long for the scooters to reconnect <500-30000>
+#ifndef WARM_START_HOLD_MS
+#define WARM_START_HOLD_MS 3000
+#endif
+
+#endif //WARM_START_ENABLED
+// </e>
+
+// <e> POWER_MANAGER_ENABLED - Dim and blank the display when parked, power off without a scooter (power_manager.h).
+//==========================================================
+#ifndef POWER_MANAGER_ENABLED
+#define POWER_MANAGER_ENABLED 1
+#endif
+#if  POWER_MANAGER_ENABLED
+// <o> POWER_MANAGER_DIM_MS - Without activity the display dims after <1000-3600000>
+#ifndef POWER_MANAGER_DIM_MS
+#define POWER_MANAGER_DIM_MS 30000
+#endif
+
+// <o> POWER_MANAGER_OFF_MS - and goes dark after <1000-3600000>
+#ifndef POWER_MANAGER_OFF_MS
+#define POWER_MANAGER_OFF_MS 120000
+#endif
+
+// <o> POWER_MANAGER_SYSTEM_OFF_MS - Without a scooter connected, system-off after <10000-86400000>
+#ifndef POWER_MANAGER_SYSTEM_OFF_MS
+#define POWER_MANAGER_SYSTEM_OFF_MS 600000
+#endif
+
+#endif //POWER_MANAGER_ENABLED
+// </e>
+
+// <q> PERF_MONITOR_ENABLED  - CPU load and display/link throughput, HUD page on a long press (perf_monitor.h).
+
+#ifndef PERF_MONITOR_ENABLED
+#define PERF_MONITOR_ENABLED 1
+#endif
+
+// <e> BUTTONS_ENABLED - Event driven short, long and double presses on the GPIOTE PORT event (buttons.h).
+//==========================================================
+#ifndef BUTTONS_ENABLED
+#define BUTTONS_ENABLED 1
+#endif
+#if  BUTTONS_ENABLED
+// <o> BUTTONS_DEBOUNCE_MS - Edges after the first are ignored for <1-100>
+#ifndef BUTTONS_DEBOUNCE_MS
+#define BUTTONS_DEBOUNCE_MS 15
+#endif
+
+// <o> BUTTONS_LONG_MS - Held this long is a long press <200-5000>
+#ifndef BUTTONS_LONG_MS
+#define BUTTONS_LONG_MS 800
+#endif
+
+// <o> BUTTONS_DOUBLE_MS - Second press within this of the release is a double press <100-1000>
+#ifndef BUTTONS_DOUBLE_MS
+#define BUTTONS_DOUBLE_MS 300
+#endif
+
+#endif //BUTTONS_ENABLED
+// </e>
+
+// <e> CHANGE_FILTER_ENABLED - Only redraw scooter data that moved past a deadband, smooth the shown speed (ninebot_filter.h).
+//==========================================================
+#ifndef CHANGE_FILTER_ENABLED
+#define CHANGE_FILTER_ENABLED 1
+#endif
+#if  CHANGE_FILTER_ENABLED
+// <o> CHANGE_FILTER_SPEED_EMA_SHIFT - Speed average weight, 1/2^n of each reading, 0 for raw speed <0-4>
+#ifndef CHANGE_FILTER_SPEED_EMA_SHIFT
+#define CHANGE_FILTER_SPEED_EMA_SHIFT 2
+#endif
+
+// <o> CHANGE_FILTER_SPEED_BAND - Speed deadband in m/h <0-1000>
+#ifndef CHANGE_FILTER_SPEED_BAND
+#define CHANGE_FILTER_SPEED_BAND 150
+#endif
+
+// <o> CHANGE_FILTER_BATTERY_BAND - Battery deadband in percent <0-10>
+#ifndef CHANGE_FILTER_BATTERY_BAND
+#define CHANGE_FILTER_BATTERY_BAND 1
+#endif
+
+// <o> CHANGE_FILTER_RANGE_BAND - Distance remaining deadband in 10 m <0-1000>
+#ifndef CHANGE_FILTER_RANGE_BAND
+#define CHANGE_FILTER_RANGE_BAND 10
+#endif
+
+// <o> CHANGE_FILTER_ODOMETER_BAND - Odometer deadband in m <0-10000>
+#ifndef CHANGE_FILTER_ODOMETER_BAND
+#define CHANGE_FILTER_ODOMETER_BAND 100
+#endif
+
+// <o> CHANGE_FILTER_CURRENT_BAND - Battery current deadband in 10 mA <0-1000>
+#ifndef CHANGE_FILTER_CURRENT_BAND
+#define CHANGE_FILTER_CURRENT_BAND 20
+#endif
+
+// <o> CHANGE_FILTER_VOLTAGE_BAND - Battery voltage deadband in 10 mV <0-1000>
+#ifndef CHANGE_FILTER_VOLTAGE_BAND
+#define CHANGE_FILTER_VOLTAGE_BAND 10
+#endif
+
+// <o> CHANGE_FILTER_TEMP_BAND - Temperature deadband in C <0-10>
+#ifndef CHANGE_FILTER_TEMP_BAND
+#define CHANGE_FILTER_TEMP_BAND 1
+#endif
+
+// <o> CHANGE_FILTER_HEARTBEAT_MS - Redrawn anyway after <1000-60000>
+#ifndef CHANGE_FILTER_HEARTBEAT_MS
+#define CHANGE_FILTER_HEARTBEAT_MS 5000
+#endif
+
+#endif //CHANGE_FILTER_ENABLED
+// </e>
+
+// <q> SSD1306_LAYERS_ENABLED  - Static layer and mask drawn once per screen, composited into each frame (ssd1306.h).
+
+#ifndef SSD1306_LAYERS_ENABLED
+#define SSD1306_LAYERS_ENABLED 1
+#endif
+
+// <q> GAUGE_ENABLED  - Speedometer page with an animated needle, after the scooter page on the view button (gauge.h).
+
+#ifndef GAUGE_ENABLED
+#define GAUGE_ENABLED 1
+#endif
+
+// <e> APP_CONFIG_LOG_ENABLED - Enables logging in main.c (APP).
+//==========================================================
+#ifndef APP_CONFIG_LOG_ENABLED
+#define APP_CONFIG_LOG_ENABLED 1
+#endif
+#if  APP_CONFIG_LOG_ENABLED
+// <o> APP_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef APP_CONFIG_LOG_LEVEL
+#define APP_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //APP_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> BLE_MODULE_CONFIG_LOG_ENABLED - Enables logging in ble_module.c (BLM).
+//==========================================================
+#ifndef BLE_MODULE_CONFIG_LOG_ENABLED
+#define BLE_MODULE_CONFIG_LOG_ENABLED 1
+#endif
+#if  BLE_MODULE_CONFIG_LOG_ENABLED
+// <o> BLE_MODULE_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef BLE_MODULE_CONFIG_LOG_LEVEL
+#define BLE_MODULE_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //BLE_MODULE_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> NINEBOT_MODULE_CONFIG_LOG_ENABLED - Enables logging in ninebot_module.c (NBM).
+//==========================================================
+#ifndef NINEBOT_MODULE_CONFIG_LOG_ENABLED
+#define NINEBOT_MODULE_CONFIG_LOG_ENABLED 1
+#endif
+#if  NINEBOT_MODULE_CONFIG_LOG_ENABLED
+// <o> NINEBOT_MODULE_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef NINEBOT_MODULE_CONFIG_LOG_LEVEL
+#define NINEBOT_MODULE_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //NINEBOT_MODULE_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> NINEBOT_STATS_CONFIG_LOG_ENABLED - Enables logging in ninebot_stats.c (NBS).
+//==========================================================
+#ifndef NINEBOT_STATS_CONFIG_LOG_ENABLED
+#define NINEBOT_STATS_CONFIG_LOG_ENABLED 1
+#endif
+#if  NINEBOT_STATS_CONFIG_LOG_ENABLED
+// <o> NINEBOT_STATS_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef NINEBOT_STATS_CONFIG_LOG_LEVEL
+#define NINEBOT_STATS_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //NINEBOT_STATS_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> CONN_PARAM_MANAGER_CONFIG_LOG_ENABLED - Enables logging in conn_param_manager.c (CPM).
+//==========================================================
+#ifndef CONN_PARAM_MANAGER_CONFIG_LOG_ENABLED
+#define CONN_PARAM_MANAGER_CONFIG_LOG_ENABLED 1
+#endif
+#if  CONN_PARAM_MANAGER_CONFIG_LOG_ENABLED
+// <o> CONN_PARAM_MANAGER_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef CONN_PARAM_MANAGER_CONFIG_LOG_LEVEL
+#define CONN_PARAM_MANAGER_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //CONN_PARAM_MANAGER_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> TELEMETRY_BEACON_CONFIG_LOG_ENABLED - Enables logging in telemetry_beacon.c (TLM).
+//==========================================================
+#ifndef TELEMETRY_BEACON_CONFIG_LOG_ENABLED
+#define TELEMETRY_BEACON_CONFIG_LOG_ENABLED 1
+#endif
+#if  TELEMETRY_BEACON_CONFIG_LOG_ENABLED
+// <o> TELEMETRY_BEACON_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef TELEMETRY_BEACON_CONFIG_LOG_LEVEL
+#define TELEMETRY_BEACON_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //TELEMETRY_BEACON_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> TELEMETRY_RELAY_CONFIG_LOG_ENABLED - Enables logging in telemetry_relay.c (RLY).
+//==========================================================
+#ifndef TELEMETRY_RELAY_CONFIG_LOG_ENABLED
+#define TELEMETRY_RELAY_CONFIG_LOG_ENABLED 1
+#endif
+#if  TELEMETRY_RELAY_CONFIG_LOG_ENABLED
+// <o> TELEMETRY_RELAY_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef TELEMETRY_RELAY_CONFIG_LOG_LEVEL
+#define TELEMETRY_RELAY_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //TELEMETRY_RELAY_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> TX_POWER_CONTROL_CONFIG_LOG_ENABLED - Enables logging in tx_power_control.c (TXP).
+//==========================================================
+#ifndef TX_POWER_CONTROL_CONFIG_LOG_ENABLED
+#define TX_POWER_CONTROL_CONFIG_LOG_ENABLED 1
+#endif
+#if  TX_POWER_CONTROL_CONFIG_LOG_ENABLED
+// <o> TX_POWER_CONTROL_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef TX_POWER_CONTROL_CONFIG_LOG_LEVEL
+#define TX_POWER_CONTROL_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //TX_POWER_CONTROL_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> RIDE_LOG_CONFIG_LOG_ENABLED - Enables logging in ride_log.c (RLG).
+//==========================================================
+#ifndef RIDE_LOG_CONFIG_LOG_ENABLED
+#define RIDE_LOG_CONFIG_LOG_ENABLED 1
+#endif
+#if  RIDE_LOG_CONFIG_LOG_ENABLED
+// <o> RIDE_LOG_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef RIDE_LOG_CONFIG_LOG_LEVEL
+#define RIDE_LOG_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //RIDE_LOG_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> RIDE_STATS_CONFIG_LOG_ENABLED - Enables logging in ride_stats.c (RST).
+//==========================================================
+#ifndef RIDE_STATS_CONFIG_LOG_ENABLED
+#define RIDE_STATS_CONFIG_LOG_ENABLED 1
+#endif
+#if  RIDE_STATS_CONFIG_LOG_ENABLED
+// <o> RIDE_STATS_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef RIDE_STATS_CONFIG_LOG_LEVEL
+#define RIDE_STATS_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //RIDE_STATS_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> BOOT_PROFILE_CONFIG_LOG_ENABLED - Enables logging in boot_profile.c (BOT).
+//==========================================================
+#ifndef BOOT_PROFILE_CONFIG_LOG_ENABLED
+#define BOOT_PROFILE_CONFIG_LOG_ENABLED 1
+#endif
+#if  BOOT_PROFILE_CONFIG_LOG_ENABLED
+// <o> BOOT_PROFILE_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef BOOT_PROFILE_CONFIG_LOG_LEVEL
+#define BOOT_PROFILE_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //BOOT_PROFILE_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> WARM_START_CONFIG_LOG_ENABLED - Enables logging in warm_start.c (WRM).
+//==========================================================
+#ifndef WARM_START_CONFIG_LOG_ENABLED
+#define WARM_START_CONFIG_LOG_ENABLED 1
+#endif
+#if  WARM_START_CONFIG_LOG_ENABLED
+// <o> WARM_START_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef WARM_START_CONFIG_LOG_LEVEL
+#define WARM_START_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //WARM_START_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> POWER_MANAGER_CONFIG_LOG_ENABLED - Enables logging in power_manager.c (PWR).
+//==========================================================
+#ifndef POWER_MANAGER_CONFIG_LOG_ENABLED
+#define POWER_MANAGER_CONFIG_LOG_ENABLED 1
+#endif
+#if  POWER_MANAGER_CONFIG_LOG_ENABLED
+// <o> POWER_MANAGER_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef POWER_MANAGER_CONFIG_LOG_LEVEL
+#define POWER_MANAGER_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //POWER_MANAGER_CONFIG_LOG_ENABLED
+// </e>
+
+// <e> BUTTONS_CONFIG_LOG_ENABLED - Enables logging in buttons.c (BTN).
+//==========================================================
+#ifndef BUTTONS_CONFIG_LOG_ENABLED
+#define BUTTONS_CONFIG_LOG_ENABLED 1
+#endif
+#if  BUTTONS_CONFIG_LOG_ENABLED
+// <o> BUTTONS_CONFIG_LOG_LEVEL  - Default Severity level
+ 
+// <0=> Off 
+// <1=> Error 
+// <2=> Warning 
+// <3=> Info 
+// <4=> Debug 
+
+#ifndef BUTTONS_CONFIG_LOG_LEVEL
+#define BUTTONS_CONFIG_LOG_LEVEL 3
+#endif
+
+#endif //BUTTONS_CONFIG_LOG_ENABLED
+// </e>
+
+// </h> 
+//==========================================================
+
 // <<< end of configuration section >>>
 #endif //SDK_CONFIG_H
 
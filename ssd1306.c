@@ -87,7 +87,7 @@ static volatile bool use_i2c = false;
 
 // the memory buffer for the LCD
 
-static uint8_t buffer[SSD1306_LCDHEIGHT * SSD1306_LCDWIDTH / 8] = {
+static uint8_t frame_buffer[SSD1306_LCDHEIGHT * SSD1306_LCDWIDTH / 8] __attribute__((aligned(4))) = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -158,6 +158,15 @@ static uint8_t buffer[SSD1306_LCDHEIGHT * SSD1306_LCDWIDTH / 8] = {
 #endif
 };
 
+#if SSD1306_LAYERS_ENABLED
+// Set bits of the static layer are ORed into the frame, set bits of the mask cleared from it.
+static uint32_t static_layer[SSD1306_LCDHEIGHT * SSD1306_LCDWIDTH / 32];
+static uint32_t mask_layer[SSD1306_LCDHEIGHT * SSD1306_LCDWIDTH / 32];
+#endif
+
+// Drawing goes here, the frame unless a layer is selected
+static uint8_t *buffer = frame_buffer;
+
 #define ssd1306_swap(a, b) { int16_t t = a; a = b; b = t; }
 #define adagfxswap(a, b) { int16_t t = a; a = b; b = t; }
 
@@ -548,6 +557,41 @@ void ssd1306_dim(bool dim)
     ssd1306_command(contrast);
 }
 
+// Sleep the panel
+// sleep = true: display off and charge pump off, the controller keeps its RAM
+// sleep = false: back on showing the same frame
+void ssd1306_sleep(bool sleep)
+{
+    if (sleep) {
+        ssd1306_command(SSD1306_DISPLAYOFF);
+        ssd1306_command(SSD1306_CHARGEPUMP);
+        ssd1306_command(0x10);
+    }
+    else {
+        ssd1306_command(SSD1306_CHARGEPUMP);
+        if (_vccstate == SSD1306_EXTERNALVCC) {
+            ssd1306_command(0x10);
+        }
+        else {
+            ssd1306_command(0x14);
+        }
+        ssd1306_command(SSD1306_DISPLAYON);
+    }
+}
+
+// The TWI only has to be enabled while talking to the display
+void ssd1306_twi_enable(bool enable)
+{
+    if (use_i2c) {
+        if (enable) {
+            nrf_drv_twi_enable(&m_twi_master);
+        }
+        else {
+            nrf_drv_twi_disable(&m_twi_master);
+        }
+    }
+}
+
 void ssd1306_data(uint8_t c)
 {
     if (use_i2c) {
@@ -593,7 +637,7 @@ void ssd1306_display(void)
         tmpBuf[0] = control;
         // data
         for (uint8_t j = 0; j < 128; j++) {
-          tmpBuf[j + 1] = buffer[i];
+          tmpBuf[j + 1] = frame_buffer[i];
           i++;
         }
         i--;
@@ -609,7 +653,7 @@ void ssd1306_display(void)
       _HI_DC();
       _LO_CS();
       for (uint16_t i = 0; i < (SSD1306_LCDWIDTH * SSD1306_LCDHEIGHT / 8); i++) {
-        UNUSED_VARIABLE(spi_transfer(&buffer[i], 1));
+        UNUSED_VARIABLE(spi_transfer(&frame_buffer[i], 1));
       }
       _HI_CS();
 #endif
@@ -622,7 +666,140 @@ void ssd1306_clear_display(void)
     memset(buffer, 0, (SSD1306_LCDWIDTH * SSD1306_LCDHEIGHT / 8));
 }
 
+#if SSD1306_LAYERS_ENABLED
+// Draw and clear calls go to the chosen layer until the next select
+void ssd1306_layer_select(ssd1306_layer_t layer)
+{
+    switch (layer) {
+    case ssd1306_layer_static:
+        buffer = (uint8_t *)static_layer;
+        break;
+    case ssd1306_layer_mask:
+        buffer = (uint8_t *)mask_layer;
+        break;
+    default:
+        buffer = frame_buffer;
+        break;
+    }
+}
+
+// frame = (frame | static) & ~mask, a word at a time
+void ssd1306_layers_composite(void)
+{
+    uint32_t *p_frame = (uint32_t *)frame_buffer;
+    for (uint16_t i = 0; i < (SSD1306_LCDWIDTH * SSD1306_LCDHEIGHT / 32); i++) {
+        p_frame[i] = (p_frame[i] | static_layer[i]) & ~mask_layer[i];
+    }
+}
+#endif
+
+// Span engine: a rectangle in panel coordinates is filled a page (8 rows) at a
+// time. The mask for a page is worked out once and applied to the whole run of
+// columns, four columns per 32 bit word once the pointer is aligned.
+static void span_apply(uint8_t *pBuf, int16_t w, uint8_t mask, uint16_t color)
+{
+    uint32_t mask32 = mask * 0x01010101UL;
+
+    for (; w && ((uintptr_t)pBuf & 3); w--, pBuf++) {
+        switch (color) {
+        case WHITE:
+            *pBuf |=  mask;
+            break;
+        case BLACK:
+            *pBuf &= ~mask;
+            break;
+        case INVERSE:
+            *pBuf ^=  mask;
+            break;
+        }
+    }
+
+    register uint32_t *pWord = (uint32_t *)pBuf;
+    switch (color) {
+    case WHITE:
+        for (; w >= 4; w -= 4) {
+            *pWord++ |=  mask32;
+        }
+        break;
+    case BLACK:
+        for (; w >= 4; w -= 4) {
+            *pWord++ &= ~mask32;
+        }
+        break;
+    case INVERSE:
+        for (; w >= 4; w -= 4) {
+            *pWord++ ^=  mask32;
+        }
+        break;
+    }
 
+    for (pBuf = (uint8_t *)pWord; w; w--, pBuf++) {
+        switch (color) {
+        case WHITE:
+            *pBuf |=  mask;
+            break;
+        case BLACK:
+            *pBuf &= ~mask;
+            break;
+        case INVERSE:
+            *pBuf ^=  mask;
+            break;
+        }
+    }
+}
+
+static void span_fill(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    // clip to the panel
+    if (x < 0) {
+        w += x;
+        x = 0;
+    }
+    if (y < 0) {
+        h += y;
+        y = 0;
+    }
+    if ((x + w) > WIDTH) {
+        w = (WIDTH - x);
+    }
+    if ((y + h) > HEIGHT) {
+        h = (HEIGHT - y);
+    }
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    int16_t y_end = y + h;
+    for (int16_t page = y / 8; page * 8 < y_end; page++) {
+        uint8_t mask = 0xFF;
+        if (page * 8 < y) {
+            mask &= (uint8_t)(0xFF << (y & 7));         // first page, rows from y down
+        }
+        if (page * 8 + 8 > y_end) {
+            mask &= (uint8_t)(0xFF >> (page * 8 + 8 - y_end)); // last page, rows above y_end
+        }
+        span_apply(&buffer[page * SSD1306_LCDWIDTH + x], w, mask, color);
+    }
+}
+
+// Rotated to panel coordinates the same way ssd1306_draw_pixel does
+static void span_fill_rotated(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    switch (rotation) {
+    case 1:
+        span_fill(WIDTH - y - h, x, h, w, color);
+        break;
+    case 2:
+        span_fill(WIDTH - x - w, HEIGHT - y - h, w, h, color);
+        break;
+    case 3:
+        span_fill(y, HEIGHT - x - w, h, w, color);
+        break;
+    default:
+        span_fill(x, y, w, h, color);
+        break;
+    }
+}
 
 void ssd1306_draw_fast_hline(int16_t x, int16_t y, int16_t w, uint16_t color)
 {
@@ -662,54 +839,7 @@ void ssd1306_draw_fast_hline(int16_t x, int16_t y, int16_t w, uint16_t color)
 
 void ssd1306_draw_fast_hline_internal(int16_t x, int16_t y, int16_t w, uint16_t color)
 {
-    // Do bounds/limit checks
-    if (y < 0 || y >= HEIGHT) {
-        return;
-    }
-
-    // make sure we don't try to draw below 0
-    if (x < 0) {
-        w += x;
-        x = 0;
-    }
-
-    // make sure we don't go off the edge of the display
-    if ( (x + w) > WIDTH) {
-        w = (WIDTH - x);
-    }
-
-    // if our width is now negative, punt
-    if (w <= 0) {
-        return;
-    }
-
-    // set up the pointer for  movement through the buffer
-    register uint8_t *pBuf = buffer;
-    // adjust the buffer pointer for the current row
-    pBuf += ((y / 8) * SSD1306_LCDWIDTH);
-    // and offset x columns in
-    pBuf += x;
-
-    register uint8_t mask = 1 << (y & 7);
-
-    switch (color) {
-    case WHITE:
-        while (w--) {
-            *pBuf++ |= mask;
-        };
-        break;
-    case BLACK:
-        mask = ~mask;
-        while (w--) {
-            *pBuf++ &= mask;
-        };
-        break;
-    case INVERSE:
-        while (w--) {
-            *pBuf++ ^= mask;
-        };
-        break;
-    }
+    span_fill(x, y, w, 1, color);
 }
 
 void ssd1306_draw_fast_vline(int16_t x, int16_t y, int16_t h, uint16_t color)
@@ -958,81 +1088,108 @@ void ssd1306_fill_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
     ssd1306_fill_circle_helper(x0, y0, r, 3, 0, color);
 }
 
-// Used to do circles and roundrects
+// Used to do circles and roundrects, columns 1 .. r either side of x0.
+// Neighbouring columns of the same height are filled as one span.
 void ssd1306_fill_circle_helper(int16_t x0, int16_t y0, int16_t r,
                                 uint8_t cornername, int16_t delta, uint16_t color)
 {
-
-    int16_t f     = 1 - r;
-    int16_t ddF_x = 1;
-    int16_t ddF_y = -2 * r;
-    int16_t x     = 0;
+    int32_t limit = (int32_t)r * r + r;
     int16_t y     = r;
+    int16_t start = 1;
+    int16_t run_y = -1;
 
-    while (x < y) {
-        if (f >= 0) {
-            y--;
-            ddF_y += 2;
-            f     += ddF_y;
-        }
-        x++;
-        ddF_x += 2;
-        f     += ddF_x;
-
-        if (cornername & 0x1) {
-            ssd1306_draw_fast_vline(x0 + x, y0 - y, 2 * y + 1 + delta, color);
-            ssd1306_draw_fast_vline(x0 + y, y0 - x, 2 * x + 1 + delta, color);
+    for (int16_t x = 1; x <= r + 1; x++) {
+        if (x <= r) {
+            while (y > 0 && (int32_t)x * x + (int32_t)y * y > limit) {
+                y--;
+            }
         }
-        if (cornername & 0x2) {
-            ssd1306_draw_fast_vline(x0 - x, y0 - y, 2 * y + 1 + delta, color);
-            ssd1306_draw_fast_vline(x0 - y, y0 - x, 2 * x + 1 + delta, color);
+        if (x > r || y != run_y) {
+            if (run_y >= 0) {
+                int16_t w = x - start;
+                if (cornername & 0x1) {
+                    ssd1306_fill_rect(x0 + start, y0 - run_y, w, 2 * run_y + 1 + delta, color);
+                }
+                if (cornername & 0x2) {
+                    ssd1306_fill_rect(x0 - x + 1, y0 - run_y, w, 2 * run_y + 1 + delta, color);
+                }
+            }
+            start = x;
+            run_y = y;
         }
     }
 }
 
-// Bresenham's algorithm - thx wikpedia
+// One run of a line along its major axis, advances *major past it
+static void line_run(int16_t *major, int16_t minor, int16_t length, int16_t step, bool steep, uint16_t color)
+{
+    int16_t start = step > 0 ? *major : *major - length + 1;
+    if (steep) {
+        ssd1306_draw_fast_vline(minor, start, length, color);
+    }
+    else {
+        ssd1306_draw_fast_hline(start, minor, length, color);
+    }
+    *major += step * length;
+}
+
+// Run-sliced Bresenham (Abrash): a line is one run along the major axis per
+// step of the minor axis, all runs whole or whole + 1 long. Each run is worked
+// out once and drawn as a span instead of pixel by pixel.
 void ssd1306_draw_line(int16_t x0, int16_t y0,
                        int16_t x1, int16_t y1,
                        uint16_t color)
 {
-    int16_t steep = abs(y1 - y0) > abs(x1 - x0);
+    bool steep = abs(y1 - y0) > abs(x1 - x0);
     if (steep) {
         adagfxswap(x0, y0);
         adagfxswap(x1, y1);
     }
 
-    if (x0 > x1) {
+    // minor axis always counts up, the major axis steps either way
+    if (y0 > y1) {
         adagfxswap(x0, x1);
         adagfxswap(y0, y1);
     }
 
-    int16_t dx, dy;
-    dx = x1 - x0;
-    dy = abs(y1 - y0);
+    int16_t dx = x1 - x0;
+    int16_t dy = y1 - y0;
+    int16_t step = 1;
+    if (dx < 0) {
+        step = -1;
+        dx = -dx;
+    }
 
-    int16_t err = dx / 2;
-    int16_t ystep;
+    if (dy == 0) {
+        line_run(&x0, y0, dx + 1, step, steep, color);
+        return;
+    }
 
-    if (y0 < y1) {
-        ystep = 1;
+    int16_t whole    = dx / dy;         // shortest run
+    int16_t adj_up   = (dx % dy) * 2;
+    int16_t adj_down = dy * 2;
+    int16_t error    = (dx % dy) - adj_down;
+
+    // the first and last runs split a whole run between them
+    int16_t initial = (whole / 2) + 1;
+    int16_t final   = initial;
+    if (adj_up == 0 && (whole & 1) == 0) {
+        initial--;
     }
-    else {
-        ystep = -1;
+    if (whole & 1) {
+        error += dy;
     }
 
-    for (; x0 <= x1; x0++) {
-        if (steep) {
-            ssd1306_draw_pixel(y0, x0, color);
-        }
-        else {
-            ssd1306_draw_pixel(x0, y0, color);
-        }
-        err -= dy;
-        if (err < 0) {
-            y0 += ystep;
-            err += dx;
+    line_run(&x0, y0++, initial, step, steep, color);
+    for (int16_t i = 0; i < dy - 1; i++) {
+        int16_t run = whole;
+        if ((error += adj_up) > 0) {
+            run++;
+            error -= adj_down;
         }
+        line_run(&x0, y0++, run, step, steep, color);
     }
+    line_run(&x0, y0, final, step, steep, color);
 }
 
 // Draw a rectangle
@@ -1064,10 +1221,7 @@ void Adafruit_GFX::drawFastHLine(int16_t x, int16_t y,
 
 void ssd1306_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
 {
-    // Update in subclasses if desired!
-    for (int16_t i = x; i < x + w; i++) {
-        ssd1306_draw_fast_vline(i, y, h, color);
-    }
+    span_fill_rotated(x, y, w, h, color);
 }
 
 void ssd1306_fill_screen(uint16_t color)
@@ -12,6 +12,7 @@
 #endif
 
 #include <stdint.h>
+#include "sdk_config.h"
 
 typedef volatile uint8_t PortReg;
 typedef uint32_t PortMask;
@@ -102,6 +103,15 @@ typedef uint32_t PortMask;
 #define SSD1306_VERTICAL_AND_RIGHT_HORIZONTAL_SCROLL 0x29
 #define SSD1306_VERTICAL_AND_LEFT_HORIZONTAL_SCROLL 0x2A
 
+// With SSD1306_LAYERS_ENABLED content that only changes with the screen is
+// drawn once into the static layer (set pixels) and the mask (cleared pixels),
+// frames redraw the dynamic content and composite before ssd1306_display.
+typedef enum {
+    ssd1306_layer_frame = 0,
+    ssd1306_layer_static,
+    ssd1306_layer_mask
+} ssd1306_layer_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -122,9 +132,15 @@ void ssd1306_start_scroll_diag_right(uint8_t start, uint8_t stop);
 void ssd1306_start_scroll_diag_left(uint8_t start, uint8_t stop);
 void ssd1306_stop_scroll(void);
 void ssd1306_dim(bool dim);
+void ssd1306_sleep(bool sleep);
+void ssd1306_twi_enable(bool enable);
 void ssd1306_data(uint8_t c);
 void ssd1306_display(void);
 void ssd1306_clear_display(void);
+#if SSD1306_LAYERS_ENABLED
+void ssd1306_layer_select(ssd1306_layer_t layer);
+void ssd1306_layers_composite(void);
+#endif
 void ssd1306_draw_fast_hline(int16_t x, int16_t y, int16_t w, uint16_t color);
 void ssd1306_draw_fast_hline_internal(int16_t x, int16_t y, int16_t w, uint16_t color);
 void ssd1306_draw_fast_vline(int16_t x, int16_t y, int16_t h, uint16_t color);
@@ -0,0 +1,215 @@
+/*
+  telemetry_beacon.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_util.h"
+#include "ble_gap.h"
+
+#include "telemetry_beacon.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "TLM"
+#if TELEMETRY_BEACON_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       TELEMETRY_BEACON_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#if TELEMETRY_BEACON_ENABLED
+
+#define FLAGS_FIELD_LENGTH      3                                      /**< len, type, flags. */
+#define MANUF_FIELD_LENGTH      (2 + 2 + sizeof(telemetry_beacon_frame_t)) /**< len, type, company id, frame. */
+#define NO_LINK                 0x0F                                   /**< links low nibble when no scooter is connected. */
+
+STATIC_ASSERT(FLAGS_FIELD_LENGTH + MANUF_FIELD_LENGTH <= BLE_GAP_ADV_MAX_SIZE);
+
+// vars
+static telemetry_beacon_frame_t m_frames[NINEBOT_MAX_LINKS];  // latest values per link, header unused
+static bool m_connected[NINEBOT_MAX_LINKS];
+static telemetry_beacon_frame_t m_frame;                      // on air
+static uint8_t m_adv_data[FLAGS_FIELD_LENGTH + MANUF_FIELD_LENGTH];
+static uint8_t m_sr_data[BLE_GAP_ADV_MAX_SIZE];
+static uint8_t m_sr_length;
+static uint16_t m_interval = MSEC_TO_UNITS(TELEMETRY_BEACON_INTERVAL_MS, UNIT_0_625_MS);
+static bool m_advertising;
+static bool m_connectable;                                    // ADV_IND while the relay has a free slot
+
+// internal
+
+// Scales and rounds to the frame's fixed point units.
+static int32_t scaled(double value, double scale) {
+  value *= scale;
+  return (int32_t)(value < 0.0 ? value - 0.5 : value + 0.5);
+}
+
+static uint32_t adv_data_set(void) {
+  uint8_t index = 0;
+
+  m_adv_data[index++] = FLAGS_FIELD_LENGTH - 1;
+  m_adv_data[index++] = BLE_GAP_AD_TYPE_FLAGS;
+  m_adv_data[index++] = BLE_GAP_ADV_FLAG_BR_EDR_NOT_SUPPORTED;
+
+  m_adv_data[index++] = MANUF_FIELD_LENGTH - 1;
+  m_adv_data[index++] = BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA;
+  index += uint16_encode(TELEMETRY_BEACON_COMPANY_ID, &m_adv_data[index]);
+  memcpy(&m_adv_data[index], &m_frame, sizeof(telemetry_beacon_frame_t));
+  index += sizeof(telemetry_beacon_frame_t);
+
+  // Takes effect from the next advertising event, no need to stop.
+  return sd_ble_gap_adv_data_set(m_adv_data, index, m_sr_length ? m_sr_data : NULL, m_sr_length);
+}
+
+static uint32_t advertising_start(void) {
+  uint32_t error_code;
+  ble_gap_adv_params_t adv_params;
+
+  memset(&adv_params, 0, sizeof(adv_params));
+  adv_params.type = m_connectable ? BLE_GAP_ADV_TYPE_ADV_IND : BLE_GAP_ADV_TYPE_ADV_NONCONN_IND;
+  adv_params.p_peer_addr = NULL;
+  adv_params.fp = BLE_GAP_ADV_FP_ANY;
+  adv_params.interval = m_interval;
+  adv_params.timeout = 0;
+
+  error_code = sd_ble_gap_adv_start(&adv_params);
+  m_advertising = (error_code == NRF_SUCCESS);
+  return error_code;
+}
+
+// Rebuilds the frame from the lowest connected link and only touches the radio when it changed.
+static void frame_refresh(void) {
+  telemetry_beacon_frame_t frame;
+  uint8_t link = NO_LINK;
+  uint8_t count = 0;
+  uint32_t error_code;
+
+  memset(&frame, 0, sizeof(frame));
+  for (uint8_t i = 0; i < NINEBOT_MAX_LINKS; i++) {
+    if (m_connected[i]) {
+      if (count++ == 0) {
+        link = i;
+        frame = m_frames[i];
+      }
+    }
+  }
+  frame.version = TELEMETRY_BEACON_VERSION;
+  frame.links = (uint8_t)((count << 4) | link);
+  frame.sequence = m_frame.sequence;
+
+  if (memcmp(&frame, &m_frame, sizeof(frame)) == 0) {
+    return;
+  }
+
+  frame.sequence++;
+  m_frame = frame;
+  error_code = adv_data_set();
+  if (error_code != NRF_SUCCESS) {
+    NRF_LOG_WARNING("adv_data_set failed: %d\r\n", error_code);
+  }
+}
+
+// Beacon
+
+uint32_t telemetry_beacon_init(void) {
+  uint32_t error_code;
+
+  memset(m_frames, 0, sizeof(m_frames));
+  memset(m_connected, 0, sizeof(m_connected));
+  memset(&m_frame, 0, sizeof(m_frame));
+  m_frame.version = TELEMETRY_BEACON_VERSION;
+  m_frame.links = NO_LINK;
+
+  error_code = adv_data_set();
+  if (error_code == NRF_SUCCESS) {
+    error_code = advertising_start();
+  }
+
+  NRF_LOG_DEBUG("telemetry_beacon_init finished.\r\n");
+  return error_code;
+}
+
+void telemetry_beacon_update(uint8_t link, const ninebot_data_t *data) {
+  telemetry_beacon_frame_t *p_frame;
+
+  if (link >= NINEBOT_MAX_LINKS || !data) {
+    return;
+  }
+
+  // Quantised to the frame's units, so noise below the resolution doesn't count as a change.
+  p_frame = &m_frames[link];
+  m_connected[link] = data->connected;
+  p_frame->speed = (int16_t)scaled(data->speed_kph, 10.0);
+  p_frame->battery = (uint8_t)MIN(MAX(scaled(data->battery_percentage, 100.0), 0), 100);
+  p_frame->range = (uint16_t)MIN(MAX(scaled(data->distance_remaining_km, 100.0), 0), UINT16_MAX);
+  p_frame->error = (uint8_t)MIN(data->error_code, UINT8_MAX);
+  p_frame->odometer = (uint32_t)MAX(scaled(data->odometer_km, 1000.0), 0);
+
+  frame_refresh();
+}
+
+uint32_t telemetry_beacon_interval_set(uint32_t interval_ms) {
+  uint32_t error_code = NRF_SUCCESS;
+  uint32_t interval = MSEC_TO_UNITS(interval_ms, UNIT_0_625_MS);
+
+  if (interval < BLE_GAP_ADV_NONCON_INTERVAL_MIN || interval > BLE_GAP_ADV_INTERVAL_MAX) {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+  if (interval == m_interval) {
+    return NRF_SUCCESS;
+  }
+
+  m_interval = (uint16_t)interval;
+  if (m_advertising) {
+    UNUSED_RETURN_VALUE(sd_ble_gap_adv_stop());
+    error_code = advertising_start();
+  }
+  NRF_LOG_INFO("Beacon interval %d ms\r\n", interval_ms);
+  return error_code;
+}
+
+void telemetry_beacon_connectable_set(bool connectable, const uint8_t *p_sr_data, uint8_t sr_length) {
+  uint32_t error_code;
+
+  m_connectable = connectable;
+  m_sr_length = (p_sr_data && connectable) ? MIN(sr_length, sizeof(m_sr_data)) : 0;
+  if (m_sr_length) {
+    memcpy(m_sr_data, p_sr_data, m_sr_length);
+  }
+
+  // A connection on ADV_IND already stopped us, the stop is for the other direction.
+  UNUSED_RETURN_VALUE(sd_ble_gap_adv_stop());
+  error_code = adv_data_set();
+  if (error_code == NRF_SUCCESS) {
+    error_code = advertising_start();
+  }
+  if (error_code != NRF_SUCCESS) {
+    NRF_LOG_WARNING("Advertising restart failed: %d\r\n", error_code);
+  }
+  NRF_LOG_DEBUG("Advertising %s.\r\n", (uint32_t)(connectable ? "connectable" : "non-connectable"));
+}
+
+#endif // TELEMETRY_BEACON_ENABLED
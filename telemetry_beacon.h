@@ -0,0 +1,79 @@
+/*
+  telemetry_beacon.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Advertises the scooter telemetry in manufacturer data, so a gateway can
+// collect it by just scanning. Runs as a broadcaster next to the central links,
+// connectable while the telemetry relay waits for a phone.
+// Decode with resources/decode_beacon.py.
+
+#ifndef __TELEMETRY_BEACON_H
+#define __TELEMETRY_BEACON_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_config.h"
+#include "ninebot_module.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_BEACON_VERSION 1  /**< Bump when telemetry_beacon_frame_t changes. */
+
+// Follows the 2 byte company id in the manufacturer data, little endian.
+typedef struct __attribute__((packed)) {
+  uint8_t  version;                // TELEMETRY_BEACON_VERSION
+  uint8_t  sequence;               // bumped whenever the content changes
+  uint8_t  links;                  // scooter link index in the low nibble, connected scooters in the high nibble
+  int16_t  speed;                  // 0.1 km/h
+  uint8_t  battery;                // percent
+  uint16_t range;                  // 10 m
+  uint8_t  error;                  // scooter error code, 0 when fine
+  uint32_t odometer;               // m
+} telemetry_beacon_frame_t;
+
+#if TELEMETRY_BEACON_ENABLED
+
+uint32_t telemetry_beacon_init(void);
+
+// Feed every data update, the advertised frame only changes when the values do.
+void telemetry_beacon_update(uint8_t link, const ninebot_data_t *data);
+
+// 100ms .. 10.24s, restarts advertising with the new interval.
+uint32_t telemetry_beacon_interval_set(uint32_t interval_ms);
+
+// Lets a central connect (see telemetry_relay.h), the scan response is copied.
+void telemetry_beacon_connectable_set(bool connectable, const uint8_t *p_sr_data, uint8_t sr_length);
+
+#else
+
+#define telemetry_beacon_init() NRF_SUCCESS
+#define telemetry_beacon_update(link, data)
+#define telemetry_beacon_interval_set(interval_ms) NRF_SUCCESS
+#define telemetry_beacon_connectable_set(connectable, p_sr_data, sr_length)
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __TELEMETRY_BEACON_H */
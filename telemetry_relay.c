@@ -0,0 +1,510 @@
+/*
+  telemetry_relay.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "ble.h"
+#include "ble_gap.h"
+#include "ble_gatts.h"
+
+#include "ms_clock.h"
+#include "varint.h"
+#include "ride_log.h"
+#include "telemetry_beacon.h"
+#include "telemetry_relay.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "RLY"
+#if TELEMETRY_RELAY_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       TELEMETRY_RELAY_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#if TELEMETRY_RELAY_ENABLED
+
+#if !TELEMETRY_BEACON_ENABLED
+#error "TELEMETRY_RELAY_ENABLED needs TELEMETRY_BEACON_ENABLED, the beacon does the advertising."
+#endif
+
+#define APP_TIMER_PRESCALER     0                                        /**< Value of the RTC1 PRESCALER register. */
+#define ATT_HEADER_LENGTH       3                                        /**< Opcode + handle in front of every notification. */
+#define NOTIFY_HEADER_LENGTH    2                                        /**< version, sequence. */
+#define BATCH_MAX_LENGTH        (NRF_BLE_GATT_MAX_MTU_SIZE - ATT_HEADER_LENGTH)
+#define SAMPLE_MAX_LENGTH       (1 + VARINT_MAX_LENGTH * (1 + telemetry_relay_field_count))
+#define SAMPLE_KEYFRAME         0x80
+#define SAMPLE_LINK_SHIFT       5
+#define SAMPLE_FIELDS_MASK      0x1F
+#define KEYFRAME_INTERVAL       50                                       /**< Samples of a link between keyframes, so a late listener can sync. */
+#define SCAN_RSP_LENGTH         (2 + 16)                                 /**< len, type, 128 bit service uuid. */
+
+STATIC_ASSERT(NINEBOT_MAX_LINKS <= 4);                                   // 2 bit link index
+STATIC_ASSERT(telemetry_relay_field_count <= 5);                         // 5 bit field mask
+
+typedef struct {
+  bool keyframe_due;                        // next sample is absolute
+  uint8_t since_keyframe;
+  uint32_t time_ms;                         // of the previous sample
+  int32_t fields[telemetry_relay_field_count];
+} relay_link_t;
+
+// vars
+APP_TIMER_DEF(m_flush_timer_id);
+static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID;
+static uint16_t m_service_handle;
+static ble_gatts_char_handles_t m_telemetry_handles;
+static uint8_t m_scan_rsp[SCAN_RSP_LENGTH];
+static bool m_notifying;
+static uint16_t m_payload_max = GATT_MTU_SIZE_DEFAULT - ATT_HEADER_LENGTH;
+static uint16_t m_conn_interval;            // 1.25 ms units
+static uint8_t m_batch[BATCH_MAX_LENGTH];
+static uint16_t m_batch_length;             // 0 or the header plus samples
+static uint8_t m_sequence;
+static relay_link_t m_links[NINEBOT_MAX_LINKS];
+static uint32_t m_dropped;                  // notifications the softdevice didn't take
+#if RIDE_LOG_ENABLED
+static ble_gatts_char_handles_t m_log_handles;
+static bool m_log_notifying;
+static bool m_exporting;
+static ride_log_cursor_t m_cursor;
+static bool m_cursor_open;
+static uint32_t m_export_sequence;          // next block to open
+static uint16_t m_export_offset;            // bytes of the open block sent
+static uint8_t m_export_buffer[BATCH_MAX_LENGTH];
+#endif
+
+// internal
+
+static int32_t scaled(double value, double scale) {
+  value *= scale;
+  return (int32_t)(value < 0.0 ? value - 0.5 : value + 0.5);
+}
+
+static void links_reset(void) {
+  memset(m_links, 0, sizeof(m_links));
+  for (uint8_t link = 0; link < NINEBOT_MAX_LINKS; link++) {
+    m_links[link].keyframe_due = true;
+  }
+}
+
+static uint8_t sample_encode(uint8_t link, const int32_t *fields, uint32_t now_ms, uint8_t *p_out) {
+  relay_link_t *p_link = &m_links[link];
+  bool keyframe = p_link->keyframe_due || p_link->since_keyframe >= KEYFRAME_INTERVAL;
+  uint8_t header = (uint8_t)(link << SAMPLE_LINK_SHIFT);
+  uint8_t length = 1;
+
+  if (keyframe) {
+    header |= SAMPLE_KEYFRAME;
+    length += varint_encode(now_ms, &p_out[length]);
+  } else {
+    length += varint_encode(now_ms - p_link->time_ms, &p_out[length]);
+  }
+
+  for (uint8_t field = 0; field < telemetry_relay_field_count; field++) {
+    int32_t value = keyframe ? fields[field] : fields[field] - p_link->fields[field];
+    if (keyframe || value != 0) {
+      header |= (1 << field);
+      length += varint_encode(zigzag(value), &p_out[length]);
+    }
+  }
+  p_out[0] = header;
+  return length;
+}
+
+static void sample_commit(uint8_t link, const int32_t *fields, uint32_t now_ms, bool keyframe) {
+  relay_link_t *p_link = &m_links[link];
+  p_link->since_keyframe = keyframe ? 0 : p_link->since_keyframe + 1;
+  p_link->keyframe_due = false;
+  p_link->time_ms = now_ms;
+  memcpy(p_link->fields, fields, sizeof(p_link->fields));
+}
+
+static void batch_flush(void) {
+  uint32_t error_code;
+  uint16_t length = m_batch_length;
+  ble_gatts_hvx_params_t hvx_params;
+
+  if (m_batch_length <= NOTIFY_HEADER_LENGTH) {
+    return;
+  }
+
+  memset(&hvx_params, 0, sizeof(hvx_params));
+  hvx_params.handle = m_telemetry_handles.value_handle;
+  hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
+  hvx_params.offset = 0;
+  hvx_params.p_len = &length;
+  hvx_params.p_data = m_batch;
+
+  error_code = sd_ble_gatts_hvx(m_conn_handle, &hvx_params);
+  if (error_code != NRF_SUCCESS) {
+    // The phone sees the sequence gap, every link restarts from a keyframe.
+    m_dropped++;
+    links_reset();
+    if (error_code != BLE_ERROR_NO_TX_PACKETS) {
+      NRF_LOG_WARNING("hvx failed: %d\r\n", error_code);
+    }
+  }
+  m_sequence++;
+  m_batch_length = 0;
+}
+
+// Samples come from the softdevice event handler, which can preempt this one. The
+// whole flush goes in a critical region so none lands between the hvx and the reset.
+static void flush_timer_handler(void *p_context) {
+  CRITICAL_REGION_ENTER();
+  batch_flush();
+  CRITICAL_REGION_EXIT();
+}
+
+#if RIDE_LOG_ENABLED
+static void export_stop(void) {
+  if (m_cursor_open) {
+    ride_log_block_close(&m_cursor);
+    m_cursor_open = false;
+  }
+  m_exporting = false;
+}
+
+static uint32_t log_notify(uint16_t length) {
+  ble_gatts_hvx_params_t hvx_params;
+
+  memset(&hvx_params, 0, sizeof(hvx_params));
+  hvx_params.handle = m_log_handles.value_handle;
+  hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
+  hvx_params.p_len = &length;
+  hvx_params.p_data = m_export_buffer;
+  return sd_ble_gatts_hvx(m_conn_handle, &hvx_params);
+}
+
+// Sends until the softdevice is out of packets, TX_COMPLETE picks it up again.
+// Nothing is skipped, a notification that didn't go out is built again.
+static void export_pump(void) {
+  uint32_t error_code;
+  uint16_t length;
+
+  while (m_exporting) {
+    if (!m_cursor_open) {
+      if (ride_log_block_open(m_export_sequence, &m_cursor) != NRF_SUCCESS) {
+        m_export_buffer[0] = telemetry_relay_log_end;
+        error_code = log_notify(1);
+        if (error_code == NRF_SUCCESS) {
+          NRF_LOG_INFO("Export finished.\r\n");
+          export_stop();
+        } else if (error_code != BLE_ERROR_NO_TX_PACKETS) {
+          export_stop();
+        }
+        return;
+      }
+      m_cursor_open = true;
+      m_export_offset = 0;
+    }
+
+    length = MIN(m_cursor.length - m_export_offset, m_payload_max - 1);
+    m_export_buffer[0] = telemetry_relay_log_data;
+    memcpy(&m_export_buffer[1], m_cursor.p_data + m_export_offset, length);
+    error_code = log_notify(length + 1);
+    if (error_code != NRF_SUCCESS) {
+      if (error_code != BLE_ERROR_NO_TX_PACKETS) {
+        NRF_LOG_WARNING("Export failed: %d\r\n", error_code);
+        export_stop();
+      }
+      return;
+    }
+    m_export_offset += length;
+    if (m_export_offset >= m_cursor.length) {
+      m_export_sequence = m_cursor.sequence + 1;
+      ride_log_block_close(&m_cursor);
+      m_cursor_open = false;
+    }
+  }
+}
+
+static void on_log_command(uint8_t command) {
+  export_stop();
+  switch (command) {
+  case telemetry_relay_log_export:
+    // The block being filled goes to flash first, it comes last if written in time.
+    ride_log_flush();
+    m_export_sequence = 0;
+    m_exporting = m_log_notifying;
+    NRF_LOG_INFO("Export started.\r\n");
+    export_pump();
+    break;
+
+  case telemetry_relay_log_erase:
+    if (ride_log_erase() != NRF_SUCCESS) {
+      NRF_LOG_WARNING("Erase refused, flash busy.\r\n");
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+#endif // RIDE_LOG_ENABLED
+
+// Flushes on a whole number of connection intervals, so each notification has its own
+// connection event instead of queueing up behind the previous one.
+static void flush_timer_restart(void) {
+  uint32_t error_code;
+  uint32_t interval_us;
+  uint32_t period_us;
+
+  error_code = app_timer_stop(m_flush_timer_id);
+  APP_ERROR_CHECK(error_code);
+  if (!m_notifying) {
+    return;
+  }
+
+  interval_us = MAX(m_conn_interval, 1) * 1250;
+  period_us = CEIL_DIV((uint32_t)TELEMETRY_RELAY_BATCH_MS * 1000, interval_us) * interval_us;
+  error_code = app_timer_start(m_flush_timer_id, (uint32_t)(((uint64_t)period_us * APP_TIMER_CLOCK_FREQ) / 1000000), NULL);
+  APP_ERROR_CHECK(error_code);
+  NRF_LOG_DEBUG("Flushing every %d ms\r\n", period_us / 1000);
+}
+
+static uint32_t service_add(void) {
+  uint32_t error_code;
+  ble_uuid128_t base_uuid = TELEMETRY_RELAY_BASE_UUID;
+  ble_uuid_t uuid;
+  ble_gatts_char_md_t char_md;
+  ble_gatts_attr_md_t cccd_md;
+  ble_gatts_attr_md_t attr_md;
+  ble_gatts_attr_t attr;
+
+  error_code = sd_ble_uuid_vs_add(&base_uuid, &uuid.type);
+  VERIFY_SUCCESS(error_code);
+  uuid.uuid = TELEMETRY_RELAY_SERVICE_UUID;
+  error_code = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &uuid, &m_service_handle);
+  VERIFY_SUCCESS(error_code);
+
+  memset(&cccd_md, 0, sizeof(cccd_md));
+  BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+  BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+  cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+
+  memset(&char_md, 0, sizeof(char_md));
+  char_md.char_props.notify = 1;
+  char_md.p_cccd_md = &cccd_md;
+
+  // Notify only, the value itself is never read.
+  memset(&attr_md, 0, sizeof(attr_md));
+  BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.read_perm);
+  BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+  attr_md.vloc = BLE_GATTS_VLOC_STACK;
+  attr_md.vlen = 1;
+
+  uuid.uuid = TELEMETRY_RELAY_TELEMETRY_UUID;
+  memset(&attr, 0, sizeof(attr));
+  attr.p_uuid = &uuid;
+  attr.p_attr_md = &attr_md;
+  attr.init_len = 1;
+  attr.max_len = BATCH_MAX_LENGTH;
+
+  error_code = sd_ble_gatts_characteristic_add(m_service_handle, &char_md, &attr, &m_telemetry_handles);
+  VERIFY_SUCCESS(error_code);
+
+#if RIDE_LOG_ENABLED
+  // One byte command in, the log notified out.
+  char_md.char_props.write = 1;
+  char_md.char_props.write_wo_resp = 1;
+  BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+  uuid.uuid = TELEMETRY_RELAY_LOG_UUID;
+  error_code = sd_ble_gatts_characteristic_add(m_service_handle, &char_md, &attr, &m_log_handles);
+  VERIFY_SUCCESS(error_code);
+#endif
+
+  // Complete list of 128 bit service uuids, the phone filters its scan on it.
+  m_scan_rsp[0] = SCAN_RSP_LENGTH - 1;
+  m_scan_rsp[1] = BLE_GAP_AD_TYPE_128BIT_SERVICE_UUID_COMPLETE;
+  memcpy(&m_scan_rsp[2], base_uuid.uuid128, sizeof(base_uuid.uuid128));
+  UNUSED_RETURN_VALUE(uint16_encode(TELEMETRY_RELAY_SERVICE_UUID, &m_scan_rsp[2 + 12]));
+  return NRF_SUCCESS;
+}
+
+static void on_connected(const ble_gap_evt_t *p_gap_evt) {
+  m_conn_handle = p_gap_evt->conn_handle;
+  m_conn_interval = p_gap_evt->params.connected.conn_params.max_conn_interval;
+  m_payload_max = GATT_MTU_SIZE_DEFAULT - ATT_HEADER_LENGTH;
+  m_notifying = false;
+  m_batch_length = 0;
+  NRF_LOG_INFO("Phone connected.\r\n");
+  // Our one peripheral slot is taken, back to a plain beacon.
+  telemetry_beacon_connectable_set(false, NULL, 0);
+}
+
+static void on_disconnected(void) {
+  m_conn_handle = BLE_CONN_HANDLE_INVALID;
+  m_notifying = false;
+#if RIDE_LOG_ENABLED
+  m_log_notifying = false;
+  export_stop();
+#endif
+  m_batch_length = 0;
+  flush_timer_restart();
+  NRF_LOG_INFO("Phone disconnected, %d notifications dropped.\r\n", m_dropped);
+  telemetry_beacon_connectable_set(true, m_scan_rsp, sizeof(m_scan_rsp));
+}
+
+static void on_write(const ble_gatts_evt_write_t *p_write) {
+  if (p_write->handle == m_telemetry_handles.cccd_handle && p_write->len == 2) {
+    m_notifying = (uint16_decode(p_write->data) & BLE_GATT_HVX_NOTIFICATION) != 0;
+    m_batch_length = 0;
+    m_dropped = 0;
+    links_reset();
+    flush_timer_restart();
+    NRF_LOG_INFO("Notifications %s.\r\n", (uint32_t)(m_notifying ? "on" : "off"));
+  }
+#if RIDE_LOG_ENABLED
+  if (p_write->handle == m_log_handles.cccd_handle && p_write->len == 2) {
+    m_log_notifying = (uint16_decode(p_write->data) & BLE_GATT_HVX_NOTIFICATION) != 0;
+    if (!m_log_notifying) {
+      export_stop();
+    }
+  } else if (p_write->handle == m_log_handles.value_handle && p_write->len >= 1) {
+    on_log_command(p_write->data[0]);
+  }
+#endif
+}
+
+// Relay
+
+uint32_t telemetry_relay_init(void) {
+  uint32_t error_code;
+
+  links_reset();
+
+  error_code = app_timer_create(&m_flush_timer_id, APP_TIMER_MODE_REPEATED, flush_timer_handler);
+  VERIFY_SUCCESS(error_code);
+  error_code = service_add();
+  VERIFY_SUCCESS(error_code);
+
+  telemetry_beacon_connectable_set(true, m_scan_rsp, sizeof(m_scan_rsp));
+  NRF_LOG_DEBUG("telemetry_relay_init finished.\r\n");
+  return NRF_SUCCESS;
+}
+
+void telemetry_relay_on_ble_evt(ble_evt_t *p_ble_evt) {
+  const ble_gap_evt_t *p_gap_evt = &p_ble_evt->evt.gap_evt;
+
+  switch (p_ble_evt->header.evt_id) {
+  case BLE_GAP_EVT_CONNECTED:
+    if (p_gap_evt->params.connected.role == BLE_GAP_ROLE_PERIPH) {
+      on_connected(p_gap_evt);
+    }
+    break;
+
+  case BLE_GAP_EVT_DISCONNECTED:
+    if (p_gap_evt->conn_handle == m_conn_handle) {
+      on_disconnected();
+    }
+    break;
+
+  case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+    if (p_gap_evt->conn_handle == m_conn_handle) {
+      m_conn_interval = p_gap_evt->params.conn_param_update.conn_params.max_conn_interval;
+      flush_timer_restart();
+    }
+    break;
+
+  case BLE_GATTS_EVT_WRITE:
+    if (p_ble_evt->evt.gatts_evt.conn_handle == m_conn_handle) {
+      on_write(&p_ble_evt->evt.gatts_evt.params.write);
+    }
+    break;
+
+#if RIDE_LOG_ENABLED
+  case BLE_EVT_TX_COMPLETE:
+    if (p_ble_evt->evt.common_evt.conn_handle == m_conn_handle) {
+      export_pump();
+    }
+    break;
+#endif
+
+  case BLE_GATTS_EVT_SYS_ATTR_MISSING:
+    // No bonding, the CCCD always starts off.
+    if (p_ble_evt->evt.gatts_evt.conn_handle == m_conn_handle) {
+      UNUSED_RETURN_VALUE(sd_ble_gatts_sys_attr_set(m_conn_handle, NULL, 0, 0));
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+void telemetry_relay_mtu_update(uint16_t conn_handle, uint16_t att_mtu) {
+  if (conn_handle == m_conn_handle) {
+    m_payload_max = MIN(MAX(att_mtu, GATT_MTU_SIZE_DEFAULT), NRF_BLE_GATT_MAX_MTU_SIZE) - ATT_HEADER_LENGTH;
+    NRF_LOG_DEBUG("Notification payload %d\r\n", m_payload_max);
+  }
+}
+
+void telemetry_relay_sample(uint8_t link, const ninebot_data_t *data) {
+  int32_t fields[telemetry_relay_field_count];
+  uint8_t sample[SAMPLE_MAX_LENGTH];
+  uint8_t length;
+  uint32_t now_ms;
+  bool keyframe;
+
+  if (!m_notifying || link >= NINEBOT_MAX_LINKS || !data || !data->connected) {
+    return;
+  }
+
+  fields[telemetry_relay_field_speed] = scaled(data->speed_kph, 10.0);
+  fields[telemetry_relay_field_battery] = scaled(data->battery_percentage, 100.0);
+  fields[telemetry_relay_field_range] = scaled(data->distance_remaining_km, 100.0);
+  fields[telemetry_relay_field_error] = data->error_code;
+  fields[telemetry_relay_field_odometer] = scaled(data->odometer_km, 1000.0);
+  now_ms = ms_clock_now();
+
+  length = sample_encode(link, fields, now_ms, sample);
+  if (length > m_payload_max - NOTIFY_HEADER_LENGTH) {
+    // Only a keyframe with huge values on a default MTU link gets here.
+    m_links[link].keyframe_due = true;
+    return;
+  }
+  if (m_batch_length + length > m_payload_max) {
+    batch_flush();
+    // A failed flush turns this sample into a keyframe.
+    length = sample_encode(link, fields, now_ms, sample);
+  }
+  if (m_batch_length == 0) {
+    m_batch[0] = TELEMETRY_RELAY_VERSION;
+    m_batch[1] = m_sequence;
+    m_batch_length = NOTIFY_HEADER_LENGTH;
+  }
+  keyframe = (sample[0] & SAMPLE_KEYFRAME) != 0;
+  memcpy(&m_batch[m_batch_length], sample, length);
+  m_batch_length += length;
+  sample_commit(link, fields, now_ms, keyframe);
+}
+
+#endif // TELEMETRY_RELAY_ENABLED
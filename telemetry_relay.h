@@ -0,0 +1,104 @@
+/*
+  telemetry_relay.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// GATT service on a peripheral link that relays every decoded sample to a
+// phone or logger. Samples are delta encoded and batched, several per
+// notification, and flushed on a multiple of the connection interval.
+// Decode with resources/decode_relay.py.
+//
+// Notification:
+//   version, sequence, then samples until the end of the notification.
+// Sample:
+//   header   bit 7 keyframe, bits 6..5 link, bits 4..0 which fields follow
+//   time     varint ms, absolute on a keyframe, else since the link's previous sample
+//   fields   zigzag varint each, in telemetry_relay_field_t order, absolute on a
+//            keyframe (every field present), else the change since the previous sample
+// A sequence gap means a notification was dropped, deltas resume after each
+// link's next keyframe.
+//
+// Ride log export (RIDE_LOG_ENABLED), on its own characteristic: write a
+// telemetry_relay_log_command_t, enable notifications first. Every notification
+// starts with a telemetry_relay_log_notify_t, data ones carry the next bytes of
+// the stored blocks (see ride_log.h) back to back, oldest first.
+
+#ifndef __TELEMETRY_RELAY_H
+#define __TELEMETRY_RELAY_H
+
+#include <stdint.h>
+#include "ble.h"
+#include "sdk_config.h"
+#include "ninebot_module.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_RELAY_VERSION 1  /**< Bump when the notification encoding changes. */
+
+// 128 bit base, the service and characteristic go in bytes 12 and 13.
+#define TELEMETRY_RELAY_BASE_UUID {{0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0, 0x93, 0xF3, 0xA3, 0xB5, 0x00, 0x00, 0x65, 0x13}}
+#define TELEMETRY_RELAY_SERVICE_UUID   0x0001
+#define TELEMETRY_RELAY_TELEMETRY_UUID 0x0002  /**< Notify only. */
+#define TELEMETRY_RELAY_LOG_UUID       0x0003  /**< Write a command, notifies the ride log. */
+
+typedef enum {
+  telemetry_relay_log_stop = 0,
+  telemetry_relay_log_export,          // every stored block, after writing the one being filled
+  telemetry_relay_log_erase,
+} telemetry_relay_log_command_t;
+
+typedef enum {
+  telemetry_relay_log_end = 0,         // export finished
+  telemetry_relay_log_data,
+} telemetry_relay_log_notify_t;
+
+typedef enum {
+  telemetry_relay_field_speed = 0,     // 0.1 km/h
+  telemetry_relay_field_battery,       // percent
+  telemetry_relay_field_range,         // 10 m
+  telemetry_relay_field_error,         // scooter error code
+  telemetry_relay_field_odometer,      // m
+  telemetry_relay_field_count
+} telemetry_relay_field_t;
+
+#if TELEMETRY_RELAY_ENABLED
+
+uint32_t telemetry_relay_init(void);
+void telemetry_relay_on_ble_evt(ble_evt_t *p_ble_evt);
+void telemetry_relay_mtu_update(uint16_t conn_handle, uint16_t att_mtu);
+
+// Feed every data update, dropped while nobody is subscribed.
+void telemetry_relay_sample(uint8_t link, const ninebot_data_t *data);
+
+#else
+
+#define telemetry_relay_init() NRF_SUCCESS
+#define telemetry_relay_on_ble_evt(p_ble_evt)
+#define telemetry_relay_mtu_update(conn_handle, att_mtu)
+#define telemetry_relay_sample(link, data)
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __TELEMETRY_RELAY_H */
@@ -0,0 +1,129 @@
+/*
+  time_series.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_util.h"
+
+#include "time_series.h"
+
+STATIC_ASSERT(TIME_SERIES_RAW_LENGTH <= UINT8_MAX);
+STATIC_ASSERT(TIME_SERIES_TIER_LENGTH <= UINT8_MAX);
+STATIC_ASSERT(TIME_SERIES_TIER_COUNT + 1 == time_series_resolution_count);
+
+// vars
+static const uint32_t m_tier_ms[TIME_SERIES_TIER_COUNT] = { 10000, 60000 };
+
+// internal
+
+static void tier_open(time_series_tier_t *p_tier, uint32_t start_ms) {
+  p_tier->sum = 0;
+  p_tier->samples = 0;
+  p_tier->min = INT16_MAX;
+  p_tier->max = INT16_MIN;
+  p_tier->start_ms = start_ms;
+}
+
+static void tier_push(time_series_tier_t *p_tier, const time_series_bucket_t *p_bucket) {
+  p_tier->buckets[p_tier->head] = *p_bucket;
+  p_tier->head = (p_tier->head + 1) % TIME_SERIES_TIER_LENGTH;
+  if (p_tier->count < TIME_SERIES_TIER_LENGTH) {
+    p_tier->count++;
+  }
+}
+
+// Closes the open bucket, and an empty one for every period without samples.
+static void tier_close(time_series_tier_t *p_tier, uint32_t duration_ms, uint32_t time_ms) {
+  time_series_bucket_t bucket;
+  uint32_t periods = (time_ms - p_tier->start_ms) / duration_ms;
+
+  bucket.min = p_tier->min;
+  bucket.max = p_tier->max;
+  bucket.avg = p_tier->samples ? (int16_t)(p_tier->sum / p_tier->samples) : 0;
+  tier_push(p_tier, &bucket);
+
+  // Bounded, a long gap just empties the tier.
+  bucket.min = INT16_MAX;
+  bucket.max = INT16_MIN;
+  bucket.avg = 0;
+  for (uint32_t i = 1; i < MIN(periods, TIME_SERIES_TIER_LENGTH + 1); i++) {
+    tier_push(p_tier, &bucket);
+  }
+  tier_open(p_tier, p_tier->start_ms + periods * duration_ms);
+}
+
+// Time series
+
+void time_series_init(time_series_t *p_series) {
+  memset(p_series, 0, sizeof(time_series_t));
+}
+
+void time_series_add(time_series_t *p_series, int16_t value, uint32_t time_ms) {
+  p_series->raw[p_series->raw_head] = value;
+  p_series->raw_head = (p_series->raw_head + 1) % TIME_SERIES_RAW_LENGTH;
+  if (p_series->raw_count < TIME_SERIES_RAW_LENGTH) {
+    p_series->raw_count++;
+  }
+
+  for (uint8_t i = 0; i < TIME_SERIES_TIER_COUNT; i++) {
+    time_series_tier_t *p_tier = &p_series->tiers[i];
+    if (!p_series->started) {
+      // Aligned to the tier, so buckets of the same age line up across series.
+      tier_open(p_tier, time_ms - (time_ms % m_tier_ms[i]));
+    } else if (time_ms - p_tier->start_ms >= m_tier_ms[i]) {
+      tier_close(p_tier, m_tier_ms[i], time_ms);
+    }
+    p_tier->sum += value;
+    p_tier->samples++;
+    p_tier->min = MIN(p_tier->min, value);
+    p_tier->max = MAX(p_tier->max, value);
+  }
+  p_series->started = true;
+}
+
+uint8_t time_series_length(const time_series_t *p_series, time_series_resolution_t resolution) {
+  if (resolution == time_series_raw) {
+    return p_series->raw_count;
+  }
+  if (resolution < time_series_resolution_count) {
+    return p_series->tiers[resolution - 1].count;
+  }
+  return 0;
+}
+
+bool time_series_get(const time_series_t *p_series, time_series_resolution_t resolution, uint8_t age, time_series_bucket_t *p_bucket) {
+  if (age >= time_series_length(p_series, resolution)) {
+    return false;
+  }
+  if (resolution == time_series_raw) {
+    uint8_t index = (p_series->raw_head + TIME_SERIES_RAW_LENGTH - 1 - age) % TIME_SERIES_RAW_LENGTH;
+    p_bucket->min = p_series->raw[index];
+    p_bucket->max = p_bucket->min;
+    p_bucket->avg = p_bucket->min;
+  } else {
+    const time_series_tier_t *p_tier = &p_series->tiers[resolution - 1];
+    *p_bucket = p_tier->buckets[(p_tier->head + TIME_SERIES_TIER_LENGTH - 1 - age) % TIME_SERIES_TIER_LENGTH];
+  }
+  return true;
+}
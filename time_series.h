@@ -0,0 +1,87 @@
+/*
+  time_series.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Fixed size history of one value, like a tiny RRD: the raw samples of about
+// the last minute, plus min/max/avg buckets at coarser resolutions that close
+// on the sample timestamps, so a gap shows up as empty buckets. Adding a sample
+// is O(1), every tier aggregates it directly.
+
+#ifndef __TIME_SERIES_H
+#define __TIME_SERIES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+#define TIME_SERIES_RAW_LENGTH   192     /**< A minute of samples at the 3 Hz poll rate. */
+#define TIME_SERIES_TIER_COUNT   2       /**< 10 s and 60 s buckets, see time_series.c. */
+#define TIME_SERIES_TIER_LENGTH  64      /**< Buckets kept per tier, ~10 min and ~1 h. */
+
+typedef enum {
+  time_series_raw = 0,
+  time_series_10s,
+  time_series_60s,
+  time_series_resolution_count
+} time_series_resolution_t;
+
+typedef struct {
+  int16_t min;
+  int16_t max;                           // below min when no sample landed in the bucket
+  int16_t avg;
+} time_series_bucket_t;
+
+typedef struct {
+  time_series_bucket_t buckets[TIME_SERIES_TIER_LENGTH];
+  uint8_t  head;                         // next bucket written
+  uint8_t  count;
+  // open bucket
+  int32_t  sum;
+  uint16_t samples;
+  int16_t  min;
+  int16_t  max;
+  uint32_t start_ms;
+} time_series_tier_t;
+
+typedef struct {
+  int16_t  raw[TIME_SERIES_RAW_LENGTH];
+  uint8_t  raw_head;
+  uint8_t  raw_count;
+  bool     started;
+  time_series_tier_t tiers[TIME_SERIES_TIER_COUNT];
+} time_series_t;
+
+void time_series_init(time_series_t *p_series);
+void time_series_add(time_series_t *p_series, int16_t value, uint32_t time_ms);
+
+// Stored entries at a resolution, the open bucket isn't counted.
+uint8_t time_series_length(const time_series_t *p_series, time_series_resolution_t resolution);
+
+// age 0 is the newest, raw samples come back with min = max = avg. False past the stored range.
+bool time_series_get(const time_series_t *p_series, time_series_resolution_t resolution, uint8_t age, time_series_bucket_t *p_bucket);
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __TIME_SERIES_H */
@@ -0,0 +1,330 @@
+/*
+  tx_power_control.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "ble_gap.h"
+
+#include "tx_power_control.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "TXP"
+#if TX_POWER_CONTROL_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       TX_POWER_CONTROL_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#if TX_POWER_CONTROL_ENABLED
+
+#define APP_TIMER_PRESCALER     0                               /**< Value of the RTC1 PRESCALER register. */
+#define EVALUATE_INTERVAL_MS    500                             /**< RSSI sampled and the power reconsidered this often. */
+#define HYSTERESIS_DB           6                               /**< Margin above the target the next lower level must still leave. */
+#define STEP_DOWN_HOLD          10                              /**< Evaluations in a row with that margin before stepping down (5s). */
+#define LOSS_HOLDOFF            60                              /**< Evaluations at full power after a lost response (30s). */
+#define RSSI_FILTER_FALL        2                               /**< Weakening samples count 1/n, so a fading link is seen quickly. */
+#define RSSI_FILTER_RISE        8                               /**< Strengthening samples count 1/n. */
+#define PEER_TX_POWER_DBM       0                               /**< Assumed, neither scooter nor phone tell us theirs. */
+#define LOG_INTERVAL            120                             /**< Log the stats every n evaluations (60s). */
+#define HISTORY_INTERVAL        (TX_POWER_CONTROL_HISTORY_MS / EVALUATE_INTERVAL_MS)
+
+typedef struct {
+  uint16_t conn_handle;
+  bool sampled;                    // rssi_ema holds at least one reading
+  int16_t rssi_ema;                // dBm * 16
+} tx_power_link_t;
+
+static const int8_t m_levels[TX_POWER_CONTROL_LEVEL_COUNT] = TX_POWER_CONTROL_LEVELS;
+
+// vars
+APP_TIMER_DEF(m_evaluate_timer_id);
+static tx_power_link_t m_links[TX_POWER_CONTROL_MAX_LINKS];
+static uint8_t m_level;                 // index into m_levels, in effect now
+static uint8_t m_min_level;
+static uint8_t m_max_level;
+static uint8_t m_hold;                  // evaluations in a row that allowed a step down
+static uint8_t m_holdoff;               // evaluations left at full power after a loss
+static int8_t m_rssi;                   // weakest link, dBm, 0 when nothing is connected
+static uint32_t m_level_ms[TX_POWER_CONTROL_LEVEL_COUNT];
+static uint32_t m_steps_down;
+static uint32_t m_steps_up;
+static uint32_t m_loss_events;
+static tx_power_sample_t m_history[TX_POWER_CONTROL_HISTORY];
+static uint8_t m_history_next;
+static uint8_t m_history_count;
+
+// internal
+
+static tx_power_link_t *link_find(uint16_t conn_handle) {
+  for (uint8_t i = 0; i < TX_POWER_CONTROL_MAX_LINKS; i++) {
+    if (m_links[i].conn_handle == conn_handle) {
+      return &m_links[i];
+    }
+  }
+  return NULL;
+}
+
+// Nearest level at or below dbm, clamped to the table.
+static uint8_t level_for(int8_t dbm) {
+  uint8_t level = 0;
+  while (level + 1 < TX_POWER_CONTROL_LEVEL_COUNT && m_levels[level + 1] <= dbm) {
+    level++;
+  }
+  return level;
+}
+
+static void level_set(uint8_t level) {
+  uint32_t err_code;
+  if (level == m_level) {
+    return;
+  }
+  err_code = sd_ble_gap_tx_power_set(m_levels[level]);
+  if (err_code != NRF_SUCCESS) {
+    NRF_LOG_WARNING("tx_power_set failed: %d\r\n", err_code);
+    return;
+  }
+  if (level < m_level) {
+    m_steps_down++;
+  } else {
+    m_steps_up++;
+  }
+  NRF_LOG_INFO("TX power %d dBm, rssi %d dBm\r\n", m_levels[level], m_rssi);
+  m_level = level;
+  m_hold = 0;
+}
+
+static void rssi_add(tx_power_link_t *p_link, int8_t rssi) {
+  int16_t sample = (int16_t)(rssi * 16);
+  if (!p_link->sampled) {
+    p_link->sampled = true;
+    p_link->rssi_ema = sample;
+  } else {
+    int16_t divisor = sample < p_link->rssi_ema ? RSSI_FILTER_FALL : RSSI_FILTER_RISE;
+    p_link->rssi_ema += (sample - p_link->rssi_ema) / divisor;
+  }
+}
+
+static void history_add(void) {
+  m_history[m_history_next].rssi = m_rssi;
+  m_history[m_history_next].tx_power = m_levels[m_level];
+  m_history_next = (m_history_next + 1) % TX_POWER_CONTROL_HISTORY;
+  if (m_history_count < TX_POWER_CONTROL_HISTORY) {
+    m_history_count++;
+  }
+}
+
+// The peer hears us at about our TX power minus the path loss, and the path loss is
+// PEER_TX_POWER_DBM minus what we hear from it.
+static int16_t peer_rssi(int8_t rssi, uint8_t level) {
+  return (int16_t)rssi - PEER_TX_POWER_DBM + m_levels[level];
+}
+
+static void evaluate(void) {
+  int16_t weakest = INT16_MAX;
+  bool unknown = false;
+  uint8_t level = m_level;
+
+  for (uint8_t i = 0; i < TX_POWER_CONTROL_MAX_LINKS; i++) {
+    tx_power_link_t *p_link = &m_links[i];
+    int8_t rssi;
+    if (p_link->conn_handle == BLE_CONN_HANDLE_INVALID) {
+      continue;
+    }
+    if (sd_ble_gap_rssi_get(p_link->conn_handle, &rssi) == NRF_SUCCESS) {
+      rssi_add(p_link, rssi);
+    }
+    if (p_link->sampled) {
+      weakest = MIN(weakest, p_link->rssi_ema);
+    } else {
+      unknown = true;
+    }
+  }
+
+  if (weakest == INT16_MAX || unknown) {
+    // Nothing to go by: searching, connecting or a link without a reading yet.
+    m_rssi = weakest == INT16_MAX ? 0 : (int8_t)(weakest / 16);
+    level = m_max_level;
+    m_hold = 0;
+  } else {
+    m_rssi = (int8_t)(weakest / 16);
+    if (peer_rssi(m_rssi, level) < TX_POWER_CONTROL_TARGET_DBM) {
+      // Up in one go, to the lowest level that reaches the target.
+      m_hold = 0;
+      while (level < m_max_level && peer_rssi(m_rssi, level) < TX_POWER_CONTROL_TARGET_DBM) {
+        level++;
+      }
+    } else if (m_holdoff > 0) {
+      m_holdoff--;
+    } else if (level > m_min_level && peer_rssi(m_rssi, level - 1) >= TX_POWER_CONTROL_TARGET_DBM + HYSTERESIS_DB) {
+      // Down one level at a time, each after a sustained margin.
+      if (++m_hold >= STEP_DOWN_HOLD) {
+        level--;
+      }
+    } else {
+      m_hold = 0;
+    }
+  }
+  level_set(level);
+}
+
+static void evaluate_timer_handler(void *p_context) {
+  static uint8_t history_counter = 0;
+  static uint8_t log_counter = 0;
+
+  evaluate();
+  m_level_ms[m_level] += EVALUATE_INTERVAL_MS;
+  if (++history_counter >= HISTORY_INTERVAL) {
+    history_counter = 0;
+    history_add();
+  }
+  if (++log_counter >= LOG_INTERVAL) {
+    log_counter = 0;
+    tx_power_control_log();
+  }
+}
+
+// TX power control
+
+uint32_t tx_power_control_init(void) {
+  uint32_t err_code;
+
+  for (uint8_t i = 0; i < TX_POWER_CONTROL_MAX_LINKS; i++) {
+    m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    m_links[i].sampled = false;
+  }
+  m_min_level = level_for(TX_POWER_CONTROL_MIN_DBM);
+  m_max_level = level_for(TX_POWER_CONTROL_MAX_DBM);
+  m_hold = 0;
+  m_holdoff = 0;
+  m_rssi = 0;
+  m_steps_down = 0;
+  m_steps_up = 0;
+  m_loss_events = 0;
+  memset(m_level_ms, 0, sizeof(m_level_ms));
+  m_history_next = 0;
+  m_history_count = 0;
+
+  m_level = m_max_level;
+  err_code = sd_ble_gap_tx_power_set(m_levels[m_level]);
+  VERIFY_SUCCESS(err_code);
+
+  err_code = app_timer_create(&m_evaluate_timer_id, APP_TIMER_MODE_REPEATED, evaluate_timer_handler);
+  VERIFY_SUCCESS(err_code);
+  err_code = app_timer_start(m_evaluate_timer_id, APP_TIMER_TICKS(EVALUATE_INTERVAL_MS, APP_TIMER_PRESCALER), NULL);
+
+  NRF_LOG_DEBUG("tx_power_control_init finished.\r\n");
+  return err_code;
+}
+
+void tx_power_control_on_ble_evt(ble_evt_t *p_ble_evt) {
+  const ble_gap_evt_t *p_gap_evt = &p_ble_evt->evt.gap_evt;
+  tx_power_link_t *p_link;
+  uint32_t err_code;
+
+  switch (p_ble_evt->header.evt_id) {
+  case BLE_GAP_EVT_CONNECTED:
+    p_link = link_find(BLE_CONN_HANDLE_INVALID);
+    if (!p_link) {
+      NRF_LOG_WARNING("No free link for 0x%x.\r\n", p_gap_evt->conn_handle);
+      break;
+    }
+    p_link->conn_handle = p_gap_evt->conn_handle;
+    p_link->sampled = false;
+    // Read with sd_ble_gap_rssi_get on every evaluation, no events.
+    err_code = sd_ble_gap_rssi_start(p_gap_evt->conn_handle, BLE_GAP_RSSI_THRESHOLD_INVALID, 0);
+    if (err_code != NRF_SUCCESS) {
+      NRF_LOG_WARNING("rssi_start failed: %d\r\n", err_code);
+    }
+    // Full power until the new link has a reading.
+    level_set(m_max_level);
+    break;
+
+  case BLE_GAP_EVT_DISCONNECTED:
+    p_link = link_find(p_gap_evt->conn_handle);
+    if (p_link && p_gap_evt->conn_handle != BLE_CONN_HANDLE_INVALID) {
+      p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+      p_link->sampled = false;
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+void tx_power_control_link_loss(uint16_t conn_handle) {
+  if (!link_find(conn_handle) || conn_handle == BLE_CONN_HANDLE_INVALID) {
+    return;
+  }
+  m_loss_events++;
+  m_holdoff = LOSS_HOLDOFF;
+  if (m_level != m_max_level) {
+    NRF_LOG_INFO("0x%x lost a response at %d dBm.\r\n", conn_handle, m_levels[m_level]);
+    level_set(m_max_level);
+  }
+}
+
+void tx_power_control_stats_get(tx_power_control_stats_t *stats_out) {
+  if (!stats_out) {
+    return;
+  }
+  stats_out->tx_power = m_levels[m_level];
+  stats_out->rssi = m_rssi;
+  stats_out->steps_down = m_steps_down;
+  stats_out->steps_up = m_steps_up;
+  stats_out->loss_events = m_loss_events;
+  for (uint8_t i = 0; i < TX_POWER_CONTROL_LEVEL_COUNT; i++) {
+    stats_out->level_seconds[i] = m_level_ms[i] / 1000;
+  }
+}
+
+uint8_t tx_power_control_history_get(tx_power_sample_t *history_out, uint8_t max_count) {
+  uint8_t count = MIN(m_history_count, max_count);
+  // The newest count entries, oldest first.
+  uint8_t index = (m_history_next + TX_POWER_CONTROL_HISTORY - count) % TX_POWER_CONTROL_HISTORY;
+
+  if (!history_out) {
+    return 0;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    history_out[i] = m_history[index];
+    index = (index + 1) % TX_POWER_CONTROL_HISTORY;
+  }
+  return count;
+}
+
+void tx_power_control_log(void) {
+  NRF_LOG_INFO("TX %d dBm, rssi %d dBm: down %d up %d loss %d\r\n",
+      m_levels[m_level], m_rssi, m_steps_down, m_steps_up, m_loss_events);
+  for (uint8_t i = m_min_level; i <= m_max_level; i++) {
+    NRF_LOG_INFO("%d dBm: %d s\r\n", m_levels[i], m_level_ms[i] / 1000);
+  }
+}
+
+#endif // TX_POWER_CONTROL_ENABLED
@@ -0,0 +1,83 @@
+/*
+  tx_power_control.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Steps the radio TX power down while every link has margin to spare (the
+// display sits next to the scooter) and back up as soon as a link weakens or
+// loses a response. The softdevice has one TX power for all roles, so the
+// weakest connection decides, and the beacon advertises at the same power.
+
+#ifndef __TX_POWER_CONTROL_H
+#define __TX_POWER_CONTROL_H
+
+#include <stdint.h>
+#include "ble.h"
+#include "sdk_config.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+#define TX_POWER_CONTROL_MAX_LINKS    (NRF_BLE_CENTRAL_LINK_COUNT + NRF_BLE_PERIPHERAL_LINK_COUNT)  /**< Every connection, scooters and phone. */
+#define TX_POWER_CONTROL_LEVELS       {-40, -20, -16, -12, -8, -4, 0, 3, 4}  /**< dBm, what the nRF52 radio accepts. */
+#define TX_POWER_CONTROL_LEVEL_COUNT  9
+#define TX_POWER_CONTROL_HISTORY      32    /**< History entries, oldest dropped first. */
+#define TX_POWER_CONTROL_HISTORY_MS   4000  /**< One history entry this often. */
+
+typedef struct {
+  int8_t rssi;                      // dBm, weakest link smoothed, 0 while nothing is connected
+  int8_t tx_power;                  // dBm
+} tx_power_sample_t;
+
+typedef struct {
+  int8_t tx_power;                  // dBm, in effect now
+  int8_t rssi;                      // dBm, weakest link smoothed
+  uint32_t steps_down;
+  uint32_t steps_up;
+  uint32_t loss_events;             // lost responses that forced full power
+  uint32_t level_seconds[TX_POWER_CONTROL_LEVEL_COUNT];  // time spent at each of TX_POWER_CONTROL_LEVELS
+} tx_power_control_stats_t;
+
+#if TX_POWER_CONTROL_ENABLED
+
+uint32_t tx_power_control_init(void);
+void tx_power_control_on_ble_evt(ble_evt_t *p_ble_evt);
+
+// A request on the link went unanswered, back to full power for a while.
+void tx_power_control_link_loss(uint16_t conn_handle);
+
+// readers
+void tx_power_control_stats_get(tx_power_control_stats_t *stats_out);
+uint8_t tx_power_control_history_get(tx_power_sample_t *history_out, uint8_t max_count);  // oldest first, returns the count
+void tx_power_control_log(void);
+
+#else
+
+#define tx_power_control_init() NRF_SUCCESS
+#define tx_power_control_on_ble_evt(p_ble_evt)
+#define tx_power_control_link_loss(conn_handle)
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __TX_POWER_CONTROL_H */
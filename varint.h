@@ -0,0 +1,55 @@
+/*
+  varint.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// LEB128 style varints and zigzag, shared by the relay and the ride log encodings.
+
+#ifndef __VARINT_H
+#define __VARINT_H
+
+#include <stdint.h>
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+#define VARINT_MAX_LENGTH 5  /**< Bytes of a 32 bit value. */
+
+// 7 bits per byte, low bits first, top bit set while more follow.
+static inline uint8_t varint_encode(uint32_t value, uint8_t *p_out) {
+  uint8_t length = 0;
+  while (value >= 0x80) {
+    p_out[length++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  p_out[length++] = (uint8_t)value;
+  return length;
+}
+
+// Small negative deltas stay small: 0, -1, 1, -2 .. -> 0, 1, 2, 3 ..
+static inline uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __VARINT_H */
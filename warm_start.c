@@ -0,0 +1,184 @@
+/*
+  warm_start.c
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "nrf.h"
+#include "app_error.h"
+#include "app_util_platform.h"
+#include "crc16.h"
+#include "sdk_macros.h"
+#include "softdevice_handler.h"
+
+#include "warm_start.h"
+
+#include "sdk_config.h"
+#define NRF_LOG_MODULE_NAME "WRM"
+#if WARM_START_CONFIG_LOG_ENABLED
+#define NRF_LOG_LEVEL       WARM_START_CONFIG_LOG_LEVEL
+#else
+#define NRF_LOG_LEVEL       0
+#endif
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#if WARM_START_ENABLED
+
+#define STATE_MAGIC         0x4D524157  /**< "WARM". */
+#define RAM_BASE            0x20000000
+#define RAM_SECTION_SIZE    0x1000      /**< Retention is set per 4 KB section, two per RAM block. */
+#define CRC_START           offsetof(warm_start_state_t, boot_count)
+
+typedef struct {
+  uint32_t magic;
+  uint16_t length;                     // sizeof, a layout change starts cold
+  uint16_t crc;                        // from boot_count on
+  uint32_t boot_count;
+  ninebot_data_t scooters[NINEBOT_MAX_LINKS];
+  peer_cache_entry_t peer;
+  bool peer_valid;
+  warm_start_display_t display;
+} warm_start_state_t;
+
+// vars
+static warm_start_state_t m_state __attribute__((section(".non_init")));  // not zeroed by the startup code
+static bool m_warm;
+static uint32_t m_reset_reason;
+static uint32_t m_flags;                     // GPREGRET at boot
+
+// internal
+
+static uint16_t state_crc(void) {
+  return crc16_compute((const uint8_t *)&m_state + CRC_START, sizeof(warm_start_state_t) - CRC_START, NULL);
+}
+
+// Called after every change, a reset before it lands just means a cold start.
+static void state_seal(void) {
+  m_state.crc = state_crc();
+}
+
+// Warm start
+
+uint32_t warm_start_init(void) {
+  m_reset_reason = NRF_POWER->RESETREAS;
+  NRF_POWER->RESETREAS = m_reset_reason;     // cleared by writing ones
+  m_flags = NRF_POWER->GPREGRET;
+  NRF_POWER->GPREGRET = m_flags & ~WARM_START_FLAG_SLEEP;
+
+  m_warm = (m_state.magic == STATE_MAGIC) && (m_state.length == sizeof(warm_start_state_t)) && (m_state.crc == state_crc());
+  if (!m_warm) {
+    memset(&m_state, 0, sizeof(m_state));
+    m_state.magic = STATE_MAGIC;
+    m_state.length = sizeof(warm_start_state_t);
+  }
+  m_state.boot_count++;
+  state_seal();
+
+  NRF_LOG_INFO("%s start %d, reset reason 0x%x%s\r\n", (uint32_t)(m_warm ? "Warm" : "Cold"), m_state.boot_count, m_reset_reason,
+               (uint32_t)((m_flags & WARM_START_FLAG_SLEEP) ? ", woke from sleep" : ""));
+  return NRF_SUCCESS;
+}
+
+bool warm_start_is_warm(void) {
+  return m_warm;
+}
+
+bool warm_start_woke_from_sleep(void) {
+  return (m_flags & WARM_START_FLAG_SLEEP) != 0;
+}
+
+uint32_t warm_start_reset_reason(void) {
+  return m_reset_reason;
+}
+
+void warm_start_telemetry_store(uint8_t link, const ninebot_data_t *data) {
+  if (link < NINEBOT_MAX_LINKS && data) {
+    m_state.scooters[link] = *data;
+    state_seal();
+  }
+}
+
+bool warm_start_telemetry_get(uint8_t link, ninebot_data_t *data_out) {
+  if (!m_warm || link >= NINEBOT_MAX_LINKS || !data_out) {
+    return false;
+  }
+  *data_out = m_state.scooters[link];
+  return true;
+}
+
+void warm_start_peer_store(const peer_cache_entry_t *entry) {
+  m_state.peer_valid = (entry != NULL);
+  if (entry) {
+    m_state.peer = *entry;
+  }
+  state_seal();
+}
+
+bool warm_start_peer_get(peer_cache_entry_t *entry_out) {
+  if (!m_warm || !m_state.peer_valid || !entry_out) {
+    return false;
+  }
+  *entry_out = m_state.peer;
+  return true;
+}
+
+void warm_start_display_store(const warm_start_display_t *display) {
+  if (display && memcmp(&m_state.display, display, sizeof(warm_start_display_t)) != 0) {
+    m_state.display = *display;
+    state_seal();
+  }
+}
+
+bool warm_start_display_get(warm_start_display_t *display_out) {
+  if (!m_warm || !display_out) {
+    return false;
+  }
+  *display_out = m_state.display;
+  return true;
+}
+
+uint32_t warm_start_system_off(void) {
+  uint32_t first = ((uint32_t)&m_state - RAM_BASE) / RAM_SECTION_SIZE;
+  uint32_t last = ((uint32_t)&m_state + sizeof(m_state) - 1 - RAM_BASE) / RAM_SECTION_SIZE;
+  uint32_t error_code;
+
+  // POWER belongs to the SoftDevice while it runs, and it has no call for RAM retention.
+  error_code = softdevice_handler_sd_disable();
+  VERIFY_SUCCESS(error_code);
+
+  for (uint32_t section = first; section <= last; section++) {
+    NRF_POWER->RAM[section / 2].POWERSET = (POWER_RAM_POWERSET_S0RETENTION_On << (POWER_RAM_POWERSET_S0RETENTION_Pos + (section % 2)));
+  }
+  NRF_POWER->GPREGRET |= WARM_START_FLAG_SLEEP;
+  NRF_POWER->SYSTEMOFF = 1;
+  __DSB();
+
+  // Only reached in debug interface mode, where system-off is emulated.
+  while (true) {
+    __WFE();
+  }
+}
+
+#endif // WARM_START_ENABLED
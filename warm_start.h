@@ -0,0 +1,90 @@
+/*
+  warm_start.h
+
+  Xiaomi M365 Display
+  Copyright (c) 2018 Richard Heard. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// State kept in .non_init RAM across resets and system-off wake: the last
+// telemetry of every link, the cached peer with its NUS handles and what the
+// display showed. A CRC decides whether it survived (a brownout or power on
+// leaves garbage), GPREGRET says whether we went to sleep on purpose.
+
+#ifndef __WARM_START_H
+#define __WARM_START_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_config.h"
+#include "ninebot_module.h"
+#include "peer_cache.h"
+
+#ifdef __splusplus
+extern "C" {
+#endif
+
+#define WARM_START_FLAG_SLEEP  0x01  /**< GPREGRET bit, system-off was entered on purpose. */
+
+typedef struct {
+  uint8_t view_page;
+  bool    graph_shown;
+  uint8_t graph_resolution;
+} warm_start_display_t;
+
+#if WARM_START_ENABLED
+
+// Before the SoftDevice, reads and clears RESETREAS and our GPREGRET bits directly.
+uint32_t warm_start_init(void);
+
+bool warm_start_is_warm(void);
+bool warm_start_woke_from_sleep(void);
+uint32_t warm_start_reset_reason(void);  // RESETREAS, 0 after power on or brownout
+
+// Kept current while running, the getters only return what survived a warm start.
+void warm_start_telemetry_store(uint8_t link, const ninebot_data_t *data);
+bool warm_start_telemetry_get(uint8_t link, ninebot_data_t *data_out);
+void warm_start_peer_store(const peer_cache_entry_t *entry);    // NULL forgets the peer
+bool warm_start_peer_get(peer_cache_entry_t *entry_out);
+void warm_start_display_store(const warm_start_display_t *display);
+bool warm_start_display_get(warm_start_display_t *display_out);
+
+// Retains the state's RAM through system-off, flags the sleep and powers down.
+// Disables the SoftDevice, only returns on failure.
+uint32_t warm_start_system_off(void);
+
+#else
+
+#define WARM_START_HOLD_MS 0  /**< Nothing is ever restored. */
+#define warm_start_init() NRF_SUCCESS
+#define warm_start_is_warm() false
+#define warm_start_woke_from_sleep() false
+#define warm_start_reset_reason() 0
+#define warm_start_telemetry_store(link, data)
+#define warm_start_telemetry_get(link, data_out) false
+#define warm_start_peer_store(entry)
+#define warm_start_peer_get(entry_out) false
+#define warm_start_display_store(display)
+#define warm_start_display_get(display_out) false
+#define warm_start_system_off() sd_power_system_off()
+
+#endif
+
+#ifdef __splusplus
+}
+#endif
+
+#endif /* __WARM_START_H */